@@ -30,10 +30,85 @@
 
 pthread_rwlock_t GeoIPBackend::s_state_lock=PTHREAD_RWLOCK_INITIALIZER;
 
+/* Record contents and service targets are split into literal text and
+   placeholders when the zones are loaded, so lookups only have to fill in
+   the GeoIP attributes instead of searching the template for '%' again. */
+class GeoIPFormat {
+public:
+  enum Placeholder {
+    Literal, Continent, Country, AF, ASn, Region, Name, City,
+    // everything below depends on the time or on the exact client address
+    Hour, Year, YearDay, WeekdayName, MonthName, Weekday, Month, IP
+  };
+  struct Part {
+    Placeholder type;
+    string text;
+  };
+
+  GeoIPFormat(): d_volatile(false) {};
+  explicit GeoIPFormat(const string& format);
+
+  const string& str() const { return d_format; };
+  const vector<Part>& parts() const { return d_parts; };
+  // nothing to substitute, str() is the answer
+  bool isLiteral() const { return d_parts.empty(); };
+  // result is not determined by the GeoIP data for the client network alone
+  bool isVolatile() const { return d_volatile; };
+
+private:
+  string d_format;
+  vector<Part> d_parts;
+  bool d_volatile;
+};
+
+GeoIPFormat::GeoIPFormat(const string& format): d_format(format), d_volatile(false) {
+  // longer tokens first where they share a prefix
+  static const struct {
+    const char* token;
+    Placeholder type;
+  } tokens[] = {
+    { "%cn", Continent }, { "%co", Country }, { "%af", AF }, { "%as", ASn },
+    { "%re", Region }, { "%na", Name }, { "%ci", City }, { "%hh", Hour },
+    { "%yy", Year }, { "%dd", YearDay }, { "%wds", WeekdayName }, { "%mos", MonthName },
+    { "%wd", Weekday }, { "%mo", Month }, { "%ip", IP }
+  };
+  string literal;
+  string::size_type cur, last = 0;
+
+  while((cur = format.find('%', last)) != string::npos) {
+    bool matched = false;
+    for(const auto& t: tokens) {
+      size_t len = strlen(t.token);
+      if (format.compare(cur, len, t.token)) continue;
+      literal.append(format, last, cur - last);
+      if (!literal.empty()) {
+        d_parts.push_back(Part{Literal, literal});
+        literal.clear();
+      }
+      d_parts.push_back(Part{t.type, string()});
+      if (t.type >= Hour) d_volatile = true;
+      last = cur + len;
+      matched = true;
+      break;
+    }
+    if (matched) continue;
+    // '%%' and unknown placeholders are left alone
+    size_t skip = format.compare(cur, 2, "%%") ? 1 : 2;
+    literal.append(format, last, cur + skip - last);
+    last = cur + skip;
+  }
+
+  if (d_parts.empty()) return;
+  literal.append(format, last, string::npos);
+  if (!literal.empty())
+    d_parts.push_back(Part{Literal, literal});
+}
+
 struct GeoIPDNSResourceRecord: DNSResourceRecord {
 public:
 	int weight;
 	bool has_weight;
+	GeoIPFormat content_format;
 };
 
 class GeoIPDomain {
@@ -41,12 +116,16 @@ public:
   int id;
   DNSName domain;
   int ttl;
-  map<DNSName, NetmaskTree<vector<string> > > services;
+  map<DNSName, NetmaskTree<vector<GeoIPFormat> > > services;
   map<DNSName, vector<GeoIPDNSResourceRecord> > records;
 };
 
 static vector<GeoIPDomain> s_domains;
 static int s_rc = 0; // refcount
+static uint64_t s_generation = 0; // bumped on every (re)load, invalidates the service caches
+
+// bounds the per-instance service cache, it is simply dropped when full
+static const size_t s_maxServiceCacheEntries = 65536;
 
 struct geoip_deleter {
   void operator()(GeoIP* ptr) {
@@ -84,6 +163,8 @@ GeoIPBackend::GeoIPBackend(const string& suffix) {
     initialize();
   }
   s_rc++;
+  d_serviceCacheEntries = 0;
+  d_serviceCacheGeneration = s_generation;
 }
 
 void GeoIPBackend::initialize() {
@@ -178,22 +259,24 @@ void GeoIPBackend::initialize() {
           rr.weight = 100;
         } 
         rr.auth = 1;
+        rr.content_format = GeoIPFormat(rr.content);
         rrs.push_back(rr);
       }
       std::swap(dom.records[qname], rrs);
     }
 
     for(YAML::const_iterator service = domain["services"].begin(); service != domain["services"].end(); service++) {
-      NetmaskTree<vector<string> > nmt;
+      NetmaskTree<vector<GeoIPFormat> > nmt;
 
       // if it's an another map, we need to iterate it again, otherwise we just add two root entries.
       if (service->second.IsMap()) {
         for(YAML::const_iterator net = service->second.begin(); net != service->second.end(); net++) {
-          vector<string> value;
+          vector<GeoIPFormat> value;
           if (net->second.IsSequence()) {
-            value = net->second.as<vector<string> >();
+            for(const auto& format: net->second.as<vector<string> >())
+              value.push_back(GeoIPFormat(format));
           } else {
-            value.push_back(net->second.as<string>());
+            value.push_back(GeoIPFormat(net->second.as<string>()));
           }
           if (net->first.as<string>() == "default") {
             nmt.insert(Netmask("0.0.0.0/0")).second.assign(value.begin(),value.end());
@@ -203,11 +286,12 @@ void GeoIPBackend::initialize() {
           }
         }
       } else {
-        vector<string> value;
+        vector<GeoIPFormat> value;
         if (service->second.IsSequence()) {
-          value = service->second.as<vector<string> >();
+          for(const auto& format: service->second.as<vector<string> >())
+            value.push_back(GeoIPFormat(format));
         } else {
-          value.push_back(service->second.as<string>());
+          value.push_back(GeoIPFormat(service->second.as<string>()));
         }
         nmt.insert(Netmask("0.0.0.0/0")).second.assign(value.begin(),value.end());
         nmt.insert(Netmask("::/0")).second.swap(value);
@@ -287,6 +371,7 @@ void GeoIPBackend::initialize() {
 
   s_domains.clear();
   std::swap(s_domains, tmp_domains);
+  s_generation++;
 }
 
 GeoIPBackend::~GeoIPBackend() {
@@ -304,9 +389,8 @@ GeoIPBackend::~GeoIPBackend() {
 
 void GeoIPBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket *pkt_p, int zoneId) {
   ReadLock rl(&s_state_lock);
-  GeoIPDomain dom;
+  const GeoIPDomain* dom = NULL;
   GeoIPLookup gl;
-  bool found = false;
   int probability_rnd = 1+(random() % 1000); // setting probability=0 means it never is used
   int cumul_probability = 0;
 
@@ -318,16 +402,15 @@ void GeoIPBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket
   d_result.clear();
 
   if (zoneId > -1 && zoneId < static_cast<int>(s_domains.size())) 
-    dom = s_domains[zoneId];
+    dom = &s_domains[zoneId];
   else {
     for(const GeoIPDomain& i : s_domains) {   // this is arguably wrong, we should probably find the most specific match
       if (search.isPartOf(i.domain)) {
-        dom = i;
-        found = true;
+        dom = &i;
         break;
       }
     }
-    if (!found) return; // not found
+    if (dom == NULL) return; // not found
   }
 
   string ip = "0.0.0.0";
@@ -339,8 +422,8 @@ void GeoIPBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket
 
   gl.netmask = 0;
 
-  auto i = dom.records.find(search);
-  if (i != dom.records.end()) { // return static value
+  auto i = dom->records.find(search);
+  if (i != dom->records.end()) { // return static value
     for(const auto& rr : i->second) {
       if (rr.has_weight) {
         gl.netmask = (v6?128:32);
@@ -351,7 +434,8 @@ void GeoIPBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket
       }
       if (qtype == QType::ANY || rr.qtype == qtype) {
 	d_result.push_back(rr);
-        d_result.back().content = format2str(rr.content, ip, v6, &gl);
+        if (!rr.content_format.isLiteral())
+          d_result.back().content = format2str(rr.content_format, ip, v6, &gl);
 	d_result.back().qname = qdomain;
       }
     }
@@ -362,47 +446,83 @@ void GeoIPBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket
     return; // no need to go further
   }
 
-  auto target = dom.services.find(search);
-  if (target == dom.services.end()) return; // no hit
+  auto target = dom->services.find(search);
+  if (target == dom->services.end()) return; // no hit
 
-  const NetmaskTree<vector<string> >::node_type* node = target->second.lookup(ComboAddress(ip));
+  ComboAddress addr(ip);
+  const service_node_t* node = target->second.lookup(addr);
   if (node == NULL) return; // no hit, again.
 
+  if (d_serviceCacheGeneration != s_generation) {
+    d_serviceCache.clear();
+    d_serviceCacheEntries = 0;
+    d_serviceCacheGeneration = s_generation;
+  }
+
   string format;
   gl.netmask = node->first.getBits();
-
-  // note that this means the array format won't work with indirect
-  for(auto it = node->second.begin(); it != node->second.end(); it++) {
-    format = format2str(*it, ip, v6, &gl);
-
-    // see if the record can be found
-    auto ri = dom.records.find(DNSName(format));
-    if (ri != dom.records.end()) { // return static value
-      for(const auto& rr: ri->second) {
-        if (qtype == QType::ANY || rr.qtype == qtype) {
-          d_result.push_back(rr);
-          d_result.back().content = format2str(rr.content, ip, v6, &gl);
-          d_result.back().qname = qdomain;
-        }
+  auto ri = dom->records.end();
+
+  /* the chosen target only depends on the GeoIP data for the client, which is
+     the same for the whole network GeoIP reported, so remember it for that
+     network. Keying on the service node keeps more specific service netmasks
+     inside that network from being shadowed. */
+  NetmaskTree<string>& cache = d_serviceCache[node];
+  const NetmaskTree<string>::node_type* cached = cache.lookup(addr);
+  if (cached != NULL) {
+    format = cached->second;
+    gl.netmask = cached->first.getBits();
+    ri = dom->records.find(DNSName(format));
+  } else {
+    bool cacheable = true;
+    // note that this means the array format won't work with indirect
+    for(const auto& fmt: node->second) {
+      format = format2str(fmt, ip, v6, &gl);
+      if (fmt.isVolatile())
+        cacheable = false;
+
+      // see if the record can be found
+      ri = dom->records.find(DNSName(format));
+      if (ri != dom->records.end())
+        break;
+    }
+    // "unknown" GeoIP answers come back as host routes, no point keeping those
+    if (cacheable && gl.netmask < (v6?128:32)) {
+      if (d_serviceCacheEntries >= s_maxServiceCacheEntries) {
+        d_serviceCache.clear();
+        d_serviceCacheEntries = 0;
       }
-      // ensure we get most strict netmask
-      for(DNSResourceRecord& rr: d_result) {
-        rr.scopeMask = gl.netmask;
+      d_serviceCache[node].insert_or_assign(Netmask(addr, gl.netmask), format);
+      d_serviceCacheEntries++;
+    }
+  }
+
+  if (ri != dom->records.end()) { // return static value
+    for(const auto& rr: ri->second) {
+      if (qtype == QType::ANY || rr.qtype == qtype) {
+        d_result.push_back(rr);
+        if (!rr.content_format.isLiteral())
+          d_result.back().content = format2str(rr.content_format, ip, v6, &gl);
+        d_result.back().qname = qdomain;
       }
-      return; // no need to go further
     }
+    // ensure we get most strict netmask
+    for(DNSResourceRecord& rr: d_result) {
+      rr.scopeMask = gl.netmask;
+    }
+    return; // no need to go further
   }
 
   // we need this line since we otherwise claim to have NS records etc
   if (!(qtype == QType::ANY || qtype == QType::CNAME)) return;
 
   DNSResourceRecord rr;
-  rr.domain_id = dom.id;
+  rr.domain_id = dom->id;
   rr.qtype = QType::CNAME;
   rr.qname = qdomain;
   rr.content = format;
   rr.auth = 1;
-  rr.ttl = dom.ttl;
+  rr.ttl = dom->ttl;
   rr.scopeMask = gl.netmask;
   d_result.push_back(rr);
 }
@@ -663,68 +783,83 @@ string GeoIPBackend::queryGeoIP(const string &ip, bool v6, GeoIPQueryAttribute a
   return ret;
 }
 
-string GeoIPBackend::format2str(string format, const string& ip, bool v6, GeoIPLookup* gl) {
-  string::size_type cur,last;
-  time_t t = time((time_t*)NULL);
+string GeoIPBackend::format2str(const GeoIPFormat& format, const string& ip, bool v6, GeoIPLookup* gl) {
+  if (format.isLiteral())
+    return format.str();
+
   GeoIPLookup tmp_gl; // largest wins
   struct tm gtm;
-  gmtime_r(&t, &gtm);
-  last=0;
+  if (format.isVolatile()) {
+    time_t t = time((time_t*)NULL);
+    gmtime_r(&t, &gtm);
+  }
 
-  while((cur = format.find("%", last)) != string::npos) {
+  string ret;
+  for(const auto& part: format.parts()) {
     string rep;
-    int nrep=3;
     tmp_gl.netmask = 0;
-    if (!format.compare(cur,3,"%cn")) {
+    switch(part.type) {
+    case GeoIPFormat::Literal:
+      ret.append(part.text);
+      continue;
+    case GeoIPFormat::Continent:
       rep = queryGeoIP(ip, v6, Continent, &tmp_gl);
-    } else if (!format.compare(cur,3,"%co")) {
+      break;
+    case GeoIPFormat::Country:
       rep = queryGeoIP(ip, v6, Country, &tmp_gl);
-    } else if (!format.compare(cur,3,"%af")) {
+      break;
+    case GeoIPFormat::AF:
       rep = (v6?"v6":"v4");
-    } else if (!format.compare(cur,3,"%as")) {
+      break;
+    case GeoIPFormat::ASn:
       rep = queryGeoIP(ip, v6, ASn, &tmp_gl);
-    } else if (!format.compare(cur,3,"%re")) {
+      break;
+    case GeoIPFormat::Region:
       rep = queryGeoIP(ip, v6, Region, &tmp_gl);
-    } else if (!format.compare(cur,3,"%na")) {
+      break;
+    case GeoIPFormat::Name:
       rep = queryGeoIP(ip, v6, Name, &tmp_gl);
-    } else if (!format.compare(cur,3,"%ci")) {
+      break;
+    case GeoIPFormat::City:
       rep = queryGeoIP(ip, v6, City, &tmp_gl);
-    } else if (!format.compare(cur,3,"%hh")) {
+      break;
+    case GeoIPFormat::Hour:
       rep = boost::str(boost::format("%02d") % gtm.tm_hour);
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,3,"%yy")) {
+      break;
+    case GeoIPFormat::Year:
       rep = boost::str(boost::format("%02d") % (gtm.tm_year + 1900));
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,3,"%dd")) {
+      break;
+    case GeoIPFormat::YearDay:
       rep = boost::str(boost::format("%02d") % (gtm.tm_yday + 1));
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,4,"%wds")) {
-      nrep=4;
+      break;
+    case GeoIPFormat::WeekdayName:
       rep = GeoIP_WEEKDAYS[gtm.tm_wday];
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,4,"%mos")) {
-      nrep=4;
+      break;
+    case GeoIPFormat::MonthName:
       rep = GeoIP_MONTHS[gtm.tm_mon];
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,3,"%wd")) {
+      break;
+    case GeoIPFormat::Weekday:
       rep = boost::str(boost::format("%02d") % (gtm.tm_wday + 1));
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,3,"%mo")) {
+      break;
+    case GeoIPFormat::Month:
       rep = boost::str(boost::format("%02d") % (gtm.tm_mon + 1));
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,3,"%ip")) {
+      break;
+    case GeoIPFormat::IP:
       rep = ip;
       tmp_gl.netmask = (v6?128:32);
-    } else if (!format.compare(cur,2,"%%")) {
-      last = cur + 2; continue;
-    } else {
-      last = cur + 1; continue; 
+      break;
     }
     if (tmp_gl.netmask > gl->netmask) gl->netmask = tmp_gl.netmask;
-    format.replace(cur, nrep, rep);
-    last = cur + rep.size(); // move to next attribute
+    ret.append(rep);
   }
-  return format;
+  return ret;
 }
 
 void GeoIPBackend::reload() {
@@ -748,7 +883,7 @@ void GeoIPBackend::rediscover(string* status) {
 bool GeoIPBackend::getDomainInfo(const DNSName& domain, DomainInfo &di) {
   ReadLock rl(&s_state_lock);
 
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == domain) {
       SOAData sd;
       this->getSOA(domain, sd);
@@ -767,7 +902,7 @@ bool GeoIPBackend::getAllDomainMetadata(const DNSName& name, std::map<std::strin
   if (!d_dnssec) return false;
 
   ReadLock rl(&s_state_lock);
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       if (hasDNSSECkey(dom.domain)) {
         meta[string("NSEC3NARROW")].push_back("1");
@@ -783,7 +918,7 @@ bool GeoIPBackend::getDomainMetadata(const DNSName& name, const std::string& kin
   if (!d_dnssec) return false;
 
   ReadLock rl(&s_state_lock);
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       if (hasDNSSECkey(dom.domain)) {
         if (kind == "NSEC3NARROW")
@@ -800,7 +935,7 @@ bool GeoIPBackend::getDomainMetadata(const DNSName& name, const std::string& kin
 bool GeoIPBackend::getDomainKeys(const DNSName& name, std::vector<DNSBackend::KeyData>& keys) {
   if (!d_dnssec) return false;
   ReadLock rl(&s_state_lock);
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -843,7 +978,7 @@ bool GeoIPBackend::removeDomainKey(const DNSName& name, unsigned int id) {
   WriteLock rl(&s_state_lock);
   ostringstream path;
 
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -877,7 +1012,7 @@ bool GeoIPBackend::addDomainKey(const DNSName& name, const KeyData& key, int64_t
   WriteLock rl(&s_state_lock);
   unsigned int nextid=1;
 
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -911,7 +1046,7 @@ bool GeoIPBackend::addDomainKey(const DNSName& name, const KeyData& key, int64_t
 bool GeoIPBackend::activateDomainKey(const DNSName& name, unsigned int id) {
   if (!d_dnssec) return false;
   WriteLock rl(&s_state_lock);
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -944,7 +1079,7 @@ bool GeoIPBackend::activateDomainKey(const DNSName& name, unsigned int id) {
 bool GeoIPBackend::deactivateDomainKey(const DNSName& name, unsigned int id) {
   if (!d_dnssec) return false;
   WriteLock rl(&s_state_lock);
-  for(GeoIPDomain dom :  s_domains) {
+  for(const GeoIPDomain& dom :  s_domains) {
     if (dom.domain == name) {
       regex_t reg;
       regmatch_t regm[5];
@@ -44,6 +44,7 @@
 struct geoip_deleter;
 
 class GeoIPDomain;
+class GeoIPFormat;
 
 class GeoIPBackend: public DNSBackend {
 public:
@@ -95,11 +96,17 @@ private:
   bool queryRegionV6(string &ret, GeoIPLookup* gl, const string &ip, const geoip_file_t& gi);
   bool queryCity(string &ret, GeoIPLookup* gl, const string &ip, const geoip_file_t& gi);
   bool queryCityV6(string &ret, GeoIPLookup* gl, const string &ip, const geoip_file_t& gi);
-  string format2str(string format, const string& ip, bool v6, GeoIPLookup* gl);
+  string format2str(const GeoIPFormat& format, const string& ip, bool v6, GeoIPLookup* gl);
   bool d_dnssec; 
   bool hasDNSSECkey(const DNSName& name);
 
   vector<DNSResourceRecord> d_result;
+
+  // service answers per service netmask node, keyed by the client network they are valid for
+  typedef NetmaskTree<vector<GeoIPFormat> >::node_type service_node_t;
+  map<const service_node_t*, NetmaskTree<string> > d_serviceCache;
+  size_t d_serviceCacheEntries;
+  uint64_t d_serviceCacheGeneration;
 };
 
 #endif /* PDNS_GEOIPBACKEND_HH */
@@ -52,6 +52,7 @@ public:
     d_resnum = 0;
     d_fnum = 0;
     d_cur_set = 0;
+    d_needs_trx = true;
   }
 
   SSqlStatement* bind(const string& name, bool value) { return bind(name, string(value ? "t" : "f")); }
@@ -81,19 +82,24 @@ public:
     if (d_dolog) {
       L<<Logger::Warning<<"Query: "<<d_query<<endl;
     }
-    if (!d_parent->in_trx()) {
-      auto res=PQexec(d_db(),"BEGIN");
-      PQclear(res);
+    if (!d_parent->in_trx() && d_needs_trx) {
       d_do_commit = true;
-    } else d_do_commit = false;
-    d_res_set = PQexecPrepared(d_db(), d_stmt.c_str(), d_nparams, paramValues, paramLengths, NULL, 0);
+      d_res_set = beginAndExecute();
+    } else {
+      d_do_commit = false;
+      d_res_set = PQexecPrepared(d_db(), d_stmt.c_str(), d_nparams, paramValues, paramLengths, NULL, 0);
+    }
     ExecStatusType status = PQresultStatus(d_res_set);
-    string errmsg(PQresultErrorMessage(d_res_set));
     if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK && status != PGRES_NONFATAL_ERROR) {
       string errmsg(PQresultErrorMessage(d_res_set));
       releaseStatement();
       throw SSqlException("Fatal error during query: " + d_query + string(": ") + errmsg);
     }
+    // Refcursors only live as long as the transaction they were returned in,
+    // so that is what the implicit BEGIN/COMMIT is for. Once a statement has
+    // shown it does not return them, save it the two extra round trips.
+    if (d_needs_trx && (PQnfields(d_res_set) == 0 || PQftype(d_res_set, 0) != 1790))
+      d_needs_trx = false;
     d_cur_set = 0;
     nextResult();
     return this;
@@ -218,6 +224,38 @@ private:
     }
   }
 
+  // runs the statement inside a new transaction
+  PGresult* beginAndExecute() {
+#ifdef LIBPQ_HAS_PIPELINING
+    // send BEGIN and the statement together, one round trip instead of two
+    PGconn* conn = d_db();
+    PGresult* ret = NULL;
+    if (PQenterPipelineMode(conn) != 1)
+      return PQexecPrepared(conn, d_stmt.c_str(), d_nparams, paramValues, paramLengths, NULL, 0);
+    if (PQsendQueryParams(conn, "BEGIN", 0, NULL, NULL, NULL, NULL, 0) == 1 &&
+        PQsendQueryPrepared(conn, d_stmt.c_str(), d_nparams, paramValues, paramLengths, NULL, 0) == 1 &&
+        PQpipelineSync(conn) == 1) {
+      for(int n = 0; n < 2; n++) {
+        PGresult* res;
+        // each query's results are terminated by a NULL
+        while((res = PQgetResult(conn)) != NULL) {
+          if (n == 1 && ret == NULL)
+            ret = res;
+          else
+            PQclear(res);
+        }
+      }
+      PQclear(PQgetResult(conn)); // PGRES_PIPELINE_SYNC
+    }
+    PQexitPipelineMode(conn);
+    return ret; // NULL reads as PGRES_FATAL_ERROR
+#else
+    PGresult* res = PQexec(d_db(), "BEGIN");
+    PQclear(res);
+    return PQexecPrepared(d_db(), d_stmt.c_str(), d_nparams, paramValues, paramLengths, NULL, 0);
+#endif
+  }
+
   void prepareStatement() {
     if (d_prepared) return;
     // prepare a statement; name must be unique per session (using d_nstatement to ensure this).
@@ -263,6 +301,7 @@ private:
   int d_fnum;
   int d_cur_set;
   bool d_do_commit;
+  bool d_needs_trx;
   unsigned int d_nstatement;
 };
 
@@ -45,6 +45,8 @@ HTTPConnector::HTTPConnector(std::map<std::string,std::string> options) {
     this->d_post = false;
     this->d_post_json = false;
     this->d_socket = NULL;
+    this->d_port = 0;
+    this->d_reused = false;
 
     if (options.find("timeout") != options.end()) {
       this->timeout = std::stoi(options.find("timeout")->second)/1000;
@@ -294,8 +296,8 @@ void HTTPConnector::post_requestbuilder(const Json& input, YaHTTP::Request& req)
 }
 
 int HTTPConnector::send_message(const Json& input) {
-    int rv,ec,fd;
-    
+    int rv;
+
     std::vector<std::string> members;
     std::string method;
     std::ostringstream out;
@@ -312,14 +314,19 @@ int HTTPConnector::send_message(const Json& input) {
     req.headers["connection"] = "Keep-Alive"; // see if we can streamline requests (not needed, strictly speaking)
 
     out << req;
+    d_request = out.str();
+    d_host = req.url.host;
+    d_port = req.url.port;
+    d_reused = false;
 
     // try sending with current socket, if it fails retry with new socket
     if (this->d_socket != NULL) {
-      fd = this->d_socket->getHandle();
+      int fd = this->d_socket->getHandle();
       // there should be no data waiting
       if (waitForRWData(fd, true, 0, 1000) < 1) {
         try {
-          d_socket->writenWithTimeout(out.str().c_str(), out.str().size(), timeout);
+          d_socket->writenWithTimeout(d_request.c_str(), d_request.size(), timeout);
+          d_reused = true;
           rv = 1;
         } catch (NetworkError& ne) {
           L<<Logger::Error<<"While writing to HTTP endpoint "<<d_addr.toStringWithPort()<<": "<<ne.what()<<std::endl;
@@ -331,63 +338,73 @@ int HTTPConnector::send_message(const Json& input) {
 
     if (rv == 1) return rv;
 
-    delete this->d_socket;
-    this->d_socket = NULL;
-
     if (req.url.protocol == "unix") {
       // connect using unix socket
-    } else {
-      // connect using tcp
-      struct addrinfo *gAddr, *gAddrPtr, hints;
-      std::string sPort = std::to_string(req.url.port);
-      memset(&hints,0,sizeof hints);
-      hints.ai_family = AF_UNSPEC;
-      hints.ai_flags = AI_ADDRCONFIG; 
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_protocol = 6; // tcp
-      if ((ec = getaddrinfo(req.url.host.c_str(), sPort.c_str(), &hints, &gAddr)) == 0) {
-        // try to connect to each address. 
-        gAddrPtr = gAddr;
-  
-        while(gAddrPtr) {
-          try {
-            d_socket = new Socket(gAddrPtr->ai_family, gAddrPtr->ai_socktype, gAddrPtr->ai_protocol);
-            d_addr.setSockaddr(gAddrPtr->ai_addr, gAddrPtr->ai_addrlen);
-            d_socket->connect(d_addr);
-            d_socket->setNonBlocking();
-            d_socket->writenWithTimeout(out.str().c_str(), out.str().size(), timeout);
-            rv = 1;
-          } catch (NetworkError& ne) {
-            L<<Logger::Error<<"While writing to HTTP endpoint "<<d_addr.toStringWithPort()<<": "<<ne.what()<<std::endl;
-          } catch (...) {
-            L<<Logger::Error<<"While writing to HTTP endpoint "<<d_addr.toStringWithPort()<<": exception caught"<<std::endl;
-          }
-
-          if (rv > -1) break;
-          delete d_socket;
-          d_socket = NULL;
-          gAddrPtr = gAddrPtr->ai_next;
-          
+      delete this->d_socket;
+      this->d_socket = NULL;
+      return rv;
+    }
+
+    return reconnect();
+}
+
+// connects to d_host:d_port over tcp and writes out d_request
+int HTTPConnector::reconnect() {
+    int rv = -1;
+    int ec;
+
+    delete this->d_socket;
+    this->d_socket = NULL;
+    d_reused = false;
+
+    struct addrinfo *gAddr, *gAddrPtr, hints;
+    std::string sPort = std::to_string(d_port);
+    memset(&hints,0,sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_ADDRCONFIG; 
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = 6; // tcp
+    if ((ec = getaddrinfo(d_host.c_str(), sPort.c_str(), &hints, &gAddr)) == 0) {
+      // try to connect to each address. 
+      gAddrPtr = gAddr;
+
+      while(gAddrPtr) {
+        try {
+          d_socket = new Socket(gAddrPtr->ai_family, gAddrPtr->ai_socktype, gAddrPtr->ai_protocol);
+          d_addr.setSockaddr(gAddrPtr->ai_addr, gAddrPtr->ai_addrlen);
+          d_socket->connect(d_addr);
+          d_socket->setNonBlocking();
+          d_socket->writenWithTimeout(d_request.c_str(), d_request.size(), timeout);
+          rv = 1;
+        } catch (NetworkError& ne) {
+          L<<Logger::Error<<"While writing to HTTP endpoint "<<d_addr.toStringWithPort()<<": "<<ne.what()<<std::endl;
+        } catch (...) {
+          L<<Logger::Error<<"While writing to HTTP endpoint "<<d_addr.toStringWithPort()<<": exception caught"<<std::endl;
         }
-        freeaddrinfo(gAddr);
-      } else {
-        L<<Logger::Error<<"Unable to resolve " << req.url.host << ": " << gai_strerror(ec) << std::endl;
+
+        if (rv > -1) break;
+        delete d_socket;
+        d_socket = NULL;
+        gAddrPtr = gAddrPtr->ai_next;
+        
       }
+      freeaddrinfo(gAddr);
+    } else {
+      L<<Logger::Error<<"Unable to resolve " << d_host << ": " << gai_strerror(ec) << std::endl;
     }
 
     return rv;
 }
 
-int HTTPConnector::recv_message(Json& output) {
+/* Reads one response from d_socket. received tells whether any of it
+   arrived before a failure, in which case the request must not be retried. */
+bool HTTPConnector::read_response(YaHTTP::Response& resp, bool& received) {
     YaHTTP::AsyncResponseLoader arl;
-    YaHTTP::Response resp;
-
-    if (d_socket == NULL ) return -1; // cannot receive :(
     char buffer[4096];
     int rd = -1;
-    bool fail = false;
     time_t t0;
 
+    received = false;
     arl.initialize(&resp);
 
     try {
@@ -398,27 +415,50 @@ int HTTPConnector::recv_message(Json& output) {
           throw NetworkError("EOF while reading");
         if (rd<0)
           throw NetworkError(std::string(strerror(rd)));
+        received = true;
         arl.feed(std::string(buffer, rd));
       }
       // timeout occured.
       if (arl.ready() == false)
         throw NetworkError("timeout");
     } catch (NetworkError &ne) {
-      L<<Logger::Error<<"While reading from HTTP endpoint "<<d_addr.toStringWithPort()<<": "<<ne.what()<<std::endl; 
+      // an idle keep-alive connection closed by the remote is retried by our caller, no need to shout
+      if (received || !d_reused)
+        L<<Logger::Error<<"While reading from HTTP endpoint "<<d_addr.toStringWithPort()<<": "<<ne.what()<<std::endl; 
       delete d_socket;
       d_socket = NULL;
-      fail = true;
+      return false;
     } catch (...) {
       L<<Logger::Error<<"While reading from HTTP endpoint "<<d_addr.toStringWithPort()<<": exception caught"<<std::endl;
       delete d_socket;
-      fail = true;
+      d_socket = NULL;
+      received = true;
+      return false;
     }
 
-    if (fail) {
-      return -1;
+    arl.finalize();
+    return true;
+}
+
+int HTTPConnector::recv_message(Json& output) {
+    YaHTTP::Response resp;
+    bool received;
+
+    if (d_socket == NULL ) return -1; // cannot receive :(
+
+    if (!read_response(resp, received)) {
+      // the remote may have closed the kept-alive connection right before we
+      // reused it. As nothing was answered, resend once over a new connection.
+      if (!d_reused || received || reconnect() < 1 || !read_response(resp, received))
+        return -1;
     }
 
-    arl.finalize();
+    // honour the remote's wish to not keep this connection around
+    const std::string& connection = resp.headers["connection"];
+    if (pdns_iequals(connection, "close") || (resp.version < 11 && !pdns_iequals(connection, "keep-alive"))) {
+      delete d_socket;
+      d_socket = NULL;
+    }
 
     if (resp.status < 200 || resp.status >= 400) {
       // bad. 
@@ -23,9 +23,55 @@
 #include "config.h"
 #endif
 #include "remotebackend.hh"
+#include "pdns/statbag.hh"
+
+extern StatBag S;
 
 static const char *kBackendId = "[RemoteBackend]";
 
+/**
+ * Call counts and latencies of the remote methods on the query path,
+ * everything else is counted as "other". The latency histogram has
+ * buckets up to 1, 10, 100 and 1000 ms, and one for slower calls.
+ */
+static const char *kTimedMethods[] = { "lookup", "list", "getBeforeAndAfterNamesAbsolute", "getAllDomainMetadata", "getDomainMetadata", "getDomainKeys", "getDomainInfo", "other" };
+static const size_t kNumTimedMethods = sizeof(kTimedMethods)/sizeof(kTimedMethods[0]);
+static const char *kLatencyBuckets[] = { "0-1", "1-10", "10-100", "100-1000", "slow" };
+static const size_t kNumLatencyBuckets = sizeof(kLatencyBuckets)/sizeof(kLatencyBuckets[0]);
+
+static AtomicCounter s_calls[kNumTimedMethods];
+static AtomicCounter s_usec[kNumTimedMethods];
+static AtomicCounter s_latency[kNumTimedMethods][kNumLatencyBuckets];
+
+static void declareRemoteStats()
+{
+   static bool declared = false;
+   if (declared)
+      return;
+   declared = true;
+
+   for(size_t m = 0; m < kNumTimedMethods; m++) {
+      std::string method = toLower(kTimedMethods[m]);
+      AtomicCounter *calls = &s_calls[m], *usec = &s_usec[m];
+      S.declare("remote-"+method+"-calls", std::string("Number of ")+kTimedMethods[m]+" calls to remote backends", [calls](const std::string&) { return calls->load(); });
+      S.declare("remote-"+method+"-usec", std::string("Microseconds spent waiting for ")+kTimedMethods[m]+" calls to remote backends", [usec](const std::string&) { return usec->load(); });
+      for(size_t b = 0; b < kNumLatencyBuckets; b++) {
+         AtomicCounter *bucket = &s_latency[m][b];
+         S.declare("remote-"+method+"-latency-"+kLatencyBuckets[b], std::string("Number of ")+kTimedMethods[m]+" calls to remote backends answered in "+kLatencyBuckets[b]+" ms", [bucket](const std::string&) { return bucket->load(); });
+      }
+   }
+}
+
+static size_t timedMethodIndex(const std::string& method)
+{
+   size_t m;
+   for(m = 0; m < kNumTimedMethods - 1; m++) {
+      if (method == kTimedMethods[m])
+         break;
+   }
+   return m;
+}
+
 /**
  * Forwarder for value. This is just in case
  * we need to do some treatment to the value before
@@ -65,6 +111,8 @@ RemoteBackend::RemoteBackend(const std::string &suffix)
 
       this->d_connstr = getArg("connection-string");
       this->d_dnssec = mustDo("dnssec");
+      this->d_bundle = mustDo("bundle-lookups");
+      this->d_method = kNumTimedMethods - 1;
       this->d_index = -1;
       this->d_trxid = 0;
 
@@ -78,6 +126,8 @@ RemoteBackend::~RemoteBackend() {
 }
 
 bool RemoteBackend::send(Json& value) {
+   d_method = timedMethodIndex(value["method"].string_value());
+   d_dtime.set();
    try {
      return connector->send(value);
    } catch (PDNSException &ex) {
@@ -91,19 +141,41 @@ bool RemoteBackend::send(Json& value) {
 
 bool RemoteBackend::recv(Json& value) {
    try {
-     return connector->recv(value);
+     bool rv = connector->recv(value);
+     countCall();
+     return rv;
    } catch (PDNSException &ex) {
      L<<Logger::Error<<"Exception caught when receiving: "<<ex.reason<<std::endl;
    } catch (...) {
      L<<Logger::Error<<"Exception caught when receiving"<<std::endl;;
    }
 
+   countCall();
    delete this->connector;
    build();
    return false;
 }
 
 
+void RemoteBackend::countCall() {
+   int usec = d_dtime.udiff();
+   size_t bucket;
+   if (usec < 1000)
+      bucket = 0;
+   else if (usec < 10000)
+      bucket = 1;
+   else if (usec < 100000)
+      bucket = 2;
+   else if (usec < 1000000)
+      bucket = 3;
+   else
+      bucket = 4;
+
+   s_calls[d_method]++;
+   s_usec[d_method] += usec;
+   s_latency[d_method][bucket]++;
+}
+
 /**
  * Builds connector based on options
  * Currently supports unix,pipe and http
@@ -206,6 +278,22 @@ void RemoteBackend::lookup(const QType &qtype, const DNSName& qdomain, DNSPacket
    d_index = 0;
 }
 
+/**
+ * Answers all qtypes of a name from one ANY lookup. Only allowed when the
+ * operator promises the remote answers ANY with every record of the name.
+ */
+bool RemoteBackend::lookupBundle(const DNSName& qdomain, int zoneId, DNSPacket *pkt_p, vector<DNSZoneRecord>& records) {
+   if (!d_bundle)
+      return false;
+
+   lookup(QType(QType::ANY), qdomain, pkt_p, zoneId);
+
+   DNSZoneRecord dzr;
+   while(DNSBackend::get(dzr))
+      records.push_back(dzr);
+   return true;
+}
+
 bool RemoteBackend::list(const DNSName& target, int domain_id, bool include_disabled) {
    if (d_index != -1)
       throw PDNSException("Attempt to lookup while one running");
@@ -976,6 +1064,8 @@ class RemoteBackendFactory : public BackendFactory
       {
           declare(suffix,"dnssec","Enable dnssec support","no");
           declare(suffix,"connection-string","Connection string","");
+          declare(suffix,"bundle-lookups","Answer all lookups for a name from a single ANY lookup","no");
+          declareRemoteStats();
       }
 
       DNSBackend *make(const std::string &suffix="")
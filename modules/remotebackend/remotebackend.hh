@@ -102,8 +102,14 @@ class HTTPConnector: public Connector {
     void post_requestbuilder(const Json &input, YaHTTP::Request& req);
     void addUrlComponent(const Json &parameters, const string& element, std::stringstream& ss);
     std::string buildMemberListArgs(std::string prefix, const Json& args);
+    int reconnect();
+    bool read_response(YaHTTP::Response& resp, bool& received);
     Socket* d_socket;
     ComboAddress d_addr;
+    std::string d_request; //!< the last request sent, kept for a resend
+    std::string d_host;
+    int d_port;
+    bool d_reused; //!< whether d_request went out over an already open connection
 };
 
 #ifdef REMOTEBACKEND_ZEROMQ
@@ -154,6 +160,7 @@ class RemoteBackend : public DNSBackend
   ~RemoteBackend();
 
   void lookup(const QType &qtype, const DNSName& qdomain, DNSPacket *pkt_p=0, int zoneId=-1);
+  bool lookupBundle(const DNSName& qdomain, int zoneId, DNSPacket *pkt_p, vector<DNSZoneRecord>& records);
   bool get(DNSResourceRecord &rr);
   bool list(const DNSName& target, int domain_id, bool include_disabled=false);
 
@@ -195,6 +202,7 @@ class RemoteBackend : public DNSBackend
     int build();
     Connector *connector;
     bool d_dnssec;
+    bool d_bundle;
     Json d_result;
     int d_index;
     int64_t d_trxid;
@@ -202,6 +210,9 @@ class RemoteBackend : public DNSBackend
 
     bool send(Json &value);
     bool recv(Json &value);
+    void countCall();
+    DTime d_dtime; //!< started when the current call was sent
+    size_t d_method; //!< index of the current call in the latency statistics
  
     string asString(const Json& value) {
       if (value.is_number()) return std::to_string(value.int_value());
@@ -23,132 +23,246 @@
 #include "config.h"
 #endif
 #include "cdb.hh"
-#include <cdb.h>
 #include "pdns/misc.hh"
 #include "pdns/iputils.hh"
+#include <sys/mman.h>
 #include <utility>
+#include <algorithm>
 
+pthread_mutex_t CDBMapping::s_mapsLock = PTHREAD_MUTEX_INITIALIZER;
+std::map<string, CDBMapping::MapEntry> CDBMapping::s_maps;
 
-CDB::CDB(const string &cdbfile)
+CDBMapping::CDBMapping(const string &cdbfile, bool populate)
 {
-  d_fd = open(cdbfile.c_str(), O_RDONLY);
-  if (d_fd < 0)
+  int fd = open(cdbfile.c_str(), O_RDONLY);
+  if (fd < 0)
   {
     L<<Logger::Error<<"Failed to open cdb database file '"<<cdbfile<<"'. Error: "<<stringerror()<<endl;
-    throw new PDNSException("Failed to open cdb database file '"+cdbfile+"'. Error: " + stringerror());
+    throw PDNSException("Failed to open cdb database file '"+cdbfile+"'. Error: " + stringerror());
   }
 
-  memset(&d_cdbf,0,sizeof(struct cdb_find));
-  int cdbinit = cdb_init(&d_cdb, d_fd);
-  if (cdbinit < 0)
-  {
-    L<<Logger::Error<<"Failed to initialize cdb structure. ErrorNr: '"<<cdbinit<<endl;
-    throw new PDNSException("Failed to initialize cdb structure.");
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    string err = stringerror();
+    close(fd);
+    throw PDNSException("Failed to stat cdb database file '"+cdbfile+"'. Error: " + err);
+  }
+
+  if (st.st_size < 2048 || static_cast<uint64_t>(st.st_size) > 0xffffffffULL) {
+    close(fd);
+    L<<Logger::Error<<"Failed to initialize cdb structure for '"<<cdbfile<<"', invalid size "<<st.st_size<<endl;
+    throw PDNSException("Failed to initialize cdb structure.");
+  }
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (populate) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+  void* mem = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    L<<Logger::Error<<"Failed to map cdb database file '"<<cdbfile<<"'. Error: "<<stringerror()<<endl;
+    throw PDNSException("Failed to map cdb database file '"+cdbfile+"'. Error: " + stringerror());
   }
 
-  d_key = NULL;
+  d_data = static_cast<const unsigned char*>(mem);
+  d_size = st.st_size;
+  d_dev = st.st_dev;
+  d_ino = st.st_ino;
+  d_fsize = st.st_size;
+  d_mtime = st.st_mtime;
+
+  // the records are followed by the hash tables, the first of which is at the first position in the header
+  d_recordsEnd = d_data[0] | (d_data[1] << 8) | (d_data[2] << 16) | (static_cast<uint32_t>(d_data[3]) << 24);
+  if (d_recordsEnd < 2048) {
+    d_recordsEnd = 2048;
+  }
+  else if (d_recordsEnd > d_size) {
+    d_recordsEnd = d_size;
+  }
+}
+
+CDBMapping::~CDBMapping()
+{
+  munmap(const_cast<unsigned char*>(d_data), d_size);
+}
+
+std::shared_ptr<const CDBMapping> CDBMapping::get(const string &cdbfile, bool populate)
+{
+  time_t now = time(nullptr);
+  Lock l(&s_mapsLock);
+
+  auto it = s_maps.find(cdbfile);
+  if (it != s_maps.end()) {
+    if (it->second.d_lastCheck == now) {
+      return it->second.d_mapping;
+    }
+    it->second.d_lastCheck = now;
+
+    struct stat st;
+    if (stat(cdbfile.c_str(), &st) < 0 || it->second.d_mapping->isSameFile(st)) {
+      // a file that is being replaced might be missing for a moment, keep using what we have
+      return it->second.d_mapping;
+    }
+
+    try {
+      it->second.d_mapping = std::make_shared<const CDBMapping>(cdbfile, populate);
+    }
+    catch (const PDNSException& e) {
+      L<<Logger::Error<<"Keeping the previous version of cdb database file '"<<cdbfile<<"': "<<e.reason<<endl;
+    }
+    return it->second.d_mapping;
+  }
+
+  MapEntry entry;
+  entry.d_mapping = std::make_shared<const CDBMapping>(cdbfile, populate);
+  entry.d_lastCheck = now;
+  s_maps[cdbfile] = entry;
+  return entry.d_mapping;
+}
+
+CDB::CDB(std::shared_ptr<const CDBMapping> mapping) : d_mapping(mapping)
+{
+  d_hash = 0;
+  d_tablePos = 0;
+  d_tableSlots = 0;
+  d_slot = 0;
+  d_slotsSeen = 0;
   d_seqPtr = 0;
+  d_recordPos = 0;
+  d_klen = 0;
+  d_dlen = 0;
   d_searchType = SearchKey;
 }
 
-CDB::~CDB() {
-  cdb_free(&d_cdb);
-  close(d_fd);
+uint32_t CDB::unpack(uint32_t pos) const
+{
+  const unsigned char* p = d_mapping->data() + pos;
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint32_t CDB::hash(const string& key)
+{
+  uint32_t h = 5381;
+  for (const unsigned char c : key) {
+    h = ((h << 5) + h) ^ c;
+  }
+  return h;
+}
+
+// Reads the lengths of the record at pos, checking that it fits in the mapping
+bool CDB::readRecord(uint32_t pos, uint32_t& klen, uint32_t& dlen) const
+{
+  uint64_t size = d_mapping->size();
+  if (static_cast<uint64_t>(pos) + 8 > size) {
+    return false;
+  }
+  klen = unpack(pos);
+  dlen = unpack(pos + 4);
+  return static_cast<uint64_t>(pos) + 8 + klen + dlen <= size;
 }
 
 int CDB::searchKey(const string &key) {
   d_searchType = SearchKey;
+  d_key = key;
+  d_hash = hash(key);
+  d_slotsSeen = 0;
 
-  // A 'bug' in tinycdb (the lib used for reading the CDB files) means we have to copy the key because the cdb_find struct
-  // keeps a pointer to it.
-  d_key = strdup(key.c_str());
-  return cdb_findinit(&d_cdbf, &d_cdb, d_key, key.size());
+  uint32_t header = (d_hash & 0xff) * 8;
+  d_tablePos = unpack(header);
+  d_tableSlots = unpack(header + 4);
+  if (static_cast<uint64_t>(d_tablePos) + static_cast<uint64_t>(d_tableSlots) * 8 > d_mapping->size()) {
+    d_tableSlots = 0;
+    return -1;
+  }
+  d_slot = d_tableSlots ? (d_hash >> 8) % d_tableSlots : 0;
+  return 0;
 }
 
 bool CDB::searchSuffix(const string &key) {
-  d_searchType = SearchSuffix;
-
-  //See CDB::searchKey()
-  d_key = strdup(key.c_str());
-
   // We are ok with a search on things, but we do want to know if a record with that key exists.........
-  bool hasDomain = (cdb_find(&d_cdb, key.c_str(), key.size()) == 1);
-  if (hasDomain) {
-    cdb_seqinit(&d_seqPtr, &d_cdb);
-  }
+  searchKey(key);
+  bool hasDomain = moveToNext();
+
+  d_searchType = SearchSuffix;
+  // the names in the records are compared without the root label
+  d_key = key.substr(0, key.find('\0'));
+  d_seqPtr = hasDomain ? 2048 : d_mapping->recordsEnd();
 
   return hasDomain;
 }
 
 void CDB::searchAll() {
   d_searchType = SearchAll;
-  cdb_seqinit(&d_seqPtr, &d_cdb);
+  d_seqPtr = 2048;
 }
 
 bool CDB::moveToNext() {
-  int hasNext = 0;
   if (d_searchType == SearchKey) {
-    hasNext = cdb_findnext(&d_cdbf);
-  } else {
-    hasNext = cdb_seqnext(&d_seqPtr, &d_cdb);
+    const unsigned char* data = d_mapping->data();
+    while (d_slotsSeen < d_tableSlots) {
+      uint32_t slotPos = d_tablePos + d_slot * 8;
+      uint32_t slotHash = unpack(slotPos);
+      uint32_t recordPos = unpack(slotPos + 4);
+      d_slotsSeen++;
+      if (++d_slot == d_tableSlots) {
+        d_slot = 0;
+      }
+
+      if (recordPos == 0) {
+        // an empty slot ends the chain
+        d_slotsSeen = d_tableSlots;
+        return false;
+      }
+      if (slotHash != d_hash || !readRecord(recordPos, d_klen, d_dlen)) {
+        continue;
+      }
+      if (d_klen == d_key.size() && memcmp(data + recordPos + 8, d_key.c_str(), d_klen) == 0) {
+        d_recordPos = recordPos;
+        return true;
+      }
+    }
+    return false;
   }
-  return (hasNext > 0);
+
+  if (d_seqPtr >= d_mapping->recordsEnd() || !readRecord(d_seqPtr, d_klen, d_dlen)) {
+    return false;
+  }
+  d_recordPos = d_seqPtr;
+  d_seqPtr += 8 + d_klen + d_dlen;
+  return true;
 }
 
 bool CDB::readNext(pair<string, string> &value) {
   while (moveToNext()) {
-    unsigned int pos;
-    unsigned int len;
-
-    pos = cdb_keypos(&d_cdb);
-    len = cdb_keylen(&d_cdb);
-
-    char *key = (char *)malloc(len);
-    cdb_read(&d_cdb, key, len, pos);
+    const char* key = reinterpret_cast<const char*>(d_mapping->data()) + d_recordPos + 8;
 
     if (d_searchType == SearchSuffix) {
-      char *p = strstr(key, d_key);
-      if (p == NULL) {
-        free(key);
+      // the name in the key ends at its root label
+      const char* keyEnd = std::find(key, key + d_klen, '\0');
+      if (std::search(key, keyEnd, d_key.begin(), d_key.end()) == keyEnd) {
         continue;
       }
     }
-    string skey(key, len);
-    free(key);
 
-    pos = cdb_datapos(&d_cdb);
-    len = cdb_datalen(&d_cdb);
-    char *val = (char *)malloc(len);
-    cdb_read(&d_cdb, val, len, pos);
-    string sval(val, len);
-    free(val);
-
-    value = make_pair(skey, sval);
+    value.first.assign(key, d_klen);
+    value.second.assign(key + d_klen, d_dlen);
     return true;
   }
-  // We're done searching, so we can clean up d_key
-  if (d_searchType != SearchAll) {
-    free(d_key);
-  }
   return false;
 }
 
 vector<string> CDB::findall(string &key)
 {
   vector<string> ret;
-  struct cdb_find cdbf;
-
-  cdb_findinit(&cdbf, &d_cdb, key.c_str(), key.size());
-  int x=0;
-  while(cdb_findnext(&cdbf) > 0) {
-    x++;
-    unsigned int vpos = cdb_datapos(&d_cdb);
-    unsigned int vlen = cdb_datalen(&d_cdb);
-    char *val = (char *)malloc(vlen);
-    cdb_read(&d_cdb, val, vlen, vpos);
-    string sval(val, vlen);
-    ret.push_back(sval);
-    free(val);
+  CDB finder(d_mapping);
+  pair<string, string> record;
+
+  finder.searchKey(key);
+  while (finder.readNext(record)) {
+    ret.push_back(record.second);
   }
   return ret;
 }
@@ -23,18 +23,62 @@
 #define CDB_HH
 
 #include "pdns/logger.hh"
-#include <cdb.h>
+#include "pdns/lock.hh"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <map>
+#include <memory>
+#include <boost/utility.hpp>
+
+// A read-only memory mapping of a CDB file, shared by all readers of that file.
+// Mappings are immutable, a changed file gets a new mapping and the old one goes away
+// with the last reader using it.
+class CDBMapping : public boost::noncopyable
+{
+public:
+  CDBMapping(const string &cdbfile, bool populate);
+  ~CDBMapping();
+
+  // Returns the current mapping of cdbfile, checking at most once per second whether the
+  // file was replaced (different inode, size or mtime) and mapping it again if it was.
+  static std::shared_ptr<const CDBMapping> get(const string &cdbfile, bool populate);
+
+  const unsigned char* data() const { return d_data; }
+  size_t size() const { return d_size; }
+  // End of the records, the hash tables start there
+  uint32_t recordsEnd() const { return d_recordsEnd; }
+
+  bool isSameFile(const struct stat& st) const
+  {
+    return st.st_dev == d_dev && st.st_ino == d_ino && st.st_size == d_fsize && st.st_mtime == d_mtime;
+  }
+
+private:
+  struct MapEntry
+  {
+    std::shared_ptr<const CDBMapping> d_mapping;
+    time_t d_lastCheck;
+  };
+
+  const unsigned char* d_data;
+  size_t d_size;
+  uint32_t d_recordsEnd;
+  dev_t d_dev;
+  ino_t d_ino;
+  off_t d_fsize;
+  time_t d_mtime;
+
+  static pthread_mutex_t s_mapsLock;
+  static std::map<string, MapEntry> s_maps;
+};
 
 // This class is responsible for the reading of a CDB file.
-// The constructor opens the CDB file, the destructor closes it, so make sure you call that.
+// All lookups are done directly on the memory mapping, without any system calls.
 class CDB
 {
 public:
-  CDB(const string &cdbfile);
-  ~CDB();
+  CDB(std::shared_ptr<const CDBMapping> mapping);
 
   int searchKey(const string &key);
   bool searchSuffix(const string &key);
@@ -43,12 +87,24 @@ public:
   vector<string> findall(string &key);
 
 private:
-  int d_fd;
   bool moveToNext();
-  struct cdb d_cdb;
-  struct cdb_find d_cdbf;
-  char *d_key;
-  unsigned d_seqPtr;
+  bool readRecord(uint32_t pos, uint32_t& klen, uint32_t& dlen) const;
+  uint32_t unpack(uint32_t pos) const;
+  static uint32_t hash(const string& key);
+
+  std::shared_ptr<const CDBMapping> d_mapping;
+  string d_key;
+  // for SearchKey, the hash table slot we are at
+  uint32_t d_hash;
+  uint32_t d_tablePos;
+  uint32_t d_tableSlots;
+  uint32_t d_slot;
+  uint32_t d_slotsSeen;
+  // position of the next record for SearchSuffix and SearchAll, and of the current one
+  uint32_t d_seqPtr;
+  uint32_t d_recordPos;
+  uint32_t d_klen;
+  uint32_t d_dlen;
   enum SearchType { SearchSuffix, SearchKey, SearchAll } d_searchType;
 };
 
@@ -24,7 +24,6 @@
 #endif
 #include "tinydnsbackend.hh"
 #include "pdns/lock.hh"
-#include <cdb.h>
 #include "pdns/misc.hh"
 #include "pdns/iputils.hh"
 #include "pdns/dnspacket.hh"
@@ -63,9 +62,8 @@ vector<string> TinyDNSBackend::getLocations()
 
   for (int i=4;i>=0;i--) {
     string searchkey(key, i+2);
-    CDB *reader = new CDB(getArg("dbfile"));
-    ret = reader->findall(searchkey);
-    delete reader;
+    CDB reader(getMapping());
+    ret = reader.findall(searchkey);
 
     //Biggest item wins, so when we find something, we can jump out.
     if (ret.size() > 0) {
@@ -76,6 +74,17 @@ vector<string> TinyDNSBackend::getLocations()
   return ret;
 }
 
+std::shared_ptr<const CDBMapping> TinyDNSBackend::getMapping()
+{
+  // only look for a new version of the file once per second, and without taking the shared lock in between
+  time_t now = time(nullptr);
+  if (!d_mapping || now != d_mappingChecked) {
+    d_mapping = CDBMapping::get(d_dbfile, d_mapPopulate);
+    d_mappingChecked = now;
+  }
+  return d_mapping;
+}
+
 TinyDNSBackend::TinyDNSBackend(const string &suffix)
 {
   setArgPrefix("tinydns"+suffix);
@@ -83,6 +92,9 @@ TinyDNSBackend::TinyDNSBackend(const string &suffix)
   d_locations = mustDo("locations");
   d_ignorebogus = mustDo("ignore-bogus-records");
   d_taiepoch = 4611686018427387904ULL + getArgAsNum("tai-adjust");
+  d_dbfile = getArg("dbfile");
+  d_mapPopulate = mustDo("map-populate");
+  d_mappingChecked = 0;
   d_dnspacket = NULL;
   d_cdbReader = NULL;
   d_isAxfr = false;
@@ -153,7 +165,7 @@ void TinyDNSBackend::getAllDomains(vector<DomainInfo> *domains, bool include_dis
   d_isAxfr=true;
   d_dnspacket = NULL;
 
-  d_cdbReader=std::unique_ptr<CDB>(new CDB(getArg("dbfile")));
+  d_cdbReader=std::unique_ptr<CDB>(new CDB(getMapping()));
   d_cdbReader->searchAll();
   DNSResourceRecord rr;
 
@@ -178,7 +190,7 @@ void TinyDNSBackend::getAllDomains(vector<DomainInfo> *domains, bool include_dis
 bool TinyDNSBackend::list(const DNSName &target, int domain_id, bool include_disabled) {
   d_isAxfr=true;
   string key = target.toDNSString(); // FIXME400 bug: no lowercase here? or promise that from core?
-  d_cdbReader=std::unique_ptr<CDB>(new CDB(getArg("dbfile")));
+  d_cdbReader=std::unique_ptr<CDB>(new CDB(getMapping()));
   return d_cdbReader->searchSuffix(key);
 }
 
@@ -199,7 +211,7 @@ void TinyDNSBackend::lookup(const QType &qtype, const DNSName &qdomain, DNSPacke
 
   d_qtype=qtype;
 
-  d_cdbReader=std::unique_ptr<CDB>(new CDB(getArg("dbfile")));
+  d_cdbReader=std::unique_ptr<CDB>(new CDB(getMapping()));
   d_cdbReader->searchKey(key);
   d_dnspacket = pkt_p;
 }
@@ -331,6 +343,7 @@ public:
   void declareArguments(const string &suffix="") {
     declare(suffix, "notify-on-startup", "Tell the TinyDNSBackend to notify all the slave nameservers on startup. Default is no.", "no");
     declare(suffix, "dbfile", "Location of the cdb data file", "data.cdb");
+    declare(suffix, "map-populate", "Read the whole cdb data file into memory when it is (re)loaded, instead of on first access", "no");
     declare(suffix, "tai-adjust", "This adjusts the TAI value if timestamps are used. These seconds will be added to the start point (1970) and will allow you to adjust for leap seconds. The default is 11.", "11");
     declare(suffix, "locations", "Enable or Disable location support in the backend. Changing the value to 'no' will make the backend ignore the locations. This then returns all records!", "yes");
     declare(suffix, "ignore-bogus-records", "The data.cdb file might have some incorrect record data, this causes PowerDNS to fail, where tinydns would send out truncated data. This option makes powerdns ignore that data!", "no");
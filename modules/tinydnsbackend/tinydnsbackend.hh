@@ -26,7 +26,6 @@
 #include "pdns/logger.hh"
 #include "pdns/iputils.hh"
 #include "pdns/dnspacket.hh"
-#include <cdb.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -78,6 +77,7 @@ public:
   void setNotified(uint32_t id, uint32_t serial);
 private:
   vector<string> getLocations();
+  std::shared_ptr<const CDBMapping> getMapping();
 
   //TypeDefs
   struct tag_zone{};
@@ -97,6 +97,10 @@ private:
   uint64_t d_taiepoch;
   QType d_qtype;
   std::unique_ptr<CDB> d_cdbReader;
+  std::shared_ptr<const CDBMapping> d_mapping;
+  time_t d_mappingChecked;
+  string d_dbfile;
+  bool d_mapPopulate;
   DNSPacket *d_dnspacket; // used for location and edns-client support.
   bool d_isWildcardQuery; // Indicate if the query received was a wildcard query.
   bool d_isAxfr; // Indicate if we received a list() and not a lookup().
@@ -0,0 +1,229 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <boost/utility.hpp>
+
+/** A bump allocator for objects that all die at the same time, like the
+    containers built while resolving a single query.
+
+    Memory is carved out of blocks of s_blockSize bytes, deallocate() only
+    gives memory back when it was the last thing handed out, everything else
+    is released in one go when the Arena is destroyed or release()d.
+    Released blocks are kept in a small per-thread cache, so that in the steady
+    state a query does not hit malloc at all for its arena-allocated containers.
+    An Arena must be destroyed by the thread that created it, and is not
+    thread safe. */
+class Arena : public boost::noncopyable
+{
+public:
+  static const size_t s_blockSize = 8192;
+  static const size_t s_maxCachedBlocks = 64;
+
+  Arena()
+  {
+  }
+
+  ~Arena()
+  {
+    release();
+  }
+
+  void* allocate(size_t size, size_t alignment)
+  {
+    if(d_current) {
+      uintptr_t pos = (reinterpret_cast<uintptr_t>(d_current->data()) + d_used + alignment - 1) & ~(alignment - 1);
+      size_t offset = pos - reinterpret_cast<uintptr_t>(d_current->data());
+      if(offset + size <= d_current->d_capacity) {
+        d_used = offset + size;
+        return reinterpret_cast<void*>(pos);
+      }
+    }
+    return allocateSlow(size, alignment);
+  }
+
+  void deallocate(void* ptr, size_t size)
+  {
+    /* only the last allocation can be reclaimed, which covers a vector growing in place */
+    if(d_current && static_cast<char*>(ptr) + size == d_current->data() + d_used) {
+      d_used -= size;
+    }
+  }
+
+  //! frees everything that was allocated from this arena
+  void release()
+  {
+    while(d_current) {
+      Block* next = d_current->d_next;
+      freeBlock(d_current);
+      d_current = next;
+    }
+    d_used = 0;
+  }
+
+  //! number of blocks currently in use, for tests and statistics
+  size_t getBlockCount() const
+  {
+    size_t count = 0;
+    for(const Block* block = d_current; block; block = block->d_next) {
+      count++;
+    }
+    return count;
+  }
+
+private:
+  struct Block
+  {
+    Block* d_next;
+    size_t d_capacity;
+    char* data()
+    {
+      return reinterpret_cast<char*>(this + 1);
+    }
+  };
+
+  struct BlockCache
+  {
+    Block* d_head;
+    size_t d_count;
+  };
+
+  static BlockCache& getBlockCache()
+  {
+    static __thread BlockCache cache;
+    return cache;
+  }
+
+  void* allocateSlow(size_t size, size_t alignment)
+  {
+    size_t needed = size + alignment;
+    Block* block = nullptr;
+    if(needed <= s_blockSize) {
+      BlockCache& cache = getBlockCache();
+      if(cache.d_head) {
+        block = cache.d_head;
+        cache.d_head = block->d_next;
+        cache.d_count--;
+      }
+      else {
+        block = newBlock(s_blockSize);
+      }
+    }
+    else {
+      /* too large for a regular block, it gets one of its own */
+      block = newBlock(needed);
+    }
+
+    block->d_next = d_current;
+    d_current = block;
+    d_used = 0;
+    return allocate(size, alignment);
+  }
+
+  static Block* newBlock(size_t capacity)
+  {
+    Block* block = static_cast<Block*>(malloc(sizeof(Block) + capacity));
+    if(!block) {
+      throw std::bad_alloc();
+    }
+    block->d_next = nullptr;
+    block->d_capacity = capacity;
+    return block;
+  }
+
+  static void freeBlock(Block* block)
+  {
+    BlockCache& cache = getBlockCache();
+    if(block->d_capacity == s_blockSize && cache.d_count < s_maxCachedBlocks) {
+      block->d_next = cache.d_head;
+      cache.d_head = block;
+      cache.d_count++;
+    }
+    else {
+      free(block);
+    }
+  }
+
+  Block* d_current{nullptr};
+  size_t d_used{0};
+};
+
+/** Allocator for standard containers whose storage should come from an Arena.
+    Containers using it have to be handed the arena on construction, and must not outlive it. */
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef std::size_t size_type;
+
+  ArenaAllocator(Arena& arena) : d_arena(&arena)
+  {
+  }
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& rhs) : d_arena(rhs.d_arena)
+  {
+  }
+
+  pointer allocate(size_type n)
+  {
+    return static_cast<pointer>(d_arena->allocate(n * sizeof(value_type), alignof(value_type)));
+  }
+
+  void deallocate(pointer ptr, size_type n) noexcept
+  {
+    d_arena->deallocate(ptr, n * sizeof(value_type));
+  }
+
+  template <typename U>
+  struct rebind
+  {
+    typedef ArenaAllocator<U> other;
+  };
+
+private:
+  template <typename U> friend class ArenaAllocator;
+  template <typename U, typename V> friend bool operator==(const ArenaAllocator<U>&, const ArenaAllocator<V>&) noexcept;
+
+  Arena* d_arena;
+};
+
+template <typename T, typename U> inline
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept
+{
+  return lhs.d_arena == rhs.d_arena;
+}
+
+template <typename T, typename U> inline
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept
+{
+  return !(lhs == rhs);
+}
+
+#endif // ARENA_HH
@@ -21,6 +21,11 @@
  */
 #pragma once
 
+#include <cstddef>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 inline bool dns_isspace(char c)
 {
   return c==' ' || c=='\t' || c=='\r' || c=='\n';
@@ -39,3 +44,108 @@ inline unsigned char dns_tolower(unsigned char c)
     c+='a'-'A';
   return c;
 }
+
+/* The functions below work on raw buffers, like the wire format storage of a DNSName,
+   and give the same results as applying dns_tolower() byte by byte. Where SSE2 is
+   available (always the case on x86_64) they handle 16 bytes at a time. */
+
+#ifdef __SSE2__
+inline __m128i dns_tolower_sse2(__m128i v)
+{
+  /* signed comparisons, but bytes >= 0x80 are negative and so not in the A-Z range either */
+  __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(v, _mm_and_si128(isUpper, _mm_set1_epi8('a' - 'A')));
+}
+
+//! bit n is set when byte n of a and b differ once lowercased
+inline unsigned int dns_idiffmask_sse2(const unsigned char* a, const unsigned char* b)
+{
+  __m128i lhs = dns_tolower_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+  __m128i rhs = dns_tolower_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(lhs, rhs)) ^ 0xffff;
+}
+#endif
+
+//! Copies len bytes from src to dst, lowercasing them on the way
+inline void dns_tolower_copy(unsigned char* dst, const unsigned char* src, size_t len)
+{
+  size_t pos = 0;
+#ifdef __SSE2__
+  for(; pos + 16 <= len; pos += 16) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + pos), dns_tolower_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + pos))));
+  }
+#endif
+  for(; pos < len; pos++) {
+    dst[pos] = dns_tolower(src[pos]);
+  }
+}
+
+//! Case insensitive equality of two buffers of len bytes
+inline bool dns_iequals_raw(const unsigned char* a, const unsigned char* b, size_t len)
+{
+  size_t pos = 0;
+#ifdef __SSE2__
+  if(len >= 16) {
+    for(; pos + 16 <= len; pos += 16) {
+      if(dns_idiffmask_sse2(a + pos, b + pos))
+        return false;
+    }
+    /* the remainder is covered by one last block overlapping the previous one */
+    return pos == len || dns_idiffmask_sse2(a + len - 16, b + len - 16) == 0;
+  }
+#endif
+  for(; pos < len; pos++) {
+    if(a[pos] != b[pos] && dns_tolower(a[pos]) != dns_tolower(b[pos]))
+      return false;
+  }
+  return true;
+}
+
+//! Case insensitive three-way comparison of two buffers, a shorter buffer that is a prefix of the other one comes first
+inline int dns_icompare_raw(const unsigned char* a, size_t alen, const unsigned char* b, size_t blen)
+{
+  size_t common = alen < blen ? alen : blen;
+  size_t pos = 0;
+#ifdef __SSE2__
+  for(; pos + 16 <= common; pos += 16) {
+    unsigned int mask = dns_idiffmask_sse2(a + pos, b + pos);
+    if(mask) {
+      pos += __builtin_ctz(mask);
+      return dns_tolower(a[pos]) < dns_tolower(b[pos]) ? -1 : 1;
+    }
+  }
+#endif
+  for(; pos < common; pos++) {
+    unsigned char lhs = dns_tolower(a[pos]), rhs = dns_tolower(b[pos]);
+    if(lhs != rhs)
+      return lhs < rhs ? -1 : 1;
+  }
+  if(alen == blen)
+    return 0;
+  return alen < blen ? -1 : 1;
+}
+
+//! Like dns_icompare_raw() but starting from the last byte of both buffers, returns true if a comes first
+inline bool dns_ilexicographical_compare_reverse(const unsigned char* a, size_t alen, const unsigned char* b, size_t blen)
+{
+  size_t common = alen < blen ? alen : blen;
+  const unsigned char* aEnd = a + alen;
+  const unsigned char* bEnd = b + blen;
+  size_t pos = 0; // bytes compared so far, counting from the end
+#ifdef __SSE2__
+  for(; pos + 16 <= common; pos += 16) {
+    unsigned int mask = dns_idiffmask_sse2(aEnd - pos - 16, bEnd - pos - 16);
+    if(mask) {
+      /* the highest differing byte is the one closest to the end */
+      size_t idx = 16 - (31 - __builtin_clz(mask));
+      return dns_tolower(*(aEnd - pos - idx)) < dns_tolower(*(bEnd - pos - idx));
+    }
+  }
+#endif
+  for(; pos < common; pos++) {
+    unsigned char lhs = dns_tolower(*(aEnd - pos - 1)), rhs = dns_tolower(*(bEnd - pos - 1));
+    if(lhs != rhs)
+      return lhs < rhs;
+  }
+  return alen < blen;
+}
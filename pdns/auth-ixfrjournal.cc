@@ -0,0 +1,204 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <iterator>
+#include "auth-ixfrjournal.hh"
+#include "dnsbackend.hh"
+#include "dnsrecords.hh"
+#include "logger.hh"
+
+AuthIXFRJournal g_ixfrJournal;
+
+AuthIXFRJournal::AuthIXFRJournal()
+{
+  pthread_rwlock_init(&d_mut, 0);
+}
+
+AuthIXFRJournal::~AuthIXFRJournal()
+{
+  pthread_rwlock_destroy(&d_mut);
+}
+
+void AuthIXFRJournal::add(const DNSName& zone, const vector<DNSRecord>& removed, const vector<DNSRecord>& added)
+{
+  if(!d_depth)
+    return;
+
+  shared_ptr<SOARecordContent> oldsr, newsr;
+  if(!removed.empty())
+    oldsr = getRR<SOARecordContent>(removed.front());
+  if(!added.empty())
+    newsr = getRR<SOARecordContent>(added.front());
+  // a change that left the serial alone can not be told apart by a slave
+  if(!oldsr || !newsr || oldsr->d_st.serial == newsr->d_st.serial) {
+    clear(zone);
+    return;
+  }
+
+  Delta delta;
+  delta.fromSerial = oldsr->d_st.serial;
+  delta.toSerial = newsr->d_st.serial;
+  delta.oldSOA = removed.front();
+  delta.newSOA = added.front();
+  delta.removed.assign(removed.begin() + 1, removed.end());
+  delta.added.assign(added.begin() + 1, added.end());
+  add(zone, std::move(delta));
+}
+
+void AuthIXFRJournal::add(const DNSName& zone, Delta&& delta)
+{
+  if(!d_depth)
+    return;
+
+  auto entry = std::make_shared<const Delta>(std::move(delta));
+
+  WriteLock wl(&d_mut);
+  auto& chain = d_zones[zone];
+  if(!chain.empty() && chain.back()->toSerial != entry->fromSerial) {
+    DLOG(L<<"IXFR journal of '"<<zone<<"' ends at serial "<<chain.back()->toSerial<<", new change starts at "<<entry->fromSerial<<", restarting"<<endl);
+    d_size -= chain.size();
+    chain.clear();
+  }
+  chain.push_back(entry);
+  d_size++;
+  while(chain.size() > d_depth) {
+    chain.pop_front();
+    d_size--;
+  }
+}
+
+void AuthIXFRJournal::clear(const DNSName& zone)
+{
+  if(!d_depth)
+    return;
+
+  WriteLock wl(&d_mut);
+  auto it = d_zones.find(zone);
+  if(it != d_zones.end()) {
+    d_size -= it->second.size();
+    d_zones.erase(it);
+  }
+}
+
+bool AuthIXFRJournal::get(const DNSName& zone, uint32_t from, uint32_t to, deltas_t& deltas)
+{
+  if(!d_depth)
+    return false;
+
+  ReadLock rl(&d_mut);
+  auto it = d_zones.find(zone);
+  if(it == d_zones.end() || it->second.empty() || it->second.back()->toSerial != to)
+    return false;
+
+  const auto& chain = it->second;
+  auto start = std::find_if(chain.cbegin(), chain.cend(), [from](const shared_ptr<const Delta>& d) { return d->fromSerial == from; });
+  if(start == chain.cend())
+    return false;
+
+  deltas.assign(start, chain.cend());
+  return true;
+}
+
+IXFRJournalRecorder::IXFRJournalRecorder(DNSBackend* db, const DNSName& zone, int zoneId) : d_db(db), d_zone(zone), d_zoneId(zoneId)
+{
+  d_enabled = g_ixfrJournal.isEnabled();
+  touch(d_zone, QType(QType::SOA));
+}
+
+void IXFRJournalRecorder::fetch(const DNSName& qname, const QType& qtype, set<DNSRecord>& records)
+{
+  DNSZoneRecord zrr;
+  d_db->lookup(qtype, qname, 0, d_zoneId);
+  while(d_db->get(zrr)) {
+    if(zrr.dr.d_type) // skip empty non-terminals
+      records.insert(zrr.dr);
+  }
+}
+
+void IXFRJournalRecorder::touch(const DNSName& qname, const QType& qtype)
+{
+  if(!d_enabled || d_failed || d_finished)
+    return;
+
+  // an earlier change to the whole name already has these records in their old state
+  if(d_touched.count({qname, QType::ANY}) || !d_touched.insert({qname, qtype.getCode()}).second)
+    return;
+
+  set<DNSRecord> records;
+  try {
+    fetch(qname, qtype, records);
+  }
+  catch(...) {
+    d_failed = true;
+    return;
+  }
+
+  for(const auto& rec : records) {
+    // for ANY, only take the types that were not changed already
+    if(qtype.getCode() != QType::ANY || !d_touched.count({rec.d_name, rec.d_type}))
+      d_before.insert(rec);
+  }
+}
+
+void IXFRJournalRecorder::finish()
+{
+  if(!d_enabled || d_failed || d_finished)
+    return;
+  d_finished = true;
+
+  set<DNSRecord> after;
+  try {
+    for(const auto& t : d_touched)
+      fetch(t.first, QType(t.second), after);
+  }
+  catch(...) {
+    d_failed = true;
+    return;
+  }
+
+  std::set_difference(d_before.cbegin(), d_before.cend(), after.cbegin(), after.cend(), std::back_inserter(d_removed));
+  std::set_difference(after.cbegin(), after.cend(), d_before.cbegin(), d_before.cend(), std::back_inserter(d_added));
+
+  // the apex SOA goes to the front, where AuthIXFRJournal::add() expects it
+  auto isSOA = [this](const DNSRecord& rec) { return rec.d_type == QType::SOA && rec.d_name == d_zone; };
+  std::stable_partition(d_removed.begin(), d_removed.end(), isSOA);
+  std::stable_partition(d_added.begin(), d_added.end(), isSOA);
+}
+
+void IXFRJournalRecorder::commit()
+{
+  if(!d_enabled)
+    return;
+
+  if(d_failed || !d_finished) {
+    g_ixfrJournal.clear(d_zone);
+    return;
+  }
+  if(d_removed.empty() && d_added.empty())
+    return;
+
+  g_ixfrJournal.add(d_zone, d_removed, d_added);
+}
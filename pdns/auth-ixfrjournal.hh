@@ -0,0 +1,118 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef AUTH_IXFRJOURNAL_HH
+#define AUTH_IXFRJOURNAL_HH
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+#include "dnsname.hh"
+#include "dnsparser.hh"
+#include "lock.hh"
+#include "misc.hh"
+
+class DNSBackend;
+
+/** Keeps the most recent changes to each zone in memory, so an IXFR can be
+    answered with the records that changed instead of the whole zone. Every
+    zone has one chain of consecutive serials, a change that does not start
+    at the serial the chain ends on replaces the chain. Nothing is persisted,
+    after a restart IXFRs are answered with the full zone until new changes
+    come in. */
+class AuthIXFRJournal : public boost::noncopyable
+{
+public:
+  struct Delta
+  {
+    uint32_t fromSerial{0};
+    uint32_t toSerial{0};
+    DNSRecord oldSOA;
+    DNSRecord newSOA;
+    std::vector<DNSRecord> removed; //!< without the SOA, names are absolute
+    std::vector<DNSRecord> added;
+  };
+  typedef std::vector<std::shared_ptr<const Delta> > deltas_t;
+
+  AuthIXFRJournal();
+  ~AuthIXFRJournal();
+
+  //! adds a change from the SOA at the front of \a removed to the SOA at the front of \a added
+  void add(const DNSName& zone, const std::vector<DNSRecord>& removed, const std::vector<DNSRecord>& added);
+  void add(const DNSName& zone, Delta&& delta);
+  void clear(const DNSName& zone); //!< for changes we can not express as a delta
+
+  //! the changes that take \a zone from serial \a from to \a to, false if the journal does not have all of them
+  bool get(const DNSName& zone, uint32_t from, uint32_t to, deltas_t& deltas);
+
+  size_t size() { return d_size; } //!< number of changes held, over all zones
+
+  bool isEnabled() const { return d_depth > 0; }
+  void setDepth(uint32_t depth)
+  {
+    d_depth = depth;
+  }
+  uint32_t getDepth() const
+  {
+    return d_depth;
+  }
+
+private:
+  std::map<DNSName, std::deque<std::shared_ptr<const Delta> > > d_zones;
+  pthread_rwlock_t d_mut;
+
+  AtomicCounter d_size{0};
+  std::atomic<uint32_t> d_depth{0};
+};
+
+/** Turns the changes a backend transaction makes to a zone into a journal
+    entry. Call touch() before each RRset is changed, then finish() with the
+    transaction still open so the new state is read from the same connection,
+    and commit() once the backend committed. */
+class IXFRJournalRecorder : public boost::noncopyable
+{
+public:
+  IXFRJournalRecorder(DNSBackend* db, const DNSName& zone, int zoneId);
+
+  void touch(const DNSName& qname, const QType& qtype);
+  void finish();
+  void commit();
+
+private:
+  void fetch(const DNSName& qname, const QType& qtype, std::set<DNSRecord>& records);
+
+  DNSBackend* d_db;
+  DNSName d_zone;
+  int d_zoneId;
+  std::set<std::pair<DNSName, uint16_t> > d_touched;
+  std::set<DNSRecord> d_before;
+  std::vector<DNSRecord> d_removed;
+  std::vector<DNSRecord> d_added;
+  bool d_enabled;
+  bool d_failed{false};
+  bool d_finished{false};
+};
+
+extern AuthIXFRJournal g_ixfrJournal;
+
+#endif /* AUTH_IXFRJOURNAL_HH */
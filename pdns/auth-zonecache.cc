@@ -0,0 +1,136 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "auth-zonecache.hh"
+#include "dnsbackend.hh"
+
+AuthZoneCache g_zoneCache;
+
+AuthZoneCache::AuthZoneCache()
+{
+  pthread_rwlock_init(&d_mut, 0);
+}
+
+AuthZoneCache::~AuthZoneCache()
+{
+  pthread_rwlock_destroy(&d_mut);
+}
+
+bool AuthZoneCache::addToTree(tree_t& tree, const DNSName& zone, int zoneId)
+{
+  CacheValue val;
+  val.zone = zone;
+  val.zoneId = zoneId;
+
+  const CacheValue* existing = tree.lookup(zone);
+  bool added = !existing || existing->zone != zone;
+  tree.add(zone, val);
+  return added;
+}
+
+bool AuthZoneCache::removeFromTree(tree_t& tree, const DNSName& zone)
+{
+  const CacheValue* existing = tree.lookup(zone);
+  if(!existing || existing->zone != zone)
+    return false;
+  tree.remove(zone);
+  return true;
+}
+
+void AuthZoneCache::startReplace()
+{
+  WriteLock wl(&d_mut);
+  d_pendingChanges.clear();
+  d_replacePending = true;
+}
+
+void AuthZoneCache::replace(const vector<DomainInfo>& zones)
+{
+  tree_t tree;
+  size_t count = 0;
+  for(const auto& di : zones) {
+    if(addToTree(tree, di.zone, di.id))
+      count++;
+  }
+
+  {
+    WriteLock wl(&d_mut);
+    // zones added or removed while the list was being read are not in it
+    for(const auto& change : d_pendingChanges) {
+      if(change.remove) {
+        if(removeFromTree(tree, change.zone))
+          count--;
+      }
+      else if(addToTree(tree, change.zone, change.zoneId)) {
+        count++;
+      }
+    }
+    d_pendingChanges.clear();
+    d_replacePending = false;
+
+    std::swap(d_tree, tree);
+    d_size = count;
+  }
+  d_filled = true;
+}
+
+void AuthZoneCache::add(const DNSName& zone, int zoneId)
+{
+  if(!d_refreshinterval)
+    return;
+
+  WriteLock wl(&d_mut);
+  if(d_replacePending)
+    d_pendingChanges.push_back({zone, zoneId, false});
+  if(addToTree(d_tree, zone, zoneId))
+    d_size++;
+}
+
+void AuthZoneCache::remove(const DNSName& zone)
+{
+  if(!d_refreshinterval)
+    return;
+
+  WriteLock wl(&d_mut);
+  if(d_replacePending)
+    d_pendingChanges.push_back({zone, -1, true});
+  if(removeFromTree(d_tree, zone))
+    d_size--;
+}
+
+bool AuthZoneCache::getEntry(const DNSName& name, DNSName& zone, int& zoneId)
+{
+  ReadLock rl(&d_mut);
+  const CacheValue* val = d_tree.lookup(name);
+  if(!val) {
+    d_statnummiss++;
+    return false;
+  }
+
+  zone = val->zone;
+  zoneId = val->zoneId;
+  d_statnumhit++;
+  return true;
+}
@@ -0,0 +1,101 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef AUTH_ZONECACHE_HH
+#define AUTH_ZONECACHE_HH
+
+#include <vector>
+#include "dnsname.hh"
+#include "lock.hh"
+#include "misc.hh"
+
+struct DomainInfo;
+
+/** Process-wide index of the zones the backends serve, so finding the zone
+    a name belongs to is a tree walk instead of a SOA query per label. Only
+    zone names and ids are kept here, the SOA itself still comes from the
+    query cache or the backends. */
+class AuthZoneCache : public boost::noncopyable
+{
+public:
+  AuthZoneCache();
+  ~AuthZoneCache();
+
+  //! call before reading the list of zones for replace(), changes made in between are kept
+  void startReplace();
+  void replace(const std::vector<DomainInfo>& zones); //!< swap in a complete list of zones
+  void add(const DNSName& zone, int zoneId);
+  void remove(const DNSName& zone);
+
+  //! finds the most specific known zone name is part of
+  bool getEntry(const DNSName& name, DNSName& zone, int& zoneId);
+
+  size_t size() { return d_size; } //!< number of zones in the cache
+  uint64_t getHits() { return d_statnumhit; }
+  uint64_t getMisses() { return d_statnummiss; }
+
+  //! the cache is only consulted once it has been filled at least once
+  bool isEnabled() { return d_refreshinterval > 0 && d_filled; }
+  void setRefreshInterval(uint32_t interval)
+  {
+    d_refreshinterval = interval;
+  }
+  uint32_t getRefreshInterval() const
+  {
+    return d_refreshinterval;
+  }
+
+private:
+  struct CacheValue
+  {
+    DNSName zone;
+    int zoneId{-1};
+  };
+
+  typedef SuffixMatchTree<CacheValue> tree_t;
+
+  static bool addToTree(tree_t& tree, const DNSName& zone, int zoneId);
+  static bool removeFromTree(tree_t& tree, const DNSName& zone);
+
+  tree_t d_tree;
+  pthread_rwlock_t d_mut;
+
+  struct PendingChange
+  {
+    DNSName zone;
+    int zoneId;
+    bool remove;
+  };
+
+  std::vector<PendingChange> d_pendingChanges; //!< made since startReplace(), replayed by replace()
+  bool d_replacePending{false};
+
+  AtomicCounter d_statnumhit{0};
+  AtomicCounter d_statnummiss{0};
+  AtomicCounter d_size{0};
+
+  std::atomic<uint32_t> d_refreshinterval{0};
+  std::atomic<bool> d_filled{false};
+};
+
+extern AuthZoneCache g_zoneCache;
+
+#endif /* AUTH_ZONECACHE_HH */
@@ -343,34 +343,33 @@ void GSQLBackend::getUnfreshSlaveInfos(vector<DomainInfo> *unfreshDomains)
 {
   /* list all domains that need refreshing for which we are slave, and insert into SlaveDomain:
      id,name,master IP,serial */
+  vector<DomainInfo> allSlaves;
   try {
     d_InfoOfAllSlaveDomainsQuery_stmt->
-      execute()->
-      getResult(d_result)->
-      reset();
+      execute();
+
+    while(d_InfoOfAllSlaveDomainsQuery_stmt->hasNextRow()) { // id,name,master,last_check
+      d_InfoOfAllSlaveDomainsQuery_stmt->nextRow(d_row);
+      DomainInfo sd;
+      ASSERT_ROW_COLUMNS("info-all-slaves-query", d_row, 4);
+      sd.id=pdns_stou(d_row[0]);
+      try {
+        sd.zone= DNSName(d_row[1]);
+      } catch (...) {
+        continue;
+      }
+      stringtok(sd.masters, d_row[2], ", \t");
+      sd.last_check=pdns_stou(d_row[3]);
+      sd.backend=this;
+      sd.kind=DomainInfo::Slave;
+      allSlaves.push_back(sd);
+    }
+    d_InfoOfAllSlaveDomainsQuery_stmt->reset();
   }
   catch (SSqlException &e) {
     throw PDNSException("GSQLBackend unable to retrieve list of slave domains: "+e.txtReason());
   }
 
-  vector<DomainInfo> allSlaves;
-  int numanswers=d_result.size();
-  for(int n=0;n<numanswers;++n) { // id,name,master,last_check
-    DomainInfo sd;
-    ASSERT_ROW_COLUMNS("info-all-slaves-query", d_result[n], 4);
-    sd.id=pdns_stou(d_result[n][0]);
-    try {
-      sd.zone= DNSName(d_result[n][1]);
-    } catch (...) {
-      continue;
-    }
-    stringtok(sd.masters, d_result[n][2], ", \t");
-    sd.last_check=pdns_stou(d_result[n][3]);
-    sd.backend=this;
-    sd.kind=DomainInfo::Slave;
-    allSlaves.push_back(sd);
-  }
-
   for(vector<DomainInfo>::iterator i=allSlaves.begin();i!=allSlaves.end();++i) {
     SOAData sdata;
     sdata.serial=0;
@@ -387,34 +386,33 @@ void GSQLBackend::getUpdatedMasters(vector<DomainInfo> *updatedDomains)
 {
   /* list all domains that need notifications for which we are master, and insert into updatedDomains
      id,name,master IP,serial */
+  vector<DomainInfo> allMasters;
   try {
     d_InfoOfAllMasterDomainsQuery_stmt->
-      execute()->
-      getResult(d_result)->
-      reset();
+      execute();
+
+    while(d_InfoOfAllMasterDomainsQuery_stmt->hasNextRow()) { // id,name,master,last_check,notified_serial
+      d_InfoOfAllMasterDomainsQuery_stmt->nextRow(d_row);
+      DomainInfo sd;
+      ASSERT_ROW_COLUMNS("info-all-master-query", d_row, 6);
+      sd.id=pdns_stou(d_row[0]);
+      try {
+        sd.zone= DNSName(d_row[1]);
+      } catch (...) {
+        continue;
+      }
+      sd.last_check=pdns_stou(d_row[3]);
+      sd.notified_serial=pdns_stou(d_row[4]);
+      sd.backend=this;
+      sd.kind=DomainInfo::Master;
+      allMasters.push_back(sd);
+    }
+    d_InfoOfAllMasterDomainsQuery_stmt->reset();
   }
   catch(SSqlException &e) {
     throw PDNSException("GSQLBackend unable to retrieve list of master domains: "+e.txtReason());
   }
 
-  vector<DomainInfo> allMasters;
-  size_t numanswers=d_result.size();
-  for(size_t n=0;n<numanswers;++n) { // id,name,master,last_check,notified_serial
-    DomainInfo sd;
-    ASSERT_ROW_COLUMNS("info-all-master-query", d_result[n], 6);
-    sd.id=pdns_stou(d_result[n][0]);
-    try {
-      sd.zone= DNSName(d_result[n][1]);
-    } catch (...) {
-      continue;
-    }
-    sd.last_check=pdns_stou(d_result[n][3]);
-    sd.notified_serial=pdns_stou(d_result[n][4]);
-    sd.backend=this;
-    sd.kind=DomainInfo::Master;
-    allMasters.push_back(sd);
-  }
-
   for(vector<DomainInfo>::iterator i=allMasters.begin();i!=allMasters.end();++i) {
     SOAData sdata;
     sdata.serial=0;
@@ -1070,6 +1068,55 @@ skiprow:
   return false;
 }
 
+bool GSQLBackend::get(DNSZoneRecord &r)
+{
+skiprow:
+  if(d_query_stmt->hasNextRow()) {
+    try {
+      d_query_stmt->nextRow(d_row);
+      ASSERT_ROW_COLUMNS(d_query_name, d_row, 8);
+    } catch (SSqlException &e) {
+      throw PDNSException("GSQLBackend get: "+e.txtReason());
+    }
+    try {
+      extractRecord(d_row, r);
+    } catch (const std::invalid_argument&) {
+      goto skiprow;
+    } catch (const std::out_of_range&) {
+      goto skiprow;
+    } catch (...) {
+      // content we can't parse, don't leave the rest of the rows pending
+      try {
+        while(d_query_stmt->hasNextRow())
+          d_query_stmt->nextRow(d_row);
+        d_query_stmt->reset();
+      } catch (SSqlException &e) {
+      }
+      d_query_stmt = NULL;
+      throw;
+    }
+    return true;
+  }
+
+  try {
+    d_query_stmt->reset();
+  } catch (SSqlException &e) {
+      throw PDNSException("GSQLBackend get: "+e.txtReason());
+  }
+  d_query_stmt = NULL;
+  return false;
+}
+
+bool GSQLBackend::lookupBundle(const DNSName &qname, int domain_id, DNSPacket *pkt_p, vector<DNSZoneRecord>& records)
+{
+  lookup(QType(QType::ANY), qname, pkt_p, domain_id);
+
+  DNSZoneRecord dzr;
+  while(get(dzr))
+    records.push_back(dzr);
+  return true;
+}
+
 bool GSQLBackend::superMasterBackend(const string &ip, const DNSName &domain, const vector<DNSResourceRecord>&nsset, string *nameserver, string *account, DNSBackend **ddb)
 {
   // check if we know the ip/ns couple in the database
@@ -1653,6 +1700,46 @@ void GSQLBackend::extractRecord(const SSqlStatement::row_t& row, DNSResourceReco
   r.domain_id=pdns_stou(row[4]);
 }
 
+void GSQLBackend::extractRecord(const SSqlStatement::row_t& row, DNSZoneRecord& r)
+{
+  QType qtype;
+  qtype=row[3];
+
+  if (qtype==QType::SOA) {
+    // SOA content may need defaults filled in, leave that to the generic path
+    DNSResourceRecord rr;
+    extractRecord(row, rr);
+    makeZoneRecord(rr, r);
+    return;
+  }
+
+  r.dr.d_ttl = row[1].empty() ? ::arg().asNum("default-ttl") : pdns_stou(row[1]);
+  r.domain_id = pdns_stou(row[4]);
+  if(d_dnssecQueries)
+    r.auth = !row[7].empty() && row[7][0]=='1';
+  else
+    r.auth = 1;
+  r.scopeMask = 0;
+  r.signttl = 0;
+  r.wildcardname.clear();
+
+  if(!d_qname.empty())
+    r.dr.d_name = d_qname;
+  else
+    r.dr.d_name = DNSName(row[6]);
+  r.dr.d_type = qtype.getCode();
+  r.dr.d_class = QClass::IN;
+  r.dr.d_place = DNSResourceRecord::ANSWER;
+  r.dr.d_clen = 0;
+
+  if (qtype==QType::MX || qtype==QType::SRV)
+    r.dr.d_content = std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(r.dr.d_type, QClass::IN, row[2]+" "+row[0]));
+  else if (qtype==QType::TXT && !row[0].empty() && row[0][0]!='"')
+    r.dr.d_content = std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(r.dr.d_type, QClass::IN, "\""+row[0]+"\""));
+  else
+    r.dr.d_content = std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(r.dr.d_type, QClass::IN, row[0]));
+}
+
 void GSQLBackend::extractComment(const SSqlStatement::row_t& row, Comment& comment)
 {
   comment.domain_id = pdns_stou(row[0]);
@@ -182,6 +182,8 @@ public:
   void lookup(const QType &, const DNSName &qdomain, DNSPacket *p=0, int zoneId=-1);
   bool list(const DNSName &target, int domain_id, bool include_disabled=false);
   bool get(DNSResourceRecord &r);
+  bool get(DNSZoneRecord &r);
+  bool lookupBundle(const DNSName &qname, int domain_id, DNSPacket *pkt_p, vector<DNSZoneRecord>& records);
   void getAllDomains(vector<DomainInfo> *domains, bool include_disabled=false);
   bool isMaster(const DNSName &domain, const string &ip);
   void alsoNotifies(const DNSName &domain, set<string> *ips);
@@ -245,6 +247,7 @@ public:
 protected:
   string pattern2SQLPattern(const string& pattern);
   void extractRecord(const SSqlStatement::row_t& row, DNSResourceRecord& rr);
+  void extractRecord(const SSqlStatement::row_t& row, DNSZoneRecord& r);
   void extractComment(const SSqlStatement::row_t& row, Comment& c);
 
 private:
@@ -252,6 +255,7 @@ private:
   DNSName d_qname;
   SSql *d_db;
   SSqlStatement::result_t d_result;
+  SSqlStatement::row_t d_row; // reused by the streaming paths
 
   string d_NoIdQuery;
   string d_IdQuery;
@@ -26,7 +26,8 @@
 // this function can clean any cache that has a getTTD() method on its entries, and a 'sequence' index as its second index
 // the ritual is that the oldest entries are in *front* of the sequence collection, so on a hit, move an item to the end
 // on a miss, move it to the beginning
-template <typename T> void pruneCollection(T& collection, unsigned int maxCached, unsigned int scanFraction=1000)
+// onErase is called with every entry right before it is removed
+template <typename T, typename F> void pruneCollection(T& collection, unsigned int maxCached, unsigned int scanFraction, F onErase)
 {
   time_t now=time(0);
   unsigned int toTrim=0;
@@ -55,6 +56,7 @@ template <typename T> void pruneCollection(T& collection, unsigned int maxCached
   typename sequence_t::iterator iter=sidx.begin(), eiter;
   for(; iter != sidx.end() && tried < lookAt ; ++tried) {
     if(iter->getTTD() < now) { 
+      onErase(*iter);
       sidx.erase(iter++);
       erased++;
     }
@@ -77,9 +79,16 @@ template <typename T> void pruneCollection(T& collection, unsigned int maxCached
 
   eiter=iter=sidx.begin();
   std::advance(eiter, toTrim); 
+  for(auto i = iter; i != eiter; ++i)
+    onErase(*i);
   sidx.erase(iter, eiter);      // just lob it off from the beginning
 }
 
+template <typename T> void pruneCollection(T& collection, unsigned int maxCached, unsigned int scanFraction=1000)
+{
+  pruneCollection(collection, maxCached, scanFraction, [](const typename T::value_type&) {});
+}
+
 // note: this expects iterator from first index, and sequence MUST be second index!
 template <typename T> void moveCacheItemToFrontOrBack(T& collection, typename T::iterator& iter, bool front)
 {
@@ -28,6 +28,8 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include "dynhandler.hh"
+#include "auth-zonecache.hh"
+#include "auth-ixfrjournal.hh"
 
 #ifdef HAVE_SYSTEMD
 #include <systemd/sd-daemon.h>
@@ -79,6 +81,7 @@ void declareArguments()
   ::arg().set("max-queue-length","Maximum queuelength before considering situation lost")="5000";
 
   ::arg().set("retrieval-threads", "Number of AXFR-retrieval threads for slave operation")="2";
+  ::arg().set("retrieval-max-per-master", "Maximum number of simultaneous transfers from a single master, 0 for no limit")="0";
   ::arg().setSwitch("api", "Enable/disable the REST API (including HTTP listener)")="no";
   ::arg().set("api-key", "Static pre-shared authentication key for access to the REST API")="";
   ::arg().set("api-logfile", "Location of the server logfile (used by the REST API)")="/var/log/pdns.log";
@@ -135,6 +138,8 @@ void declareArguments()
   ::arg().set("webserver-port","Port of webserver/API to listen on")="8081";
   ::arg().set("webserver-password","Password required for accessing the webserver")="";
   ::arg().set("webserver-allow-from","Webserver/API access is only allowed from these subnets")="0.0.0.0/0,::/0";
+  ::arg().set("webserver-threads","Number of threads serving webserver/API requests")="4";
+  ::arg().set("webserver-statistics-interval","Seconds the statistics returned by the API are reused for, 0 to collect them for every request")="1";
 
   ::arg().setSwitch("out-of-zone-additional-processing","Do out of zone additional processing")="yes";
   ::arg().setSwitch("do-ipv6-additional-processing", "Do AAAA additional processing")="yes";
@@ -156,6 +161,8 @@ void declareArguments()
   ::arg().set("default-soa-edit-signed","Default SOA-EDIT value for signed zones")="";
   ::arg().set("dnssec-key-cache-ttl","Seconds to cache DNSSEC keys from the database")="30";
   ::arg().set("domain-metadata-cache-ttl","Seconds to cache domain metadata from the database")="60";
+  ::arg().set("zone-cache-refresh-interval","Seconds between reloads of the list of zones, 0 to disable the zone cache")="0";
+  ::arg().set("ixfr-journal-depth","Number of changes per zone to keep in memory for answering IXFR queries, 0 to disable")="0";
 
   ::arg().set("trusted-notification-proxy", "IP address of incoming notification proxy")="";
   ::arg().set("slave-renotify", "If we should send out notifications for slaved updates")="no";
@@ -249,6 +256,41 @@ static uint64_t getLatency(const std::string& str)
   return avg_latency;
 }
 
+static uint64_t getBackendQueryStats(const std::string& str)
+{
+  if(str=="backend-queries")
+    return UeberBackend::s_backendQueries;
+  else
+    return UeberBackend::s_bundleAnswers;
+}
+
+static uint64_t getSlaveXfrStats(const std::string& str)
+{
+  if(str=="slave-xfr-queued")
+    return Communicator.getSuckQueueSize();
+  else if(str=="slave-xfr-in-progress")
+    return Communicator.getSuckInProgress();
+  else if(str=="slave-xfr-done")
+    return Communicator.d_suckdone;
+  else
+    return Communicator.d_suckfailed;
+}
+
+static uint64_t getZoneCacheStats(const std::string& str)
+{
+  if(str=="zone-cache-hit")
+    return g_zoneCache.getHits();
+  else if(str=="zone-cache-miss")
+    return g_zoneCache.getMisses();
+  else
+    return g_zoneCache.size();
+}
+
+static uint64_t getIXFRJournalSize(const std::string& str)
+{
+  return g_ixfrJournal.size();
+}
+
 void declareStats(void)
 {
   S.declare("udp-queries","Number of UDP queries received");
@@ -270,6 +312,15 @@ void declareStats(void)
   S.declare("recursing-questions","Number of questions sent to recursor");
   S.declare("corrupt-packets","Number of corrupt packets received");
   S.declare("signatures", "Number of DNSSEC signatures made");
+  S.declare("axfr-out-streamed","Number of outgoing AXFRs sent straight from the backend");
+  S.declare("axfr-out-buffered","Number of outgoing AXFRs of signed zones, which are collected in memory first");
+  S.declare("axfr-out-duration-0-1","Number of outgoing AXFRs that took less than 1 second");
+  S.declare("axfr-out-duration-1-10","Number of outgoing AXFRs that took 1 to 10 seconds");
+  S.declare("axfr-out-duration-10-100","Number of outgoing AXFRs that took 10 to 100 seconds");
+  S.declare("axfr-out-duration-slow","Number of outgoing AXFRs that took 100 seconds or more");
+  S.declare("ixfr-out-journal","Number of IXFR queries answered with the changes from the IXFR journal");
+  S.declare("ixfr-out-uptodate","Number of IXFR queries from clients that already had our serial");
+  S.declare("ixfr-out-axfr","Number of IXFR queries answered with the full zone");
   S.declare("tcp-queries","Number of TCP queries received");
   S.declare("tcp-answers","Number of answers sent out over TCP");
   S.declare("tcp-answers-bytes","Total size of answers sent out over TCP");
@@ -306,10 +357,21 @@ void declareStats(void)
   S.declare("user-msec", "Number of msec spent in user time", getSysUserTimeMsec);
   S.declare("meta-cache-size", "Number of entries in the metadata cache", DNSSECKeeper::dbdnssecCacheSizes);
   S.declare("key-cache-size", "Number of entries in the key cache", DNSSECKeeper::dbdnssecCacheSizes);
+  S.declare("zone-profile-cache-size", "Number of zones in the DNSSEC profile cache", DNSSECKeeper::dbdnssecCacheSizes);
   S.declare("signature-cache-size", "Number of entries in the signature cache", signatureCacheSize);
 
   S.declare("servfail-packets","Number of times a server-failed packet was sent out");
   S.declare("latency","Average number of microseconds needed to answer a question", getLatency);
+  S.declare("backend-queries","Number of lookups sent to the backends", getBackendQueryStats);
+  S.declare("backend-bundle-answers","Number of backend lookups answered from a lookup bundle", getBackendQueryStats);
+  S.declare("slave-xfr-queued","Number of slave zones waiting for a transfer", getSlaveXfrStats);
+  S.declare("slave-xfr-in-progress","Number of slave zones being transferred", getSlaveXfrStats);
+  S.declare("slave-xfr-done","Number of incoming zone transfers that were committed", getSlaveXfrStats);
+  S.declare("slave-xfr-failed","Number of incoming zone transfers that failed", getSlaveXfrStats);
+  S.declare("zone-cache-hit","Number of zone lookups answered by the zone cache", getZoneCacheStats);
+  S.declare("zone-cache-miss","Number of zone lookups for names under no zone in the zone cache", getZoneCacheStats);
+  S.declare("zone-cache-size","Number of zones in the zone cache", getZoneCacheStats);
+  S.declare("ixfr-journal-size","Number of changes held in the IXFR journal", getIXFRJournalSize);
   S.declare("timedout-packets","Number of packets which weren't answered within timeout set");
   S.declare("security-status", "Security status based on regular polling");
   S.declareRing("queries","UDP Queries Received");
@@ -463,6 +525,24 @@ catch(PDNSException& pe)
   _exit(1);
 }
 
+static void* zoneCacheRefreshThread(void *)
+{
+  UeberBackend B;
+  for(;;) {
+    sleep(g_zoneCache.getRefreshInterval());
+    try {
+      B.updateZoneCache();
+    }
+    catch(PDNSException& pe) {
+      L<<Logger::Error<<"Unable to refresh the zone cache: "<<pe.reason<<endl;
+    }
+    catch(std::exception& e) {
+      L<<Logger::Error<<"Unable to refresh the zone cache: "<<e.what()<<endl;
+    }
+  }
+  return 0;
+}
+
 static void* dummyThread(void *)
 {
   void* ignore=0;
@@ -542,6 +622,20 @@ void mainthread()
 
   pthread_t qtid;
 
+  g_zoneCache.setRefreshInterval(::arg().asNum("zone-cache-refresh-interval"));
+  g_ixfrJournal.setDepth(::arg().asNum("ixfr-journal-depth"));
+  if(g_zoneCache.getRefreshInterval()) {
+    try {
+      UeberBackend B;
+      B.updateZoneCache();
+      L<<Logger::Warning<<"Loaded "<<g_zoneCache.size()<<" zones into the zone cache"<<endl;
+    }
+    catch(PDNSException& pe) {
+      L<<Logger::Error<<"Unable to fill the zone cache, will retry in "<<g_zoneCache.getRefreshInterval()<<" seconds: "<<pe.reason<<endl;
+    }
+    pthread_create(&qtid,0,zoneCacheRefreshThread, 0);
+  }
+
   if(::arg().mustDo("webserver") || ::arg().mustDo("api"))
     webserver.go();
 
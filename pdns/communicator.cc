@@ -40,6 +40,7 @@
 // there can be MANY OF THESE
 void CommunicatorClass::retrievalLoopThread(void)
 {
+  std::unique_ptr<UeberBackend> B;
   for(;;) {
     d_suck_sem.wait();
     SuckRequest sr;
@@ -47,14 +48,54 @@ void CommunicatorClass::retrievalLoopThread(void)
       Lock l(&d_lock);
       if(d_suckdomains.empty()) 
         continue;
-        
-      sr=d_suckdomains.front();
-      d_suckdomains.pop_front();
+
+      // take the oldest request for a master that is not at its transfer limit
+      auto i = d_suckdomains.begin();
+      if(d_maxpermaster) {
+        for(; i != d_suckdomains.end(); ++i) {
+          const auto busy = d_masterinprogress.find(i->master);
+          if(busy == d_masterinprogress.end() || busy->second < d_maxpermaster)
+            break;
+        }
+        if(i == d_suckdomains.end()) {
+          d_suckparked++; // a finishing transfer wakes us up again
+          continue;
+        }
+      }
+      sr=*i;
+      d_suckdomains.erase(i);
+      d_masterinprogress[sr.master]++;
+    }
+
+    // reuse the backend connections across transfers, suck() drops them after a failure
+    if(!B)
+      B.reset(new UeberBackend());
+    suck(sr.domain, sr.master, B);
+
+    {
+      Lock l(&d_lock);
+      if(!--d_masterinprogress[sr.master])
+        d_masterinprogress.erase(sr.master);
+      if(d_suckparked) {
+        d_suckparked--;
+        d_suck_sem.post();
+      }
     }
-    suck(sr.domain, sr.master);
   }
 }
 
+size_t CommunicatorClass::getSuckQueueSize()
+{
+  Lock l(&d_lock);
+  return d_suckdomains.size();
+}
+
+size_t CommunicatorClass::getSuckInProgress()
+{
+  Lock l(&d_lock);
+  return d_inprogress.size();
+}
+
 void CommunicatorClass::go()
 {
   try {
@@ -65,6 +106,8 @@ void CommunicatorClass::go()
     exit(1);
   }
 
+  d_maxpermaster = ::arg().asNum("retrieval-max-per-master");
+
   pthread_t tid;
   pthread_create(&tid,0,&launchhelper,this); // Starts CommunicatorClass::mainloop()
   for(int n=0; n < ::arg().asNum("retrieval-threads", 1); ++n)
@@ -160,6 +160,8 @@ public:
     d_nsock4 = -1;
     d_nsock6 = -1;
     d_preventSelfNotification = false;
+    d_maxpermaster = 0;
+    d_suckparked = 0;
   }
   time_t doNotifications();    
   void go();
@@ -186,13 +188,18 @@ public:
     return 0;
   }
   bool notifyDomain(const DNSName &domain);
+
+  size_t getSuckQueueSize(); //!< zones waiting for a transfer
+  size_t getSuckInProgress(); //!< zones being transferred right now
+  AtomicCounter d_suckdone{0}; //!< incoming transfers committed
+  AtomicCounter d_suckfailed{0}; //!< incoming transfers that failed
 private:
   void makeNotifySockets();
   void queueNotifyDomain(const DomainInfo& di, UeberBackend* B);
   int d_nsock4, d_nsock6;
   map<pair<DNSName,string>,time_t>d_holes;
   pthread_mutex_t d_holelock;
-  void suck(const DNSName &domain, const string &remote);
+  void suck(const DNSName &domain, const string &remote, std::unique_ptr<UeberBackend>& B);
   void ixfrSuck(const DNSName &domain, const TSIGTriplet& tt, const ComboAddress& laddr, const ComboAddress& remote, boost::scoped_ptr<AuthLua4>& pdl,
                 ZoneStatus& zs, vector<DNSRecord>* axfr);
 
@@ -202,6 +209,9 @@ private:
   
   UniQueue d_suckdomains;
   set<DNSName> d_inprogress;
+  map<string, unsigned int> d_masterinprogress; //!< transfers running per master
+  unsigned int d_maxpermaster;
+  unsigned int d_suckparked; //!< d_suck_sem wakeups that found only masters at their limit
   
   Semaphore d_suck_sem;
   Semaphore d_any_sem;
@@ -46,13 +46,19 @@ using namespace boost::assign;
 
 DNSSECKeeper::keycache_t DNSSECKeeper::s_keycache;
 DNSSECKeeper::metacache_t DNSSECKeeper::s_metacache;
+DNSSECKeeper::profilecache_t DNSSECKeeper::s_profilecache;
 pthread_rwlock_t DNSSECKeeper::s_metacachelock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_rwlock_t DNSSECKeeper::s_keycachelock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t DNSSECKeeper::s_profilecachelock = PTHREAD_RWLOCK_INITIALIZER;
+std::atomic<uint64_t> DNSSECKeeper::s_profilegeneration{0};
 AtomicCounter DNSSECKeeper::s_ops;
 time_t DNSSECKeeper::s_last_prune;
 
 bool DNSSECKeeper::isSecuredZone(const DNSName& zone) 
 {
+  if(auto profile = getProfile(zone))
+    return profile->secured;
+
   if(isPresigned(zone))
     return true;
 
@@ -68,6 +74,9 @@ bool DNSSECKeeper::isSecuredZone(const DNSName& zone)
 
 bool DNSSECKeeper::isPresigned(const DNSName& name)
 {
+  if(auto profile = getProfile(name))
+    return profile->presigned;
+
   string meta;
   getFromMeta(name, "PRESIGNED", meta);
   return meta=="1";
@@ -106,6 +115,11 @@ void DNSSECKeeper::clearAllCaches() {
     WriteLock l(&s_keycachelock);
     s_keycache.clear();
   }
+  {
+    WriteLock l(&s_profilecachelock);
+    s_profilecache.clear();
+    s_profilegeneration++;
+  }
   WriteLock l(&s_metacachelock);
   s_metacache.clear();
 }
@@ -116,6 +130,11 @@ void DNSSECKeeper::clearCaches(const DNSName& name)
     WriteLock l(&s_keycachelock);
     s_keycache.erase(name); 
   }
+  {
+    WriteLock l(&s_profilecachelock);
+    s_profilecache.erase(name);
+    s_profilegeneration++;
+  }
   WriteLock l(&s_metacachelock);
   pair<metacache_t::iterator, metacache_t::iterator> range = s_metacache.equal_range(tie(name));
   while(range.first != range.second)
@@ -188,6 +207,17 @@ void DNSSECKeeper::getFromMeta(const DNSName& zname, const std::string& key, std
 {
   static int ttl = ::arg().asNum("domain-metadata-cache-ttl");
   value.clear();
+
+  if(auto profile = getProfile(zname)) {
+    auto iter = profile->meta.find(key);
+    if(iter != profile->meta.end()) {
+      value = iter->second;
+      return;
+    }
+    if(profile->allMeta)
+      return;
+  }
+
   unsigned int now = time(0);
 
   if(!((++s_ops) % 100000)) {
@@ -248,29 +278,47 @@ uint64_t DNSSECKeeper::dbdnssecCacheSizes(const std::string& str)
     ReadLock l(&s_keycachelock);
     return s_keycache.size();
   }
+  else if(str=="zone-profile-cache-size") {
+    ReadLock l(&s_profilecachelock);
+    return s_profilecache.size();
+  }
   return (uint64_t)-1;
 }
 
+static void parseNSEC3PARAM(const DNSName& zname, const string& value, NSEC3PARAMRecordContent* ns3p)
+{
+  static int maxNSEC3Iterations=::arg().asNum("max-nsec3-iterations");
+  *ns3p = NSEC3PARAMRecordContent(value);
+  if (ns3p->d_iterations > maxNSEC3Iterations) {
+    ns3p->d_iterations = maxNSEC3Iterations;
+    L<<Logger::Error<<"Number of NSEC3 iterations for zone '"<<zname<<"' is above 'max-nsec3-iterations'. Value adjusted to: "<<maxNSEC3Iterations<<endl;
+  }
+  if (ns3p->d_algorithm != 1) {
+    L<<Logger::Error<<"Invalid hash algorithm for NSEC3: '"<<std::to_string(ns3p->d_algorithm)<<"', setting to 1 for zone '"<<zname<<"'."<<endl;
+    ns3p->d_algorithm = 1;
+  }
+}
+
 bool DNSSECKeeper::getNSEC3PARAM(const DNSName& zname, NSEC3PARAMRecordContent* ns3p, bool* narrow)
 {
+  if(auto profile = getProfile(zname)) {
+    if(!profile->nsec3)
+      return false;
+    if(ns3p)
+      *ns3p = profile->ns3p;
+    if(narrow)
+      *narrow = profile->narrow;
+    return true;
+  }
+
   string value;
   getFromMeta(zname, "NSEC3PARAM", value);
   if(value.empty()) { // "no NSEC3"
     return false;
   }
 
-  static int maxNSEC3Iterations=::arg().asNum("max-nsec3-iterations");
-  if(ns3p) {
-    *ns3p = NSEC3PARAMRecordContent(value);
-    if (ns3p->d_iterations > maxNSEC3Iterations) {
-      ns3p->d_iterations = maxNSEC3Iterations;
-      L<<Logger::Error<<"Number of NSEC3 iterations for zone '"<<zname<<"' is above 'max-nsec3-iterations'. Value adjusted to: "<<maxNSEC3Iterations<<endl;
-    }
-    if (ns3p->d_algorithm != 1) {
-      L<<Logger::Error<<"Invalid hash algorithm for NSEC3: '"<<std::to_string(ns3p->d_algorithm)<<"', setting to 1 for zone '"<<zname<<"'."<<endl;
-      ns3p->d_algorithm = 1;
-    }
-  }
+  if(ns3p)
+    parseNSEC3PARAM(zname, value, ns3p);
   if(narrow) {
     getFromMeta(zname, "NSEC3NARROW", value);
     *narrow = (value=="1");
@@ -405,6 +453,11 @@ DNSSECKeeper::keyset_t DNSSECKeeper::getKeys(const DNSName& zone, bool useCache)
     cleanup();
   }
 
+  if (useCache) {
+    if(auto profile = getProfile(zone))
+      return profile->keys;
+  }
+
   if (useCache && ttl > 0) {
     ReadLock l(&s_keycachelock);
     keycache_t::const_iterator iter = s_keycache.find(zone);
@@ -417,6 +470,24 @@ DNSSECKeeper::keyset_t DNSSECKeeper::getKeys(const DNSName& zone, bool useCache)
     }
   }
 
+  keyset_t retkeyset = loadKeys(zone, getNSEC3PARAM(zone));
+
+  if (ttl > 0) {
+    KeyCacheEntry kce;
+    kce.d_domain=zone;
+    kce.d_keys = retkeyset;
+    kce.d_ttd = now + ttl;
+    {
+      WriteLock l(&s_keycachelock);
+      replacing_insert(s_keycache, kce);
+    }
+  }
+
+  return retkeyset;
+}
+
+DNSSECKeeper::keyset_t DNSSECKeeper::loadKeys(const DNSName& zone, bool nsec3)
+{
   keyset_t retkeyset;
   vector<DNSBackend::KeyData> dbkeyset;
 
@@ -449,7 +520,7 @@ DNSSECKeeper::keyset_t DNSSECKeeper::getKeys(const DNSName& zone, bool useCache)
 
     dpk.d_flags = kd.flags;
     dpk.d_algorithm = dkrc.d_algorithm;
-    if(dpk.d_algorithm == 5 && getNSEC3PARAM(zone))
+    if(dpk.d_algorithm == 5 && nsec3)
       dpk.d_algorithm+=2;
 
     KeyMetaData kmd;
@@ -469,18 +540,92 @@ DNSSECKeeper::keyset_t DNSSECKeeper::getKeys(const DNSName& zone, bool useCache)
   }
   sort(retkeyset.begin(), retkeyset.end(), keyCompareByKindAndID);
 
-  if (ttl > 0) {
-    KeyCacheEntry kce;
-    kce.d_domain=zone;
-    kce.d_keys = retkeyset;
-    kce.d_ttd = now + ttl;
-    {
-      WriteLock l(&s_keycachelock);
-      replacing_insert(s_keycache, kce);
+  return retkeyset;
+}
+
+DNSSECKeeper::zoneprofile_t DNSSECKeeper::getProfile(const DNSName& zone)
+{
+  static int keyttl = ::arg().asNum("dnssec-key-cache-ttl");
+  static int metattl = ::arg().asNum("domain-metadata-cache-ttl");
+  if (keyttl <= 0 || metattl <= 0)
+    return nullptr;
+
+  time_t now = time(0);
+  // read before the cache, so a profile built while the caches are being cleared is not published
+  uint64_t generation = s_profilegeneration;
+
+  // answering one query asks for the same zone several times
+  if (d_lastProfile && d_lastProfileGeneration == generation && d_lastProfile->ttd > now && d_lastProfile->zone == zone)
+    return d_lastProfile;
+
+  if(!((++s_ops) % 100000)) {
+    cleanup();
+  }
+
+  zoneprofile_t profile;
+  {
+    ReadLock l(&s_profilecachelock);
+    auto iter = s_profilecache.find(zone);
+    if (iter != s_profilecache.end() && iter->second->ttd > now)
+      profile = iter->second;
+  }
+
+  if (!profile) {
+    profile = buildProfile(zone, now + std::min(keyttl, metattl));
+    WriteLock l(&s_profilecachelock);
+    if (generation == s_profilegeneration)
+      s_profilecache[zone] = profile;
+  }
+
+  d_lastProfile = profile;
+  d_lastProfileGeneration = generation;
+  return profile;
+}
+
+DNSSECKeeper::zoneprofile_t DNSSECKeeper::buildProfile(const DNSName& zone, time_t ttd)
+{
+  auto profile = std::make_shared<ZoneProfile>();
+  profile->zone = zone;
+  profile->ttd = ttd;
+
+  std::map<std::string, std::vector<std::string> > allMeta;
+  if (d_keymetadb->getAllDomainMetadata(zone, allMeta)) {
+    profile->allMeta = true;
+    for(const auto& kind : allMeta) {
+      if(!kind.second.empty())
+        profile->meta[kind.first] = kind.second.front();
+    }
+  }
+  else {
+    // the kinds looked at while answering queries, anything else is looked up by itself
+    for(const char* kind : {"PRESIGNED", "NSEC3PARAM", "NSEC3NARROW", "PUBLISH-CDNSKEY", "PUBLISH-CDS", "SOA-EDIT"}) {
+      vector<string> values;
+      d_keymetadb->getDomainMetadata(zone, kind, values);
+      if(!values.empty())
+        profile->meta[kind] = values.front();
     }
   }
 
-  return retkeyset;
+  auto iter = profile->meta.find("PRESIGNED");
+  profile->presigned = iter != profile->meta.end() && iter->second == "1";
+
+  iter = profile->meta.find("NSEC3PARAM");
+  if (iter != profile->meta.end() && !iter->second.empty()) {
+    profile->nsec3 = true;
+    parseNSEC3PARAM(zone, iter->second, &profile->ns3p);
+    iter = profile->meta.find("NSEC3NARROW");
+    profile->narrow = iter != profile->meta.end() && iter->second == "1";
+  }
+
+  profile->keys = loadKeys(zone, profile->nsec3);
+
+  profile->secured = profile->presigned;
+  for(const auto& keymeta : profile->keys) {
+    if(keymeta.second.active)
+      profile->secured = true;
+  }
+
+  return profile;
 }
 
 bool DNSSECKeeper::checkKeys(const DNSName& zone)
@@ -565,6 +710,16 @@ void DNSSECKeeper::cleanup()
         WriteLock l(&s_keycachelock);
         pruneCollection(s_keycache, ::arg().asNum("max-cache-entries"));
     }
+    {
+        WriteLock l(&s_profilecachelock);
+        size_t maxEntries = ::arg().asNum("max-cache-entries");
+        for(auto iter = s_profilecache.begin(); iter != s_profilecache.end(); ) {
+          if(iter->second->ttd <= now.tv_sec || s_profilecache.size() > maxEntries)
+            iter = s_profilecache.erase(iter);
+          else
+            ++iter;
+        }
+    }
     s_last_prune=time(0);
   }
 }
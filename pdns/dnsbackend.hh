@@ -115,6 +115,14 @@ public:
   virtual bool get(DNSResourceRecord &)=0; //!< retrieves one DNSResource record, returns false if no more were available
   virtual bool get(DNSZoneRecord &r);
 
+  //! Fetches all records of qdomain in zone zoneId with a single query, so several qtypes can be answered from it
+  /** Only implement this if an ANY lookup returns exactly the union of the lookups for each qtype.
+      Returns false if not supported, without doing any lookup. */
+  virtual bool lookupBundle(const DNSName &qdomain, int zoneId, DNSPacket *pkt_p, vector<DNSZoneRecord>& records)
+  {
+    return false;
+  }
+
   //! Initiates a list of the specified domain
   /** Once initiated, DNSResourceRecord objects can be retrieved using get(). Should return false
       if the backend does not consider itself responsible for the id passed.
@@ -378,6 +386,8 @@ protected:
   bool mustDo(const string &key);
   const string &getArg(const string &key);
   int getArgAsNum(const string &key);
+  //! Turns rr into dzr, quoting TXT content and filling in SOA defaults. rr may be modified.
+  static void makeZoneRecord(DNSResourceRecord& rr, DNSZoneRecord& dzr);
 
 private:
   string d_prefix;
@@ -35,6 +35,7 @@
 
 #include "dnsname.hh"
 #include "dnswriter.hh"
+#include "dnsparser.hh"
 #include "base64.hh"
 #include <fstream>
 #include "delaypipe.hh"
@@ -195,9 +196,6 @@ static void doLatencyAverages(double udiff)
 
 bool responseContentMatches(const char* response, const uint16_t responseLen, const DNSName& qname, const uint16_t qtype, const uint16_t qclass, const ComboAddress& remote)
 {
-  uint16_t rqtype, rqclass;
-  unsigned int consumed;
-  DNSName rqname;
   const struct dnsheader* dh = (struct dnsheader*) response;
 
   if (responseLen < sizeof(dnsheader)) {
@@ -215,7 +213,11 @@ bool responseContentMatches(const char* response, const uint16_t responseLen, co
   }
 
   try {
-    rqname=DNSName(response, responseLen, sizeof(dnsheader), false, &rqtype, &rqclass, &consumed);
+    /* compare the question in place, no need to build a DNSName for it */
+    DNSPacketView view(response, responseLen);
+    if (view.getQType() != qtype || view.getQClass() != qclass || !view.nameEquals(view.getQNameOffset(), qname)) {
+      return false;
+    }
   }
   catch(std::exception& e) {
     if(responseLen > (ssize_t)sizeof(dnsheader))
@@ -224,10 +226,6 @@ bool responseContentMatches(const char* response, const uint16_t responseLen, co
     return false;
   }
 
-  if (rqtype != qtype || rqclass != qclass || rqname != qname) {
-    return false;
-  }
-
   return true;
 }
 
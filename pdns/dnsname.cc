@@ -223,12 +223,7 @@ bool DNSName::isPartOf(const DNSName& parent) const
       break;
     }
     if (static_cast<size_t>(distance) == parent.d_storage.size()) {
-      auto p = parent.d_storage.cbegin();
-      for(; us != d_storage.cend(); ++us, ++p) {
-        if(dns_tolower(*p) != dns_tolower(*us))
-          return false;
-      }
-      return true;
+      return dns_iequals_raw(reinterpret_cast<const unsigned char*>(&*us), reinterpret_cast<const unsigned char*>(parent.d_storage.c_str()), parent.d_storage.size());
     }
     if (*us < 0) {
       throw std::out_of_range("negative label length in dnsname");
@@ -248,6 +243,7 @@ void DNSName::makeUsRelative(const DNSName& zone)
   if (isPartOf(zone)) {
     d_storage.erase(d_storage.size()-zone.d_storage.size());
     d_storage.append(1, (char)0); // put back the trailing 0
+    storageChanged();
   } 
   else
     clear();
@@ -292,6 +288,7 @@ void DNSName::appendRawLabel(const char* start, unsigned int length)
   }
   d_storage.append(start, length);
   d_storage.append(1, (char)0);
+  storageChanged();
 }
 
 void DNSName::prependRawLabel(const std::string& label)
@@ -306,9 +303,10 @@ void DNSName::prependRawLabel(const std::string& label)
   if(d_storage.empty())
     d_storage.append(1, (char)0);
 
-  string_t prep(1, (char)label.size());
-  prep.append(label.c_str(), label.size());
-  d_storage = prep+d_storage;
+  const char len = (char)label.size();
+  d_storage.insert(0, label.c_str(), label.size());
+  d_storage.insert(0, &len, 1);
+  storageChanged();
 }
 
 bool DNSName::slowCanonCompare(const DNSName& rhs) const 
@@ -352,6 +350,7 @@ bool DNSName::chopOff()
   if(d_storage.empty() || d_storage[0]==0)
     return false;
   d_storage.erase(0, (unsigned int)d_storage[0]+1);
+  storageChanged();
   return true;
 }
 
@@ -375,15 +374,21 @@ bool DNSName::isHostname() const
 
 unsigned int DNSName::countLabels() const
 {
+  uint8_t cached = d_labelCount.load(std::memory_order_relaxed);
+  if(cached != s_unknownLabelCount)
+    return cached;
+
   unsigned int count=0;
   for(const unsigned char* p = (const unsigned char*) d_storage.c_str(); p < ((const unsigned char*) d_storage.c_str()) + d_storage.size() && *p; p+=*p+1)
     ++count;
+  if(count < s_unknownLabelCount)
+    d_labelCount.store(count, std::memory_order_relaxed);
   return count;
 }
 
 void DNSName::trimToLabels(unsigned int to)
 {
-  while(countLabels() > to && chopOff())
+  for(unsigned int count = countLabels(); count > to && chopOff(); count--)
     ;
 }
 
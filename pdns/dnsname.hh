@@ -27,17 +27,246 @@
 #include <strings.h>
 #include <stdexcept>
 
-#include <boost/version.hpp>
-
-// it crashes on OSX and doesn't compile on OpenBSD
-#if BOOST_VERSION >= 105300 && ! defined( __APPLE__ ) && ! defined(__OpenBSD__)
-#include <boost/container/string.hpp>
-#endif
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <functional>
+#include <cstring>
 
 #include "ascii.hh"
 
 uint32_t burtleCI(const unsigned char* k, uint32_t length, uint32_t init);
 
+/* Storage for the wire format of a DNSName. Up to s_inlineCapacity - 1 bytes
+   are stored inline, which covers the vast majority of names seen in practice,
+   longer ones fall back to a heap allocation. The content is always followed
+   by a 0 byte so c_str() is cheap. Only implements what DNSName needs from a string. */
+class DNSNameStorage
+{
+public:
+  static const size_t s_inlineCapacity = 48;
+  static const size_t npos = static_cast<size_t>(-1);
+  typedef char value_type;
+  typedef size_t size_type;
+  typedef char* iterator;
+  typedef const char* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  DNSNameStorage() : d_size(0), d_capacity(s_inlineCapacity)
+  {
+    d_inline[0] = 0;
+  }
+  DNSNameStorage(size_t count, char c) : DNSNameStorage()
+  {
+    append(count, c);
+  }
+  DNSNameStorage(const char* p, size_t len) : DNSNameStorage()
+  {
+    append(p, len);
+  }
+  DNSNameStorage(const DNSNameStorage& rhs) : DNSNameStorage()
+  {
+    append(rhs.data(), rhs.size());
+  }
+  DNSNameStorage(DNSNameStorage&& rhs) noexcept : DNSNameStorage()
+  {
+    takeFrom(rhs);
+  }
+  ~DNSNameStorage()
+  {
+    release();
+  }
+  DNSNameStorage& operator=(const DNSNameStorage& rhs)
+  {
+    if(this != &rhs) {
+      clear();
+      append(rhs.data(), rhs.size());
+    }
+    return *this;
+  }
+  DNSNameStorage& operator=(DNSNameStorage&& rhs) noexcept
+  {
+    if(this != &rhs) {
+      release();
+      takeFrom(rhs);
+    }
+    return *this;
+  }
+  DNSNameStorage& operator+=(const DNSNameStorage& rhs)
+  {
+    return append(rhs.data(), rhs.size());
+  }
+
+  void swap(DNSNameStorage& rhs) noexcept
+  {
+    DNSNameStorage tmp(std::move(rhs));
+    rhs = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  const char* c_str() const { return data(); }
+  const char* data() const { return isInline() ? d_inline : d_heap; }
+  char* data() { return isInline() ? d_inline : d_heap; }
+  size_t size() const { return d_size; }
+  size_t length() const { return d_size; }
+  bool empty() const { return d_size == 0; }
+  size_t capacity() const { return d_capacity - 1; }
+  //<! Number of bytes allocated on the heap, if any
+  size_t heapSize() const { return isInline() ? 0 : d_capacity; }
+
+  char& operator[](size_t pos) { return data()[pos]; }
+  const char& operator[](size_t pos) const { return data()[pos]; }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + d_size; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + d_size; }
+  const_iterator cbegin() const { return data(); }
+  const_iterator cend() const { return data() + d_size; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+  void reserve(size_t len)
+  {
+    if(len + 1 > d_capacity)
+      grow(len + 1);
+  }
+  void clear()
+  {
+    d_size = 0;
+    data()[0] = 0;
+  }
+  DNSNameStorage& assign(size_t count, char c)
+  {
+    clear();
+    return append(count, c);
+  }
+  DNSNameStorage& append(size_t count, char c)
+  {
+    reserve(d_size + count);
+    memset(data() + d_size, c, count);
+    setSize(d_size + count);
+    return *this;
+  }
+  DNSNameStorage& append(const char* p, size_t len)
+  {
+    if(contains(p)) {
+      // p moves along with our buffer
+      const size_t offset = p - data();
+      reserve(d_size + len);
+      p = data() + offset;
+    }
+    else {
+      reserve(d_size + len);
+    }
+    memmove(data() + d_size, p, len);
+    setSize(d_size + len);
+    return *this;
+  }
+  DNSNameStorage& append(const char* first, const char* last)
+  {
+    return append(first, static_cast<size_t>(last - first));
+  }
+  DNSNameStorage& insert(size_t pos, const char* p, size_t len)
+  {
+    if(pos > d_size)
+      throw std::out_of_range("DNSNameStorage::insert");
+    if(contains(p)) {
+      const DNSNameStorage copy(p, len);
+      return insert(pos, copy.data(), copy.size());
+    }
+    reserve(d_size + len);
+    memmove(data() + pos + len, data() + pos, d_size - pos);
+    memcpy(data() + pos, p, len);
+    setSize(d_size + len);
+    return *this;
+  }
+  DNSNameStorage& erase(size_t pos = 0, size_t len = npos)
+  {
+    if(pos > d_size)
+      throw std::out_of_range("DNSNameStorage::erase");
+    len = std::min(len, d_size - pos);
+    memmove(data() + pos, data() + pos + len, d_size - pos - len);
+    setSize(d_size - len);
+    return *this;
+  }
+  DNSNameStorage& replace(size_t pos, size_t len, const DNSNameStorage& str)
+  {
+    if(pos > d_size)
+      throw std::out_of_range("DNSNameStorage::replace");
+    if(&str == this) {
+      const DNSNameStorage copy(str);
+      return replace(pos, len, copy);
+    }
+    len = std::min(len, d_size - pos);
+    const DNSNameStorage tail(data() + pos + len, d_size - pos - len);
+    setSize(pos);
+    append(str.data(), str.size());
+    return append(tail.data(), tail.size());
+  }
+
+private:
+  bool isInline() const { return d_capacity == s_inlineCapacity; }
+  //<! Whether p points into our own buffer, which any growth moves
+  bool contains(const char* p) const
+  {
+    return std::greater_equal<const char*>()(p, data()) && std::less_equal<const char*>()(p, data() + d_size);
+  }
+
+  //<! Frees our heap storage if any, and leaves us empty and inline
+  void release() noexcept
+  {
+    if(!isInline())
+      delete[] d_heap;
+    d_capacity = s_inlineCapacity;
+    d_size = 0;
+    d_inline[0] = 0;
+  }
+
+  //<! Moves the content of rhs to us, we must be inline, rhs is left empty and inline
+  void takeFrom(DNSNameStorage& rhs) noexcept
+  {
+    if(rhs.isInline()) {
+      memcpy(d_inline, rhs.d_inline, rhs.d_size + 1);
+    }
+    else {
+      d_heap = rhs.d_heap;
+      d_capacity = rhs.d_capacity;
+      rhs.d_capacity = s_inlineCapacity;
+    }
+    d_size = rhs.d_size;
+    rhs.d_size = 0;
+    rhs.d_inline[0] = 0;
+  }
+
+  void setSize(size_t len)
+  {
+    d_size = len;
+    data()[len] = 0;
+  }
+
+  void grow(size_t capacity)
+  {
+    capacity = std::max(capacity, static_cast<size_t>(d_capacity) * 2);
+    char* newData = new char[capacity];
+    memcpy(newData, data(), d_size + 1);
+    if(!isInline())
+      delete[] d_heap;
+    d_heap = newData;
+    d_capacity = capacity;
+  }
+
+  union {
+    char d_inline[s_inlineCapacity];
+    char* d_heap;
+  };
+  uint32_t d_size;
+  uint32_t d_capacity; //<! including the trailing 0, s_inlineCapacity means we are inline
+};
+
 // #include "dns.hh"
 // #include "logger.hh"
 
@@ -59,6 +288,32 @@ class DNSName
 {
 public:
   DNSName()  {}          //!< Constructs an *empty* DNSName, NOT the root!
+  DNSName(const DNSName& rhs) : d_storage(rhs.d_storage)
+  {
+    copyCache(rhs);
+  }
+  DNSName(DNSName&& rhs) noexcept : d_storage(std::move(rhs.d_storage))
+  {
+    copyCache(rhs);
+    rhs.storageChanged();
+  }
+  DNSName& operator=(const DNSName& rhs)
+  {
+    if(this != &rhs) {
+      d_storage = rhs.d_storage;
+      copyCache(rhs);
+    }
+    return *this;
+  }
+  DNSName& operator=(DNSName&& rhs) noexcept
+  {
+    if(this != &rhs) {
+      d_storage = std::move(rhs.d_storage);
+      copyCache(rhs);
+      rhs.storageChanged();
+    }
+    return *this;
+  }
   explicit DNSName(const char* p);      //!< Constructs from a human formatted, escaped presentation
   explicit DNSName(const std::string& str) : DNSName(str.c_str()) {}; //!< Constructs from a human formatted, escaped presentation
   DNSName(const char* p, int len, int offset, bool uncompress, uint16_t* qtype=0, uint16_t* qclass=0, unsigned int* consumed=0, uint16_t minOffset=0); //!< Construct from a DNS Packet, taking the first question if offset=12
@@ -83,8 +338,7 @@ public:
   DNSName makeRelative(const DNSName& zone) const;
   DNSName makeLowerCase() const
   {
-    DNSName ret;
-    ret.d_storage = d_storage;
+    DNSName ret(*this); // hash and label count are case insensitive
     for(auto & c : ret.d_storage) {
       c=dns_tolower(c);
     }
@@ -98,11 +352,19 @@ public:
   size_t wirelength() const; //!< Number of total bytes in the name
   bool empty() const { return d_storage.empty(); }
   bool isRoot() const { return d_storage.size()==1 && d_storage[0]==0; }
-  void clear() { d_storage.clear(); }
+  void clear() { d_storage.clear(); storageChanged(); }
   void trimToLabels(unsigned int);
   size_t hash(size_t init=0) const
   {
-    return burtleCI((const unsigned char*)d_storage.c_str(), d_storage.size(), init);
+    if(init != 0)
+      return burtleCI((const unsigned char*)d_storage.c_str(), d_storage.size(), init);
+
+    uint32_t ret = d_hash.load(std::memory_order_relaxed);
+    if(ret == 0) {
+      ret = burtleCI((const unsigned char*)d_storage.c_str(), d_storage.size(), 0);
+      d_hash.store(ret, std::memory_order_relaxed);
+    }
+    return ret;
   }
   DNSName& operator+=(const DNSName& rhs)
   {
@@ -115,33 +377,44 @@ public:
       d_storage+=rhs.d_storage;
     else
       d_storage.replace(d_storage.length()-1, rhs.d_storage.length(), rhs.d_storage);
+    storageChanged();
 
     return *this;
   }
 
   bool operator<(const DNSName& rhs)  const // this delivers _some_ kind of ordering, but not one useful in a DNS context. Really fast though.
   {
-    return std::lexicographical_compare(d_storage.rbegin(), d_storage.rend(), 
-				 rhs.d_storage.rbegin(), rhs.d_storage.rend(),
-				 [](const unsigned char& a, const unsigned char& b) {
-					  return dns_tolower(a) < dns_tolower(b);
-					}); // note that this is case insensitive, including on the label lengths
+    return dns_ilexicographical_compare_reverse(reinterpret_cast<const unsigned char*>(d_storage.c_str()), d_storage.size(),
+                                               reinterpret_cast<const unsigned char*>(rhs.d_storage.c_str()), rhs.d_storage.size()); // note that this is case insensitive, including on the label lengths
   }
 
   inline bool canonCompare(const DNSName& rhs) const;
   bool slowCanonCompare(const DNSName& rhs) const;  
 
-#if BOOST_VERSION >= 105300 && ! defined( __APPLE__ ) && ! defined(__OpenBSD__)
-  typedef boost::container::string string_t;
-#else
-  typedef std::string string_t;
-#endif
+  typedef DNSNameStorage string_t;
   const string_t& getStorage() const {
     return d_storage;
   }
 private:
   string_t d_storage;
+  /* lazily computed from d_storage and reset by every change to it. Atomic because
+     const DNSNames are shared between threads, relaxed since any thread would
+     compute the same value. A hash of 0 is simply never cached. */
+  mutable std::atomic<uint32_t> d_hash{0};
+  mutable std::atomic<uint8_t> d_labelCount{s_unknownLabelCount};
+  static const uint8_t s_unknownLabelCount = 255;
+
+  void storageChanged()
+  {
+    d_hash.store(0, std::memory_order_relaxed);
+    d_labelCount.store(s_unknownLabelCount, std::memory_order_relaxed);
+  }
 
+  void copyCache(const DNSName& rhs)
+  {
+    d_hash.store(rhs.d_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    d_labelCount.store(rhs.d_labelCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
   void packetParser(const char* p, int len, int offset, bool uncompress, uint16_t* qtype, uint16_t* qclass, unsigned int* consumed, int depth, uint16_t minOffset);
   static std::string escapeLabel(const std::string& orig);
   static std::string unescapeLabel(const std::string& orig);
@@ -182,29 +455,12 @@ inline bool DNSName::canonCompare(const DNSName& rhs) const
     ourcount--;
     rhscount--;
 
-    bool res=std::lexicographical_compare(
-					  d_storage.c_str() + ourpos[ourcount] + 1, 
-					  d_storage.c_str() + ourpos[ourcount] + 1 + *(d_storage.c_str() + ourpos[ourcount]),
-					  rhs.d_storage.c_str() + rhspos[rhscount] + 1, 
-					  rhs.d_storage.c_str() + rhspos[rhscount] + 1 + *(rhs.d_storage.c_str() + rhspos[rhscount]),
-					  [](const unsigned char& a, const unsigned char& b) {
-					    return dns_tolower(a) < dns_tolower(b);
-					  });
-    
-    //    cout<<"Forward: "<<res<<endl;
-    if(res)
-      return true;
-
-    res=std::lexicographical_compare(	  rhs.d_storage.c_str() + rhspos[rhscount] + 1, 
-					  rhs.d_storage.c_str() + rhspos[rhscount] + 1 + *(rhs.d_storage.c_str() + rhspos[rhscount]),
-					  d_storage.c_str() + ourpos[ourcount] + 1, 
-					  d_storage.c_str() + ourpos[ourcount] + 1 + *(d_storage.c_str() + ourpos[ourcount]),
-					  [](const unsigned char& a, const unsigned char& b) {
-					    return dns_tolower(a) < dns_tolower(b);
-					  });
-    //    cout<<"Reverse: "<<res<<endl;
+    int res=dns_icompare_raw((const unsigned char*)d_storage.c_str() + ourpos[ourcount] + 1,
+                             *((const unsigned char*)d_storage.c_str() + ourpos[ourcount]),
+                             (const unsigned char*)rhs.d_storage.c_str() + rhspos[rhscount] + 1,
+                             *((const unsigned char*)rhs.d_storage.c_str() + rhspos[rhscount]));
     if(res)
-      return false;
+      return res < 0;
   }
   return false;
 }
@@ -225,28 +481,33 @@ inline DNSName operator+(const DNSName& lhs, const DNSName& rhs)
   return ret;
 }
 
+/* Children are kept in a std::set, ordered on the length of their lowercased label and
+   then on the label itself, so adding a name stays O(log n) per label even below a parent
+   with very many children. Lookups walk the labels of the wire format storage of a DNSName
+   from right to left and search with a per-thread key node whose label buffer is reused,
+   so they don't allocate. */
 template<typename T>
 struct SuffixMatchTree
 {
-  SuffixMatchTree(const std::string& name="", bool endNode_=false) : d_name(name), endNode(endNode_)
-  {}
-
-  SuffixMatchTree(const SuffixMatchTree& rhs)
+  SuffixMatchTree(const std::string& name="", bool endNode_=false) : d_name(name), endNode(endNode_), d_value()
   {
-    d_name = rhs.d_name;
-    children = rhs.children;
-    endNode = rhs.endNode;
-    d_value = rhs.d_value;
+    for(auto& c : d_name) {
+      c=dns_tolower(c);
+    }
   }
-  std::string d_name;
+
+  std::string d_name; //!< lowercased label of this node
   mutable std::set<SuffixMatchTree> children;
   mutable bool endNode;
   mutable T d_value;
+  typedef SuffixMatchTree value_type;
+
   bool operator<(const SuffixMatchTree& rhs) const
   {
-    return strcasecmp(d_name.c_str(), rhs.d_name.c_str()) < 0;
+    if(d_name.size() != rhs.d_name.size())
+      return d_name.size() < rhs.d_name.size();
+    return memcmp(d_name.data(), rhs.d_name.data(), d_name.size()) < 0;
   }
-  typedef SuffixMatchTree value_type;
 
   template<typename V>
   void visit(const V& v) const {
@@ -258,64 +519,124 @@ struct SuffixMatchTree
 
   void add(const DNSName& name, const T& t)
   {
-    add(name.getRawLabels(), t);
+    uint8_t offsets[128];
+    unsigned int count = getLabelOffsets(name, offsets);
+    const char* storage = name.getStorage().c_str();
+    const SuffixMatchTree* node = this;
+    while(count > 0) {
+      count--;
+      node = &node->addChild(storage + offsets[count] + 1, static_cast<uint8_t>(storage[offsets[count]]));
+    }
+    node->endNode = true;
+    node->d_value = t;
   }
 
-  void add(std::vector<std::string> labels, const T& value) const
+  void add(const std::vector<std::string>& labels, const T& value)
   {
-    if(labels.empty()) { // this allows insertion of the root
-      endNode=true;
-      d_value=value;
-    }
-    else if(labels.size()==1) {
-      SuffixMatchTree newChild(*labels.begin(), true);
-      auto res=children.insert(newChild);
-      if(!res.second) {
-        // we might already have had the node as an
-        // intermediary one, but it's now an end node
-        if(!res.first->endNode) {
-          res.first->endNode = true;
-        }
-      }
-      res.first->d_value = value;
-    }
-    else {
-      SuffixMatchTree newnode(*labels.rbegin(), false);
-      auto res=children.insert(newnode);
-      labels.pop_back();
-      res.first->add(labels, value);
+    const SuffixMatchTree* node = this;
+    for(auto label = labels.crbegin(); label != labels.crend(); ++label) {
+      node = &node->addChild(label->c_str(), label->size());
     }
+    node->endNode = true;
+    node->d_value = value;
   }
 
-  T* lookup(const DNSName& name)  const
+  //! returns the value of the most specific added name that name is part of, or nullptr
+  T* lookup(const DNSName& name) const
   {
     if(children.empty()) { // speed up empty set
       if(endNode)
         return &d_value;
       return 0;
     }
-    return lookup(name.getRawLabels());
+
+    uint8_t offsets[128];
+    unsigned int count = getLabelOffsets(name, offsets);
+    const char* storage = name.getStorage().c_str();
+    const SuffixMatchTree* node = this;
+    const SuffixMatchTree* best = endNode ? this : nullptr;
+    while(count > 0) {
+      count--;
+      const SuffixMatchTree* child = node->findChild(storage + offsets[count] + 1, static_cast<uint8_t>(storage[offsets[count]]));
+      if(!child)
+        break;
+      node = child;
+      if(node->endNode)
+        best = node;
+    }
+    if(best)
+      return &best->d_value;
+    return 0;
   }
 
-  T* lookup(std::vector<std::string> labels) const
+  //! removes name, if it was added, and the branches that no longer lead anywhere
+  void remove(const DNSName& name)
   {
-    if(labels.empty()) { // optimization
-      if(endNode)
-        return &d_value;
-      return 0;
+    uint8_t offsets[128];
+    unsigned int count = getLabelOffsets(name, offsets);
+    const char* storage = name.getStorage().c_str();
+    std::vector<const SuffixMatchTree*> path;
+    path.reserve(count + 1);
+    path.push_back(this);
+    while(count > 0) {
+      count--;
+      const SuffixMatchTree* child = path.back()->findChild(storage + offsets[count] + 1, static_cast<uint8_t>(storage[offsets[count]]));
+      if(!child)
+        return;
+      path.push_back(child);
     }
 
-    SuffixMatchTree smn(*labels.rbegin());
-    auto child = children.find(smn);
-    if(child == children.end()) {
-      if(endNode)
-        return &d_value;
-      return 0;
+    const SuffixMatchTree* node = path.back();
+    node->endNode = false;
+    node->d_value = T();
+    for(size_t idx = path.size() - 1; idx > 0; idx--) {
+      node = path[idx];
+      if(node->endNode || !node->children.empty())
+        break;
+      auto& siblings = path[idx - 1]->children;
+      siblings.erase(siblings.find(*node));
     }
-    labels.pop_back();
-    return child->lookup(labels);
   }
 
+private:
+  /* stores the offset of each label length byte, returns the number of labels (not counting the root) */
+  static unsigned int getLabelOffsets(const DNSName& name, uint8_t* offsets)
+  {
+    const auto& storage = name.getStorage();
+    const unsigned char* start = reinterpret_cast<const unsigned char*>(storage.c_str());
+    const unsigned char* end = start + storage.size();
+    unsigned int count = 0;
+    for(const unsigned char* p = start; p < end && *p && count < 128; p += *p + 1)
+      offsets[count++] = p - start;
+    return count;
+  }
+
+  /* a node to search children with; its buffer only grows to the longest label seen by this thread */
+  static const SuffixMatchTree& searchKey(const char* label, size_t len)
+  {
+    static thread_local SuffixMatchTree t_key;
+    t_key.d_name.assign(label, len);
+    for(auto& c : t_key.d_name) {
+      c=dns_tolower(c);
+    }
+    return t_key;
+  }
+
+  const SuffixMatchTree* findChild(const char* label, size_t len) const
+  {
+    auto it = children.find(searchKey(label, len));
+    if(it != children.end())
+      return &*it;
+    return nullptr;
+  }
+
+  const SuffixMatchTree& addChild(const char* label, size_t len) const
+  {
+    auto it = children.find(searchKey(label, len));
+    if(it == children.end())
+      it = children.insert(SuffixMatchTree(std::string(label, len), false)).first;
+    return *it;
+  }
 };
 
 /* Quest in life: serve as a rapid block list. If you add a DNSName to a root SuffixMatchNode,
@@ -336,7 +657,7 @@ struct SuffixMatchNode
     d_tree.add(dnsname, true);
   }
 
-  void add(std::vector<std::string> labels)
+  void add(const std::vector<std::string>& labels)
   {
     d_tree.add(labels, true);
   }
@@ -367,13 +688,7 @@ bool DNSName::operator==(const DNSName& rhs) const
   if(rhs.empty() != empty() || rhs.d_storage.size() != d_storage.size())
     return false;
 
-  auto us = d_storage.cbegin();
-  auto p = rhs.d_storage.cbegin();
-  for(; us != d_storage.cend() && p != rhs.d_storage.cend(); ++us, ++p) { 
-    if(dns_tolower(*p) != dns_tolower(*us))
-      return false;
-  }
-  return true;
+  return dns_iequals_raw(reinterpret_cast<const unsigned char*>(d_storage.c_str()), reinterpret_cast<const unsigned char*>(rhs.d_storage.c_str()), d_storage.size());
 }
 
 extern const DNSName g_rootdnsname, g_wildcarddnsname;
@@ -174,6 +174,16 @@ DNSRecordContent* DNSRecordContent::mastermake(const DNSRecord &dr, PacketReader
   return i->second(dr, pr);
 }
 
+std::shared_ptr<DNSRecordContent> DNSRecordContent::makeshared(const DNSRecord &dr, PacketReader& pr, uint16_t oc)
+{
+  if(dr.d_class == QClass::IN && dr.d_type < s_sharedTypemapSize) {
+    sharedmakerfunc_t* f = getSharedTypemap()[dr.d_type];
+    if(f)
+      return f(dr, pr);
+  }
+
+  return std::shared_ptr<DNSRecordContent>(mastermake(dr, pr, oc));
+}
 
 DNSRecordContent::typemap_t& DNSRecordContent::getTypemap()
 {
@@ -199,6 +209,12 @@ DNSRecordContent::zmakermap_t& DNSRecordContent::getZmakermap()
   return zmakermap;
 }
 
+DNSRecordContent::sharedtypemap_t& DNSRecordContent::getSharedTypemap()
+{
+  static DNSRecordContent::sharedtypemap_t sharedtypemap{};
+  return sharedtypemap;
+}
+
 DNSRecord::DNSRecord(const DNSResourceRecord& rr)
 {
   d_name = rr.qname;
@@ -290,7 +306,7 @@ void MOADNSParser::init(bool query, const char *packet, unsigned int len)
       }
       else {
 //        cerr<<"parsing RR, query is "<<query<<", place is "<<dr.d_place<<", type is "<<dr.d_type<<", class is "<<dr.d_class<<endl;
-        dr.d_content=std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(dr, pr, d_header.opcode));
+        dr.d_content=DNSRecordContent::makeshared(dr, pr, d_header.opcode);
       }
 
       d_answers.push_back(make_pair(dr, pr.d_pos));
@@ -331,13 +347,180 @@ void MOADNSParser::init(bool query, const char *packet, unsigned int len)
 }
 
 
+DNSPacketView::DNSPacketView(const char* packet, size_t length) : d_packet(packet), d_length(length)
+{
+  if(length < sizeof(dnsheader))
+    throw MOADNSException("Packet shorter than minimal header");
+  if(length > std::numeric_limits<uint16_t>::max())
+    throw MOADNSException("Packet of "+std::to_string(length)+" bytes is too large");
+
+  memcpy(&d_header, packet, sizeof(dnsheader));
+  d_header.qdcount=ntohs(d_header.qdcount);
+  d_header.ancount=ntohs(d_header.ancount);
+  d_header.nscount=ntohs(d_header.nscount);
+  d_header.arcount=ntohs(d_header.arcount);
+
+  size_t pos = sizeof(dnsheader);
+  for(uint16_t n = 0; n < d_header.qdcount; ++n) {
+    pos = skipName(pos);
+    if(n == 0) {
+      d_qtype = get16BitInt(pos);
+      d_qclass = get16BitInt(pos + 2);
+    }
+    else if(pos + 4 > d_length)
+      throw MOADNSException("Question "+std::to_string(n)+" runs past the end of the packet");
+    pos += 4;
+  }
+  d_recordsOffset = pos;
+}
+
+uint8_t DNSPacketView::get8BitInt(size_t offset) const
+{
+  if(offset >= d_length)
+    throw MOADNSException("Packet read out of range: "+std::to_string(offset)+" >= "+std::to_string(d_length));
+  return d_packet[offset];
+}
+
+uint16_t DNSPacketView::get16BitInt(size_t offset) const
+{
+  return (get8BitInt(offset) << 8) | get8BitInt(offset + 1);
+}
+
+uint32_t DNSPacketView::get32BitInt(size_t offset) const
+{
+  return (static_cast<uint32_t>(get16BitInt(offset)) << 16) | get16BitInt(offset + 2);
+}
+
+uint16_t DNSPacketView::skipName(size_t offset) const
+{
+  for(;;) {
+    uint8_t labellen = get8BitInt(offset);
+    if(labellen >= 0xc0) {
+      get8BitInt(offset + 1);
+      return offset + 2;
+    }
+    if(labellen & 0xc0)
+      throw MOADNSException("Found an invalid label length in name at offset "+std::to_string(offset));
+    if(!labellen)
+      return offset + 1;
+    offset += labellen + 1;
+  }
+}
+
+DNSName DNSPacketView::getName(uint16_t offset) const
+{
+  try {
+    return DNSName(d_packet, d_length, offset, true, 0, 0, 0, sizeof(dnsheader));
+  }
+  catch(const std::range_error& re) {
+    throw MOADNSException(string("Invalid name in packet: ")+re.what());
+  }
+}
+
+bool DNSPacketView::nameEquals(uint16_t offset, const DNSName& name) const
+{
+  const auto& raw = name.getStorage();
+  size_t rawpos = 0;
+  size_t start = offset; // compression pointers have to go back from here, so we always terminate
+
+  for(;;) {
+    uint8_t labellen = get8BitInt(offset);
+    if(labellen >= 0xc0) {
+      uint16_t target = ((labellen & 0x3f) << 8) | get8BitInt(offset + 1);
+      if(target >= start || target < sizeof(dnsheader))
+        throw MOADNSException("Invalid compression pointer in name at offset "+std::to_string(offset));
+      start = offset = target;
+      continue;
+    }
+    if(labellen & 0xc0)
+      throw MOADNSException("Found an invalid label length in name at offset "+std::to_string(offset));
+    if(offset + labellen >= d_length)
+      throw MOADNSException("Label at offset "+std::to_string(offset)+" runs past the end of the packet");
+    if(rawpos >= raw.size() || static_cast<uint8_t>(raw[rawpos]) != labellen)
+      return false;
+    if(!labellen)
+      return true;
+    for(size_t n = 1; n <= labellen; n++) {
+      if(dns_tolower(raw[rawpos + n]) != dns_tolower(d_packet[offset + n]))
+        return false;
+    }
+    rawpos += labellen + 1;
+    offset += labellen + 1;
+  }
+}
+
+DNSRecord DNSPacketView::makeDNSRecord(const Record& record) const
+{
+  DNSRecord dr;
+  dr.d_name = getName(record);
+  dr.d_type = record.d_type;
+  dr.d_class = record.d_class;
+  dr.d_ttl = record.d_ttl;
+  dr.d_clen = record.d_rdataLength;
+  dr.d_place = record.d_place;
+  return dr;
+}
+
+std::shared_ptr<DNSRecordContent> DNSPacketView::parseContent(const DNSRecord& dr, const Record& record) const
+{
+  try {
+    /* the reader ends with the rdata so a broken record can't take its neighbours with it,
+       and starts at the record header to get the rdata boundaries set */
+    PacketReader pr(reinterpret_cast<const uint8_t*>(d_packet) + sizeof(dnsheader), record.d_rdataOffset + record.d_rdataLength - sizeof(dnsheader));
+    pr.d_pos = record.d_rdataOffset - sizeof(dnsrecordheader) - sizeof(dnsheader);
+    struct dnsrecordheader ah;
+    pr.getDnsrecordheader(ah);
+    return DNSRecordContent::makeshared(dr, pr, d_header.opcode);
+  }
+  catch(const std::out_of_range& oor) {
+    throw MOADNSException("Error parsing record of type "+DNSRecordContent::NumberToType(record.d_type)+" at offset "+std::to_string(record.d_nameOffset)+": "+oor.what());
+  }
+}
+
+std::shared_ptr<DNSRecordContent> DNSPacketView::getContent(const Record& record) const
+{
+  return parseContent(makeDNSRecord(record), record);
+}
+
+DNSRecord DNSPacketView::getDNSRecord(const Record& record) const
+{
+  DNSRecord dr = makeDNSRecord(record);
+  dr.d_content = parseContent(dr, record);
+  return dr;
+}
+
+void DNSPacketView::const_iterator::parse()
+{
+  const dnsheader& dh = d_view->d_header;
+  if(d_index >= d_view->getRecordsCount())
+    return;
+
+  if(d_index < dh.ancount)
+    d_record.d_place = DNSResourceRecord::ANSWER;
+  else if(d_index < static_cast<size_t>(dh.ancount + dh.nscount))
+    d_record.d_place = DNSResourceRecord::AUTHORITY;
+  else
+    d_record.d_place = DNSResourceRecord::ADDITIONAL;
+
+  d_record.d_nameOffset = d_offset;
+  size_t pos = d_view->skipName(d_offset);
+  d_record.d_type = d_view->get16BitInt(pos);
+  d_record.d_class = d_view->get16BitInt(pos + 2);
+  d_record.d_ttl = d_view->get32BitInt(pos + 4);
+  d_record.d_rdataLength = d_view->get16BitInt(pos + 8);
+  d_record.d_rdataOffset = pos + sizeof(dnsrecordheader);
+  if(d_record.d_rdataOffset + d_record.d_rdataLength > d_view->d_length)
+    throw MOADNSException("Record "+std::to_string(d_index)+" has rdata running past the end of the packet");
+  d_offset = d_record.d_rdataOffset + d_record.d_rdataLength;
+}
+
 void PacketReader::getDnsrecordheader(struct dnsrecordheader &ah)
 {
   unsigned int n;
   unsigned char *p=reinterpret_cast<unsigned char*>(&ah);
   
   for(n=0; n < sizeof(dnsrecordheader); ++n) 
-    p[n]=d_content.at(d_pos++);
+    p[n]=at(d_pos++);
   
   ah.d_type=ntohs(ah.d_type);
   ah.d_class=ntohs(ah.d_class);
@@ -356,45 +539,45 @@ void PacketReader::copyRecord(vector<unsigned char>& dest, uint16_t len)
     return;
 
   for(uint16_t n=0;n<len;++n) {
-    dest.at(n)=d_content.at(d_pos++);
+    dest.at(n)=at(d_pos++);
   }
 }
 
 void PacketReader::copyRecord(unsigned char* dest, uint16_t len)
 {
-  if(d_pos + len > d_content.size())
+  if(d_pos + len > d_length)
     throw std::out_of_range("Attempt to copy outside of packet");
 
-  memcpy(dest, &d_content.at(d_pos), len);
+  memcpy(dest, &at(d_pos), len);
   d_pos+=len;
 }
 
 void PacketReader::xfr48BitInt(uint64_t& ret)
 {
   ret=0;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
 }
 
 uint32_t PacketReader::get32BitInt()
 {
   uint32_t ret=0;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   ret<<=8;
-  ret+=d_content.at(d_pos++);
+  ret+=at(d_pos++);
   
   return ret;
 }
@@ -402,7 +585,12 @@ uint32_t PacketReader::get32BitInt()
 
 uint16_t PacketReader::get16BitInt()
 {
-  return get16BitInt(d_content, d_pos);
+  uint16_t ret=0;
+  ret+=at(d_pos++);
+  ret<<=8;
+  ret+=at(d_pos++);
+
+  return ret;
 }
 
 uint16_t PacketReader::get16BitInt(const vector<unsigned char>&content, uint16_t& pos)
@@ -417,14 +605,14 @@ uint16_t PacketReader::get16BitInt(const vector<unsigned char>&content, uint16_t
 
 uint8_t PacketReader::get8BitInt()
 {
-  return d_content.at(d_pos++);
+  return at(d_pos++);
 }
 
 DNSName PacketReader::getName()
 {
   unsigned int consumed;
   try {
-    DNSName dn((const char*) d_content.data() - 12, d_content.size() + 12, d_pos + sizeof(dnsheader), true /* uncompress */, 0 /* qtype */, 0 /* qclass */, &consumed, sizeof(dnsheader));
+    DNSName dn((const char*) d_content - 12, d_length + 12, d_pos + sizeof(dnsheader), true /* uncompress */, 0 /* qtype */, 0 /* qclass */, &consumed, sizeof(dnsheader));
     
     // the -12 fakery is because we don't have the header in 'd_content', but we do need to get 
     // the internal offsets to work
@@ -474,13 +662,13 @@ string PacketReader::getText(bool multi, bool lenField)
     }
     uint16_t labellen;
     if(lenField)
-      labellen=d_content.at(d_pos++);
+      labellen=at(d_pos++);
     else
       labellen=d_recordlen - (d_pos - d_startrecordpos);
     
     ret.append(1,'"');
     if(labellen) { // no need to do anything for an empty string
-      string val(&d_content.at(d_pos), &d_content.at(d_pos+labellen-1)+1);
+      string val(&at(d_pos), &at(d_pos+labellen-1)+1);
       ret.append(txtEscape(val)); // the end is one beyond the packet
     }
     ret.append(1,'"');
@@ -496,7 +684,7 @@ string PacketReader::getUnquotedText(bool lenField)
 {
   int16_t stop_at;
   if(lenField)
-    stop_at = (uint8_t)d_content.at(d_pos) + d_pos + 1;
+    stop_at = (uint8_t)at(d_pos) + d_pos + 1;
   else
     stop_at = d_recordlen;
 
@@ -504,7 +692,7 @@ string PacketReader::getUnquotedText(bool lenField)
     return "";
 
   d_pos++;
-  string ret(&d_content.at(d_pos), &d_content.at(stop_at));
+  string ret(&at(d_pos), &at(stop_at));
   d_pos = stop_at;
   return ret;
 }
@@ -513,7 +701,7 @@ void PacketReader::xfrBlob(string& blob)
 try
 {
   if(d_recordlen && !(d_pos == (d_startrecordpos + d_recordlen)))
-    blob.assign(&d_content.at(d_pos), &d_content.at(d_startrecordpos + d_recordlen - 1 ) + 1);
+    blob.assign(&at(d_pos), &at(d_startrecordpos + d_recordlen - 1 ) + 1);
   else
     blob.clear();
 
@@ -531,7 +719,7 @@ void PacketReader::xfrBlobNoSpaces(string& blob, int length) {
 void PacketReader::xfrBlob(string& blob, int length)
 {
   if(length) {
-    blob.assign(&d_content.at(d_pos), &d_content.at(d_pos + length - 1 ) + 1 );
+    blob.assign(&at(d_pos), &at(d_pos + length - 1 ) + 1 );
     
     d_pos += length;
   }
@@ -775,35 +963,15 @@ void ageDNSPacket(std::string& packet, uint32_t seconds)
 uint32_t getDNSPacketMinTTL(const char* packet, size_t length)
 {
   uint32_t result = std::numeric_limits<uint32_t>::max();
-  if(length < sizeof(dnsheader)) {
-    return result;
-  }
   try
   {
-    const dnsheader* dh = (const dnsheader*) packet;
-    DNSPacketMangler dpm(const_cast<char*>(packet), length);
-
-    const uint16_t qdcount = ntohs(dh->qdcount);
-    for(size_t n = 0; n < qdcount; ++n) {
-      dpm.skipLabel();
-      /* type and class */
-      dpm.skipBytes(4);
-    }
-    const size_t numrecords = ntohs(dh->ancount) + ntohs(dh->nscount) + ntohs(dh->arcount);
-    for(size_t n = 0; n < numrecords; ++n) {
-      dpm.skipLabel();
-      const uint16_t dnstype = dpm.get16BitInt();
-      /* class */
-      dpm.skipBytes(2);
-
-      if(dnstype == QType::OPT)
+    DNSPacketView view(packet, length);
+    for(const auto& record : view) {
+      if(record.d_type == QType::OPT)
         break;
 
-      const uint32_t ttl = dpm.get32BitInt();
-      if (result > ttl)
-        result = ttl;
-
-      dpm.skipRData();
+      if (result > record.d_ttl)
+        result = record.d_ttl;
     }
   }
   catch(...)
@@ -815,28 +983,14 @@ uint32_t getDNSPacketMinTTL(const char* packet, size_t length)
 uint32_t getDNSPacketLength(const char* packet, size_t length)
 {
   uint32_t result = length;
-  if(length < sizeof(dnsheader)) {
-    return result;
-  }
   try
   {
-    const dnsheader* dh = (const dnsheader*) packet;
-    DNSPacketMangler dpm(const_cast<char*>(packet), length);
-
-    const uint16_t qdcount = ntohs(dh->qdcount);
-    for(size_t n = 0; n < qdcount; ++n) {
-      dpm.skipLabel();
-      /* type and class */
-      dpm.skipBytes(4);
-    }
-    const size_t numrecords = ntohs(dh->ancount) + ntohs(dh->nscount) + ntohs(dh->arcount);
-    for(size_t n = 0; n < numrecords; ++n) {
-      dpm.skipLabel();
-      /* type (2), class (2) and ttl (4) */
-      dpm.skipBytes(8);
-      dpm.skipRData();
+    DNSPacketView view(packet, length);
+    uint32_t end = view.getRecordsOffset();
+    for(const auto& record : view) {
+      end = record.d_rdataOffset + record.d_rdataLength;
     }
-    result = dpm.getOffset();
+    result = end;
   }
   catch(...)
   {
@@ -22,11 +22,13 @@
 #ifndef DNSPARSER_HH
 #define DNSPARSER_HH
 
+#include <array>
 #include <map>
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
 #include <vector>
+#include <iterator>
 #include <errno.h>
 // #include <netinet/in.h>
 #include "misc.hh"
@@ -68,12 +70,18 @@ class PacketReader
 {
 public:
   PacketReader(const vector<uint8_t>& content) 
-    : d_pos(0), d_startrecordpos(0), d_content(content)
+    : PacketReader(content.data(), content.size())
   {
-    if(content.size() > std::numeric_limits<uint16_t>::max())
+  }
+
+  //! content is the packet without its header, it is not copied and must outlive us
+  PacketReader(const uint8_t* content, size_t length)
+    : d_pos(0), d_startrecordpos(0), d_content(content), d_length(length)
+  {
+    if(length > std::numeric_limits<uint16_t>::max())
       throw std::out_of_range("packet too large");
 
-    d_recordlen = (uint16_t) content.size();
+    d_recordlen = (uint16_t) length;
     not_used = 0;
   }
 
@@ -98,6 +106,10 @@ public:
     xfrBlob(val, 16);
   }
 
+  void xfrIP6(uint8_t (&val)[16]) {
+    copyRecord(val, sizeof(val));
+  }
+
   void xfrTime(uint32_t& val)
   {
     xfr32BitInt(val);
@@ -155,10 +167,18 @@ public:
   bool eof() { return true; };
 
 private:
+  const uint8_t& at(size_t pos) const
+  {
+    if(pos >= d_length)
+      throw std::out_of_range("packet read out of range: "+std::to_string(pos)+" >= "+std::to_string(d_length));
+    return d_content[pos];
+  }
+
   uint16_t d_startrecordpos; // needed for getBlob later on
   uint16_t d_recordlen;      // ditto
   uint16_t not_used; // Aligns the whole class on 8-byte boundries
-  const vector<uint8_t>& d_content;
+  const uint8_t* d_content;
+  size_t d_length;
 };
 
 struct DNSRecord;
@@ -170,6 +190,7 @@ public:
   static DNSRecordContent* mastermake(const DNSRecord &dr, PacketReader& pr, uint16_t opcode);
   static DNSRecordContent* mastermake(uint16_t qtype, uint16_t qclass, const string& zone);
   static std::unique_ptr<DNSRecordContent> makeunique(uint16_t qtype, uint16_t qclass, const string& content);
+  static std::shared_ptr<DNSRecordContent> makeshared(const DNSRecord &dr, PacketReader& pr, uint16_t opcode);
 
   virtual std::string getZoneRepresentation(bool noDot=false) const = 0;
   virtual ~DNSRecordContent() {}
@@ -203,6 +224,7 @@ public:
 
   typedef DNSRecordContent* makerfunc_t(const struct DNSRecord& dr, PacketReader& pr);  
   typedef DNSRecordContent* zmakerfunc_t(const string& str);  
+  typedef std::shared_ptr<DNSRecordContent> sharedmakerfunc_t(const struct DNSRecord& dr, PacketReader& pr);
 
   static void regist(uint16_t cl, uint16_t ty, makerfunc_t* f, zmakerfunc_t* z, const char* name)
   {
@@ -215,11 +237,21 @@ public:
     getN2Typemap().insert(make_pair(name, make_pair(cl,ty)));
   }
 
+  /* for the handful of types that make up most of the traffic: constructed without looking up the typemap,
+     and in a single allocation together with the shared_ptr control block. Class IN only. */
+  static void registShared(uint16_t ty, sharedmakerfunc_t* f)
+  {
+    if(ty < s_sharedTypemapSize)
+      getSharedTypemap()[ty]=f;
+  }
+
   static void unregist(uint16_t cl, uint16_t ty) 
   {
     pair<uint16_t, uint16_t> key=make_pair(cl, ty);
     getTypemap().erase(key);
     getZmakermap().erase(key);
+    if(cl == QClass::IN && ty < s_sharedTypemapSize)
+      getSharedTypemap()[ty]=nullptr;
   }
 
   static uint16_t TypeToNumber(const string& name)
@@ -254,6 +286,10 @@ protected:
   static t2namemap_t& getT2Namemap();
   static n2typemap_t& getN2Typemap();
   static zmakermap_t& getZmakermap();
+
+  static const size_t s_sharedTypemapSize = 256;
+  typedef std::array<sharedmakerfunc_t*, s_sharedTypemapSize> sharedtypemap_t;
+  static sharedtypemap_t& getSharedTypemap();
 };
 
 struct DNSRecord
@@ -382,6 +418,156 @@ private:
   uint16_t d_tsigPos;
 };
 
+/** Non-owning view of a DNS packet, for the hot paths that only need a few fields of it.
+    Nothing is copied or allocated up front: the constructor checks the header and skips over
+    the question, iterating the records only decodes their fixed headers and remembers where
+    owner name and rdata live. Names and DNSRecordContent are built when asked for.
+
+    Every read is bounds checked and malformed packets throw MOADNSException, either from the
+    constructor or while iterating. The packet must outlive the view and its iterators. */
+class DNSPacketView
+{
+public:
+  struct Record
+  {
+    uint16_t d_nameOffset;  //!< offset of the owner name in the packet
+    uint16_t d_rdataOffset; //!< offset of the rdata in the packet, the TTL is 6 bytes before it
+    uint16_t d_rdataLength;
+    uint16_t d_type;
+    uint16_t d_class;
+    uint32_t d_ttl;
+    DNSResourceRecord::Place d_place;
+  };
+
+  class const_iterator : public std::iterator<std::forward_iterator_tag, const Record>
+  {
+  public:
+    const_iterator(const DNSPacketView& view, uint16_t offset, size_t index) : d_view(&view), d_offset(offset), d_index(index)
+    {
+      parse();
+    }
+
+    const Record& operator*() const
+    {
+      return d_record;
+    }
+    const Record* operator->() const
+    {
+      return &d_record;
+    }
+    const_iterator& operator++()
+    {
+      ++d_index;
+      parse();
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator ret = *this;
+      ++(*this);
+      return ret;
+    }
+    bool operator==(const const_iterator& rhs) const
+    {
+      return d_index == rhs.d_index;
+    }
+    bool operator!=(const const_iterator& rhs) const
+    {
+      return d_index != rhs.d_index;
+    }
+  private:
+    void parse();
+
+    const DNSPacketView* d_view;
+    Record d_record;
+    uint16_t d_offset; //!< where the next record starts
+    size_t d_index;
+  };
+
+  DNSPacketView(const char* packet, size_t length);
+  explicit DNSPacketView(const std::string& packet) : DNSPacketView(packet.c_str(), packet.size())
+  {
+  }
+
+  //! the header, with the counts in host byte order
+  const dnsheader& getHeader() const
+  {
+    return d_header;
+  }
+  //! the record count of all sections but the question
+  size_t getRecordsCount() const
+  {
+    return d_header.ancount + d_header.nscount + d_header.arcount;
+  }
+
+  bool hasQuestion() const
+  {
+    return d_header.qdcount > 0;
+  }
+  //! offset of the first question name, only valid if hasQuestion()
+  uint16_t getQNameOffset() const
+  {
+    return sizeof(dnsheader);
+  }
+  DNSName getQName() const
+  {
+    return hasQuestion() ? getName(getQNameOffset()) : DNSName();
+  }
+  uint16_t getQType() const
+  {
+    return d_qtype;
+  }
+  uint16_t getQClass() const
+  {
+    return d_qclass;
+  }
+
+  //! offset of the first record, right after the question section
+  uint16_t getRecordsOffset() const
+  {
+    return d_recordsOffset;
+  }
+
+  const_iterator begin() const
+  {
+    return const_iterator(*this, d_recordsOffset, 0);
+  }
+  const_iterator end() const
+  {
+    return const_iterator(*this, d_recordsOffset, getRecordsCount());
+  }
+
+  //! decompress the name at offset
+  DNSName getName(uint16_t offset) const;
+  //! compare the (possibly compressed) name at offset to name, case insensitively and without allocating
+  bool nameEquals(uint16_t offset, const DNSName& name) const;
+
+  DNSName getName(const Record& record) const
+  {
+    return getName(record.d_nameOffset);
+  }
+  //! parse the rdata of record
+  std::shared_ptr<DNSRecordContent> getContent(const Record& record) const;
+  //! name and content of record, like MOADNSParser would have produced them
+  DNSRecord getDNSRecord(const Record& record) const;
+
+private:
+  uint8_t get8BitInt(size_t offset) const;
+  uint16_t get16BitInt(size_t offset) const;
+  uint32_t get32BitInt(size_t offset) const;
+  //! returns the offset right after the name starting at offset
+  uint16_t skipName(size_t offset) const;
+  DNSRecord makeDNSRecord(const Record& record) const;
+  std::shared_ptr<DNSRecordContent> parseContent(const DNSRecord& dr, const Record& record) const;
+
+  const char* d_packet;
+  size_t d_length;
+  dnsheader d_header;
+  uint16_t d_qtype{0};
+  uint16_t d_qclass{0};
+  uint16_t d_recordsOffset;
+};
+
 string simpleCompress(const string& label, const string& root="");
 void ageDNSPacket(char* packet, size_t length, uint32_t seconds);
 void ageDNSPacket(std::string& packet, uint32_t seconds);
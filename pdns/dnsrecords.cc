@@ -89,7 +89,7 @@ ARecordContent::ARecordContent(const ComboAddress& ca)
 
 AAAARecordContent::AAAARecordContent(const ComboAddress& ca) 
 {
-  d_ip6.assign((const char*)ca.sin6.sin6_addr.s6_addr, 16);
+  memcpy(d_ip6, ca.sin6.sin6_addr.s6_addr, sizeof(d_ip6));
 }
 
 
@@ -109,7 +109,7 @@ ComboAddress AAAARecordContent::getCA(int port) const
 
   ret.sin4.sin_family=AF_INET6;
   ret.sin6.sin6_port = htons(port);
-  memcpy(&ret.sin6.sin6_addr.s6_addr, d_ip6.c_str(), sizeof(ret.sin6.sin6_addr.s6_addr));
+  memcpy(&ret.sin6.sin6_addr.s6_addr, d_ip6, sizeof(ret.sin6.sin6_addr.s6_addr));
   return ret;
 }
 
@@ -566,6 +566,11 @@ void reportBasicTypes()
   DNSRecordContent::regist(QClass::IN, QType::ANY, 0, 0, "ANY");
   DNSRecordContent::regist(QClass::IN, QType::AXFR, 0, 0, "AXFR");
   DNSRecordContent::regist(QClass::IN, QType::IXFR, 0, 0, "IXFR");
+
+  DNSRecordContent::registShared(QType::A, &makeSharedRecordContent<ARecordContent>);
+  DNSRecordContent::registShared(QType::AAAA, &makeSharedRecordContent<AAAARecordContent>);
+  DNSRecordContent::registShared(QType::NS, &makeSharedRecordContent<NSRecordContent>);
+  DNSRecordContent::registShared(QType::CNAME, &makeSharedRecordContent<CNAMERecordContent>);
 }
 
 void reportOtherTypes()
@@ -54,7 +54,7 @@ private:
 };
 
 
-class ARecordContent : public DNSRecordContent
+class ARecordContent final : public DNSRecordContent
 {
 public:
   explicit ARecordContent(const ComboAddress& ca);
@@ -72,10 +72,9 @@ private:
   uint32_t d_ip;
 };
 
-class AAAARecordContent : public DNSRecordContent
+class AAAARecordContent final : public DNSRecordContent
 {
 public:
-  AAAARecordContent(std::string &val);
   explicit AAAARecordContent(const ComboAddress& ca);
   includeboilerplate(AAAA);
   ComboAddress getCA(int port=0) const;
@@ -83,10 +82,10 @@ public:
   {
     if(typeid(*this) != typeid(rhs))
       return false;
-    return d_ip6 == dynamic_cast<const decltype(this)>(&rhs)->d_ip6;
+    return memcmp(d_ip6, dynamic_cast<const decltype(this)>(&rhs)->d_ip6, sizeof(d_ip6)) == 0;
   }
 private:
-  string d_ip6; // why??
+  uint8_t d_ip6[16];
 };
 
 class MXRecordContent : public DNSRecordContent
@@ -201,7 +200,7 @@ private:
 };
 
 
-class NSRecordContent : public DNSRecordContent
+class NSRecordContent final : public DNSRecordContent
 {
 public:
   includeboilerplate(NS)
@@ -228,7 +227,7 @@ private:
   DNSName d_content;
 };
 
-class CNAMERecordContent : public DNSRecordContent
+class CNAMERecordContent final : public DNSRecordContent
 {
 public:
   includeboilerplate(CNAME)
@@ -749,6 +748,13 @@ struct EDNSOpts
 };
 //! Convenience function that fills out EDNS0 options, and returns true if there are any
 
+//! For DNSRecordContent::registShared(), the type is known at compile time so this is a direct constructor call
+template<class RecordContent>
+std::shared_ptr<DNSRecordContent> makeSharedRecordContent(const DNSRecord& dr, PacketReader& pr)
+{
+  return std::make_shared<RecordContent>(dr, pr);
+}
+
 class MOADNSParser;
 bool getEDNSOpts(const MOADNSParser& mdp, EDNSOpts* eo);
 DNSRecord makeOpt(int udpsize, int extRCode, int Z);
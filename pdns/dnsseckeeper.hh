@@ -23,6 +23,9 @@
 #include <string>
 #include <string.h>
 #include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
 #include <boost/logic/tribool.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -65,6 +68,24 @@ public:
   typedef std::pair<DNSSECPrivateKey, KeyMetaData> keymeta_t;
   typedef std::vector<keymeta_t > keyset_t;
 
+  /** What answering queries for a zone needs from the key and metadata
+      store, read in one go. A profile never changes once it is built,
+      changes to the keys or metadata of a zone replace it instead. */
+  struct ZoneProfile
+  {
+    DNSName zone;
+    keyset_t keys; //!< as returned by getKeys()
+    std::map<std::string, std::string, CIStringCompare> meta; //!< first value of each metadata kind
+    bool allMeta{false}; //!< meta holds every kind set for the zone, not just the common ones
+    bool presigned{false};
+    bool secured{false};
+    bool nsec3{false};
+    NSEC3PARAMRecordContent ns3p;
+    bool narrow{false};
+    time_t ttd{0};
+  };
+  typedef std::shared_ptr<const ZoneProfile> zoneprofile_t;
+
   static string keyTypeToString(const keytype_t &keyType)
   {
     switch(keyType) {
@@ -141,6 +162,10 @@ private:
   UeberBackend* d_keymetadb;
   bool d_ourDB;
 
+  // the profile used last by this keeper, valid while s_profilegeneration is unchanged
+  zoneprofile_t d_lastProfile;
+  uint64_t d_lastProfileGeneration{0};
+
 public:
   DNSSECKeeper() : d_keymetadb( new UeberBackend("key-only")), d_ourDB(true)
   {
@@ -197,7 +222,11 @@ public:
   
   void getFromMeta(const DNSName& zname, const std::string& key, std::string& value);
   void getSoaEdit(const DNSName& zname, std::string& value);
+  //! returns nullptr when the key or metadata cache is disabled
+  zoneprofile_t getProfile(const DNSName& zone);
 private:
+  zoneprofile_t buildProfile(const DNSName& zone, time_t ttd);
+  keyset_t loadKeys(const DNSName& zone, bool nsec3);
 
 
   struct KeyCacheEntry
@@ -248,12 +277,17 @@ private:
     >
   > metacache_t;
 
+  typedef std::unordered_map<DNSName, zoneprofile_t> profilecache_t;
+
   void cleanup();
 
   static keycache_t s_keycache;
   static metacache_t s_metacache;
+  static profilecache_t s_profilecache;
   static pthread_rwlock_t s_metacachelock;
   static pthread_rwlock_t s_keycachelock;
+  static pthread_rwlock_t s_profilecachelock;
+  static std::atomic<uint64_t> s_profilegeneration; //!< bumped whenever cached profiles are dropped
   static AtomicCounter s_ops;
   static time_t s_last_prune;
 };
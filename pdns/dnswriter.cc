@@ -22,10 +22,6 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
-#include <boost/version.hpp>
-#if BOOST_VERSION >= 105400
-#include <boost/container/static_vector.hpp>
-#endif
 #include "dnswriter.hh"
 #include "misc.hh"
 #include "dnsparser.hh"
@@ -58,7 +54,6 @@ DNSPacketWriter::DNSPacketWriter(vector<uint8_t>& content, const DNSName& qname,
   uint8_t* dptr=(&*d_content.begin()) + len;
 
   memcpy(dptr, ptr, sizeof(dnsheader));
-  d_namepositions.reserve(16);
   xfrName(qname, false);
   xfr16BitInt(qtype);
   xfr16BitInt(qclass);
@@ -189,116 +184,129 @@ void DNSPacketWriter::xfrUnquotedText(const string& text, bool lenField)
 
 
 static constexpr bool l_verbose=false;
-uint16_t DNSPacketWriter::lookupName(const DNSName& name, uint16_t* matchLen)
-{
-  // iterate over the written labels, see if we find a match
-  const auto& raw = name.getStorage();
 
-  /* name might be a.root-servers.net, we need to be able to benefit from finding:
-     b.root-servers.net, or even:
-     b\xc0\x0c 
-  */
-  unsigned int bestpos=0;
-  *matchLen=0;
-#if BOOST_VERSION >= 105400
-  boost::container::static_vector<uint16_t, 34> nvect, pvect;
-#else
-  vector<uint16_t> nvect, pvect;
-#endif
+/* Every label suffix of every name we write is stored in d_namesuffixes, with the position
+   in the packet it starts at. So for www.powerdns.com written at 12, we know where to find
+   www.powerdns.com, powerdns.com and com. Lookups hash the suffixes of the new name, longest
+   first, and verify candidates against the packet, so a hash collision only costs compression. */
 
-  try {
-    for(auto riter= raw.cbegin(); riter < raw.cend(); ) {
-      if(!*riter)
-        break;
-      nvect.push_back(riter - raw.cbegin());
-      riter+=*riter+1;
+static uint32_t hashNameSuffix(const char* raw, size_t len)
+{
+  return burtleCI((const unsigned char*)raw, len, 0);
+}
+
+void DNSPacketWriter::addNameSuffix(uint32_t hash, uint16_t pos)
+{
+  if(2 * (d_namesuffixesUsed + 1) > d_namesuffixes.size()) {
+    vector<NameSuffix> old(std::max(static_cast<size_t>(32), 2 * d_namesuffixes.size()), NameSuffix{0, 0});
+    old.swap(d_namesuffixes);
+    d_namesuffixesUsed = 0;
+    for(const auto& entry : old) {
+      if(entry.pos)
+        addNameSuffix(entry.hash, entry.pos);
     }
   }
-  catch(std::bad_alloc& ba) {
-    if(l_verbose)
-      cout<<"Domain "<<name<<" too large to compress"<<endl;
-    return 0;
+
+  const size_t mask = d_namesuffixes.size() - 1;
+  for(size_t idx = hash & mask; ; idx = (idx + 1) & mask) {
+    NameSuffix& entry = d_namesuffixes[idx];
+    if(!entry.pos) {
+      entry.hash = hash;
+      entry.pos = pos;
+      d_namesuffixesUsed++;
+      return;
+    }
+    if(entry.hash == hash) // keep the first occurrence
+      return;
   }
-  
-  if(l_verbose) {
-    cout<<"Input vector for lookup "<<name<<": ";
-    for(const auto n : nvect) 
-      cout << n<<" ";
-    cout<<endl;
-    cout<<makeHexDump(string(raw.c_str(), raw.c_str()+raw.size()))<<endl;
+}
+
+// raw is 'written' bytes of the name that were written uncompressed at pos, followed by a pointer if it does not end in the root
+void DNSPacketWriter::addNameSuffixes(const DNSName::string_t& raw, size_t pos, size_t written)
+{
+  for(size_t off = 0; off < written && raw[off]; off += (uint8_t)raw[off] + 1) {
+    if(pos + off >= 16384) // can't point there
+      break;
+    addNameSuffix(hashNameSuffix(raw.c_str() + off, raw.size() - off), pos + off);
   }
+}
 
-  if(l_verbose)
-    cout<<"Have "<<d_namepositions.size()<<" to ponder"<<endl;
-  int counter=1;
-  for(auto p : d_namepositions) {
-    if(l_verbose) {
-      cout<<"Pos: "<<p<<", "<<d_content.size()<<endl;
-      DNSName pname((const char*)&d_content[0], d_content.size(), p, true); // only for debugging
-      cout<<"Looking at '"<<pname<<"' in packet at position "<<p<<"/"<<d_content.size()<<", option "<<counter<<"/"<<d_namepositions.size()<<endl;
-      ++counter;
-    }
-    // memcmp here makes things _slower_
-    pvect.clear();
-    try {
-      for(auto iter = d_content.cbegin() + p; iter < d_content.cend();) {
-        uint8_t c=*iter;
-        if(l_verbose)
-          cout<<"Found label length: "<<(int)c<<endl;
-        if(c & 0xc0) {
-          uint16_t npos = 0x100*(c & (~0xc0)) + *++iter;
-          iter = d_content.begin() + npos;
-          if(l_verbose)
-            cout<<"Is compressed label to newpos "<<npos<<", going there"<<endl;
-          // check against going forward here
-          continue;
-        }
-        if(!c)
-          break;
-        pvect.push_back(iter - d_content.cbegin());
-        iter+=*iter+1;
-      }
-    }
-    catch(std::bad_alloc& ba) {
-      if(l_verbose)
-        cout<<"Domain "<<name<<" too large to compress"<<endl;
+// check that the (possibly compressed) name at pos in our packet equals raw
+bool DNSPacketWriter::nameMatchesAt(uint16_t pos, const char* raw, size_t len) const
+{
+  const size_t size = d_content.size();
+  const char* end = raw + len;
+  for(unsigned int steps = 0; steps < 256; steps++) {
+    if(pos >= size)
+      return false;
+    uint8_t c = d_content[pos];
+    if((c & 0xc0) == 0xc0) {
+      if(pos + 1 >= size)
+        return false;
+      uint16_t npos = ((c & 0x3f) << 8) | d_content[pos + 1];
+      if(npos >= pos) // only backward references
+        return false;
+      pos = npos;
       continue;
     }
-    if(l_verbose) {
-      cout<<"Packet vector: "<<endl;
-      for(const auto n : pvect) 
-        cout << n<<" ";
-      cout<<endl;
+    if(pos + c + 1 > size)
+      return false;
+    if(raw >= end || (uint8_t)*raw != c)
+      return false;
+    for(unsigned int n = 1; n <= c; n++) {
+      if(dns_tolower(raw[n]) != dns_tolower(d_content[pos + n]))
+        return false;
     }
-    auto niter=nvect.crbegin(), piter=pvect.crbegin();
-    unsigned int cmatchlen=1;
-    for(; niter != nvect.crend() && piter != pvect.crend(); ++niter, ++piter) {
-      // niter is an offset in raw, pvect an offset in packet
-      uint8_t nlen = raw[*niter], plen=d_content[*piter];
-      if(l_verbose)
-        cout<<"nlnen="<<(int)nlen<<", plen="<<(int)plen<<endl;
-      if(nlen != plen)
-        break;
-      if(strncasecmp(raw.c_str()+*niter+1, (const char*)&d_content[*piter]+1, nlen)) {
-        if(l_verbose)
-          cout<<"Mismatch: "<<string(raw.c_str()+*niter+1, raw.c_str()+*niter+nlen+1)<< " != "<<string((const char*)&d_content[*piter]+1, (const char*)&d_content[*piter]+nlen+1)<<endl;
-        break;
-      }
-      cmatchlen+=nlen+1;
-      if(cmatchlen == raw.length()) { // have matched all of it, can't improve
+    raw += c + 1;
+    if(!c)
+      return true;
+    pos += c + 1;
+  }
+  return false;
+}
+
+// drop the names we just lost to a rollback or truncate
+void DNSPacketWriter::pruneNameSuffixes()
+{
+  vector<NameSuffix> old;
+  old.swap(d_namesuffixes);
+  d_namesuffixesUsed = 0;
+  for(const auto& entry : old) {
+    if(entry.pos && entry.pos < d_content.size())
+      addNameSuffix(entry.hash, entry.pos);
+  }
+}
+
+uint16_t DNSPacketWriter::lookupName(const DNSName& name, uint16_t* matchLen)
+{
+  const auto& raw = name.getStorage();
+  *matchLen=0;
+
+  if(d_namesuffixes.empty())
+    return 0;
+
+  const size_t mask = d_namesuffixes.size() - 1;
+  /* name might be a.root-servers.net, we need to be able to benefit from finding:
+     b.root-servers.net, or even:
+     b\xc0\x0c 
+     we try the longest suffix first */
+  for(size_t off = 0; off < raw.size() && raw[off]; off += (uint8_t)raw[off] + 1) {
+    const char* suffix = raw.c_str() + off;
+    const size_t len = raw.size() - off;
+    const uint32_t hash = hashNameSuffix(suffix, len);
+    for(size_t idx = hash & mask; d_namesuffixes[idx].pos; idx = (idx + 1) & mask) {
+      const NameSuffix& entry = d_namesuffixes[idx];
+      if(entry.hash == hash && nameMatchesAt(entry.pos, suffix, len)) {
         if(l_verbose)
-          cout<<"Stopping search, matched whole name"<<endl;
-        *matchLen = cmatchlen;
-        return *piter;
+          cout<<"Found a match for the last "<<len<<" bytes of "<<name<<" at position "<<entry.pos<<endl;
+        *matchLen = len;
+        return entry.pos;
       }
     }
-    if(piter != pvect.crbegin() && *matchLen < cmatchlen) {
-      *matchLen = cmatchlen;
-      bestpos=*--piter;
-    }
   }
-  return bestpos;
+  return 0;
 }
+
 // this is the absolute hottest function in the pdns recursor
 void DNSPacketWriter::xfrName(const DNSName& name, bool compress, bool)
 {
@@ -321,10 +329,10 @@ void DNSPacketWriter::xfrName(const DNSName& name, bool compress, bool)
     // found a substring, if www.powerdns.com matched powerdns.com, we get back matchlen = 13
 
     unsigned int pos=d_content.size();
-    if(pos < 16384 && matchlen != dns.size()) {
+    if(matchlen != dns.size()) {
       if(l_verbose)
         cout<<"Inserting pos "<<pos<<" for "<<name<<" for compressed case"<<endl;
-      d_namepositions.push_back(pos);
+      addNameSuffixes(dns, pos, dns.size() - matchlen);
     }
 
     if(l_verbose)
@@ -340,17 +348,13 @@ void DNSPacketWriter::xfrName(const DNSName& name, bool compress, bool)
     unsigned int pos=d_content.size();
     if(l_verbose)
       cout<<"Found nothing, we are at pos "<<pos<<", inserting whole name"<<endl;
-    if(pos < 16384) {
-      if(l_verbose)
-        cout<<"Inserting pos "<<pos<<" for "<<name<<" for uncompressed case"<<endl;
-      d_namepositions.push_back(pos);
-    }
 
     std::unique_ptr<DNSName> lc;
     if(d_lowerCase)
       lc = make_unique<DNSName>(name.makeLowerCase());
 
     const DNSName::string_t& raw = (lc ? *lc : name).getStorage();
+    addNameSuffixes(raw, pos, raw.size());
     if(l_verbose)
       cout<<"Writing out the whole thing "<<makeHexDump(string(raw.c_str(),  raw.c_str() + raw.length()))<<endl;
     d_content.insert(d_content.end(), raw.c_str(), raw.c_str() + raw.size());
@@ -388,11 +392,13 @@ void DNSPacketWriter::rollback()
 {
   d_content.resize(d_rollbackmarker);
   d_sor = 0;
+  pruneNameSuffixes();
 }
 
 void DNSPacketWriter::truncate()
 {
   d_content.resize(d_truncatemarker);
+  pruneNameSuffixes();
   dnsheader* dh=reinterpret_cast<dnsheader*>( &*d_content.begin());
   dh->ancount = dh->nscount = dh->arcount = 0;
 }
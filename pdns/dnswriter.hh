@@ -100,6 +100,10 @@ public:
   {
     xfrBlob(val,16);
   }
+  void xfrIP6(const uint8_t (&val)[16])
+  {
+    d_content.insert(d_content.end(), val, val + sizeof(val));
+  }
   void xfrTime(const uint32_t& val)
   {
     xfr32BitInt(val);
@@ -134,7 +138,19 @@ public:
 
 private:
   uint16_t lookupName(const DNSName& name, uint16_t* matchlen);
-  vector<uint16_t> d_namepositions;
+  void addNameSuffixes(const DNSName::string_t& raw, size_t pos, size_t written);
+  void addNameSuffix(uint32_t hash, uint16_t pos);
+  bool nameMatchesAt(uint16_t pos, const char* raw, size_t len) const;
+  void pruneNameSuffixes();
+
+  //! Position in the packet of a name (suffix) we can point to, keyed on the hash of its uncompressed form
+  struct NameSuffix
+  {
+    uint32_t hash;
+    uint16_t pos; // 0 means empty
+  };
+  vector<NameSuffix> d_namesuffixes; // open addressing, size is a power of 2
+  size_t d_namesuffixesUsed{0};
   // We declare 1 uint_16 in the public section, these 3 align on a 8-byte boundry
   uint16_t d_sor;
   uint16_t d_rollbackmarker; // start of last complete packet, for rollback
@@ -30,6 +30,8 @@
 #include <stdio.h>
 #include <functional>
 #include <bitset>
+#include <limits>
+#include <algorithm>
 #include "pdnsexception.hh"
 #include "misc.hh"
 #include <sys/socket.h>
@@ -474,7 +476,10 @@ private:
  *
  * You can store IPv4 and IPv6 addresses to same tree, separate payload storage is kept per AFI.
  *
- * To erase something copy values to new tree sans the value you want to erase.
+ * The tree is path-compressed: nodes only exist where a prefix ends or where prefixes diverge,
+ * and they are all kept in one vector, so a lookup only touches a handful of nodes.
+ *
+ * Erasing a prefix removes its value but leaves the node in place, copy the tree to compact it.
  *
  * Use swap if you need to move the tree to another NetmaskTree instance, it is WAY faster
  * than using copy ctor or assignment operator, since it moves the nodes and tree root to
@@ -492,55 +497,117 @@ public:
   typedef size_t size_type;
 
 private:
-  /** Single node in tree, internal use only.
+  /** Path-compressed binary trie node, internal use only. Nodes live in
+      a single vector and refer to their children by index, a node only
+      exists where a prefix ends or where two prefixes diverge.
     */
-  class TreeNode : boost::noncopyable {
-  public:
-     explicit TreeNode(int bits) noexcept : parent(NULL),d_bits(bits) {
-     }
-
-     //<! Makes a left node with one more bit than parent
-     TreeNode* make_left() {
-       if (!left) {
-         left = unique_ptr<TreeNode>(new TreeNode(d_bits+1));
-         left->parent = this;
-       }
-       return left.get();
-     }
-
-     //<! Makes a right node with one more bit than parent
-     TreeNode* make_right() {
-       if (!right) {
-         right = unique_ptr<TreeNode>(new TreeNode(d_bits+1));
-         right->parent = this;
-       }
-       return right.get();
-     }
-
-     unique_ptr<TreeNode> left;
-     unique_ptr<TreeNode> right;
-     TreeNode* parent;
-
-     unique_ptr<node_type> node4; //<! IPv4 value-pair
-     unique_ptr<node_type> node6; //<! IPv6 value-pair
-
-     int d_bits; //<! How many bits have been used so far
+  struct TreeNode {
+    TreeNode(const uint64_t* key, uint8_t bits) : d_bits(bits) {
+      d_key[0] = key[0];
+      d_key[1] = key[1];
+      maskKey(d_key, bits);
+      child[0] = child[1] = npos;
+    }
+
+    uint64_t d_key[2]; //<! Prefix of this node, host byte order, bits past d_bits are zero
+    uint32_t child[2]; //<! Index of the left (0) and right (1) child, or npos
+    unique_ptr<node_type> value; //<! Value-pair stored at this exact prefix, if any
+    uint8_t d_bits; //<! Length of the prefix
   };
 
+  static const uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  //<! IPv4 addresses use the upper 32 bits of d_key[0]
+  static void makeKey(const ComboAddress& addr, uint64_t* key) {
+    if (addr.sin4.sin_family == AF_INET) {
+      key[0] = static_cast<uint64_t>(be32toh(addr.sin4.sin_addr.s_addr)) << 32;
+      key[1] = 0;
+    } else {
+      uint64_t tmp[2];
+      memcpy(tmp, addr.sin6.sin6_addr.s6_addr, sizeof(tmp));
+      key[0] = be64toh(tmp[0]);
+      key[1] = be64toh(tmp[1]);
+    }
+  }
+
+  static void maskKey(uint64_t* key, int bits) {
+    if (bits < 64) {
+      key[0] = bits ? key[0] & ~((~0ULL) >> bits) : 0;
+      key[1] = 0;
+    } else if (bits < 128) {
+      key[1] = bits > 64 ? key[1] & ~((~0ULL) >> (bits - 64)) : 0;
+    }
+  }
+
+  static uint8_t getBit(const uint64_t* key, int bit) {
+    if (bit < 64)
+      return (key[0] >> (63 - bit)) & 1;
+    return (key[1] >> (127 - bit)) & 1;
+  }
+
+  //<! Number of leading bits a and b have in common, at most max_bits
+  static int commonBits(const uint64_t* a, const uint64_t* b, int max_bits) {
+    int common;
+    uint64_t diff = a[0] ^ b[0];
+    if (diff) {
+      common = __builtin_clzll(diff);
+    } else {
+      diff = a[1] ^ b[1];
+      common = diff ? 64 + __builtin_clzll(diff) : 128;
+    }
+    return std::min(common, max_bits);
+  }
+
+  uint32_t& getRoot(const ComboAddress& addr) {
+    return addr.sin4.sin_family == AF_INET ? d_root4 : d_root6;
+  }
+
+  uint32_t getRoot(const ComboAddress& addr) const {
+    return addr.sin4.sin_family == AF_INET ? d_root4 : d_root6;
+  }
+
+  uint32_t newNode(const uint64_t* key, int bits) {
+    if (d_tree.size() >= npos)
+      throw std::length_error("NetmaskTree is full");
+    d_tree.push_back(TreeNode(key, bits));
+    return d_tree.size() - 1;
+  }
+
+  //<! Finds the node holding exactly the given prefix, or npos
+  uint32_t findExact(const key_type& key) const {
+    uint64_t addr[2];
+    makeKey(key.getNetwork(), addr);
+    const int bits = key.getBits();
+    uint32_t idx = getRoot(key.getNetwork());
+    while (idx != npos) {
+      const TreeNode& node = d_tree[idx];
+      if (node.d_bits > bits || commonBits(node.d_key, addr, node.d_bits) < node.d_bits)
+        return npos;
+      if (node.d_bits == bits)
+        return idx;
+      idx = node.child[getBit(addr, node.d_bits)];
+    }
+    return npos;
+  }
+
 public:
-  NetmaskTree() noexcept {
+  NetmaskTree() noexcept : d_root4(npos), d_root6(npos) {
   }
 
-  NetmaskTree(const NetmaskTree& rhs) {
+  NetmaskTree(const NetmaskTree& rhs) : d_root4(npos), d_root6(npos) {
     // it is easier to copy the nodes than tree.
     // also acts as handy compactor
+    d_tree.reserve(rhs.d_tree.size());
     for(auto const& node: rhs._nodes)
       insert(node->first).second = node->second;
   }
 
   NetmaskTree& operator=(const NetmaskTree& rhs) {
+    if (this == &rhs)
+      return *this;
     clear();
     // see above.
+    d_tree.reserve(rhs.d_tree.size());
     for(auto const& node: rhs._nodes)
       insert(node->first).second = node->second;
     return *this;
@@ -558,58 +625,67 @@ public:
 
   //<! Creates new value-pair in tree and returns it.
   node_type& insert(const key_type& key) {
-    // lazily initialize tree on first insert.
-    if (!root) root = unique_ptr<TreeNode>(new TreeNode(0));
-    TreeNode* node = root.get();
-    node_type* value = nullptr;
-
-    if (key.getNetwork().sin4.sin_family == AF_INET) {
-      std::bitset<32> addr(be32toh(key.getNetwork().sin4.sin_addr.s_addr));
-      int bits = 0;
-      // we turn left on 0 and right on 1
-      while(bits < key.getBits()) {
-        uint8_t val = addr[31-bits];
-        if (val)
-          node = node->make_right();
-        else
-          node = node->make_left();
-        bits++;
+    uint64_t addr[2];
+    makeKey(key.getNetwork(), addr);
+    const int bits = key.getBits();
+
+    // index of the node we are at, and of the parent slot pointing to it (npos for the root)
+    uint32_t idx = getRoot(key.getNetwork());
+    uint32_t parent = npos;
+    uint8_t dir = 0;
+    uint32_t target;
+
+    for(;;) {
+      if (idx == npos) {
+        // empty slot, we become a leaf here
+        target = idx = newNode(addr, bits);
+        break;
       }
-      // only create node if not yet assigned
-      if (!node->node4) {
-        node->node4 = unique_ptr<node_type>(new node_type());
-        _nodes.push_back(node->node4.get());
-      }
-      value = node->node4.get();
-    } else {
-      uint64_t* addr = (uint64_t*)key.getNetwork().sin6.sin6_addr.s6_addr;
-      std::bitset<64> addr_low(be64toh(addr[1]));
-      std::bitset<64> addr_high(be64toh(addr[0]));
-      int bits = 0;
-      while(bits < key.getBits()) {
-        uint8_t val;
-        // we use high address until we are
-        if (bits < 64) val = addr_high[63-bits];
-        // past 64 bits, and start using low address
-        else val = addr_low[127-bits];
-
-        // we turn left on 0 and right on 1
-        if (val)
-          node = node->make_right();
-        else
-          node = node->make_left();
-        bits++;
+      const int nodeBits = d_tree[idx].d_bits;
+      const int common = commonBits(d_tree[idx].d_key, addr, std::min(nodeBits, bits));
+      if (common == nodeBits) {
+        if (nodeBits == bits) {
+          target = idx;
+          break;
+        }
+        // this node is a prefix of ours, descend
+        parent = idx;
+        dir = getBit(addr, nodeBits);
+        idx = d_tree[idx].child[dir];
+        continue;
       }
-      // only create node if not yet assigned
-      if (!node->node6) {
-        node->node6 = unique_ptr<node_type>(new node_type());
-        _nodes.push_back(node->node6.get());
+
+      // we diverge from this node before its end, so it moves below a new node
+      const uint8_t existingDir = getBit(d_tree[idx].d_key, common);
+      target = newNode(addr, bits);
+      if (common == bits) {
+        // we are a prefix of the existing node
+        d_tree[target].child[existingDir] = idx;
+        idx = target;
+      } else {
+        // we need a branching node where the two prefixes diverge
+        uint32_t branch = newNode(addr, common);
+        d_tree[branch].child[existingDir] = idx;
+        d_tree[branch].child[getBit(addr, common)] = target;
+        idx = branch;
       }
-      value = node->node6.get();
+      break;
+    }
+
+    if (parent == npos)
+      getRoot(key.getNetwork()) = idx;
+    else
+      d_tree[parent].child[dir] = idx;
+
+    TreeNode& node = d_tree[target];
+    // only create value if not yet assigned
+    if (!node.value) {
+      node.value = unique_ptr<node_type>(new node_type());
+      _nodes.push_back(node.value.get());
     }
     // assign key
-    value->first = key;
-    return *value;
+    node.value->first = key;
+    return *node.value;
   }
 
   //<! Creates or updates value
@@ -621,6 +697,22 @@ public:
     insert(key_type(mask)).second = value;
   }
 
+  //<! Bulk insert of a range of (key, value) pairs, later pairs override earlier ones for the same key
+  template<typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    std::vector<const typename std::iterator_traits<InputIterator>::value_type*> items;
+    for(; first != last; ++first)
+      items.push_back(&*first);
+    // shorter prefixes first, so that longer ones never need to split an existing node
+    std::stable_sort(items.begin(), items.end(), [](const typename std::iterator_traits<InputIterator>::value_type* a, const typename std::iterator_traits<InputIterator>::value_type* b) {
+        return a->first.getBits() < b->first.getBits();
+      });
+    d_tree.reserve(d_tree.size() + 2 * items.size());
+    _nodes.reserve(_nodes.size() + items.size());
+    for(const auto item : items)
+      insert(item->first).second = item->second;
+  }
+
   //<! check if given key is present in TreeMap
   bool has_key(const key_type& key) const {
     const node_type *ptr = lookup(key);
@@ -634,55 +726,24 @@ public:
 
   //<! Perform best match lookup for value, using at most max_bits
   const node_type* lookup(const ComboAddress& value, int max_bits = 128) const {
-    if (!root) return nullptr;
-
-    TreeNode *node = root.get();
-    node_type *ret = nullptr;
-
-    // exact same thing as above, except
-    if (value.sin4.sin_family == AF_INET) {
-      max_bits = std::max(0,std::min(max_bits,32));
-      std::bitset<32> addr(be32toh(value.sin4.sin_addr.s_addr));
-      int bits = 0;
-
-      while(bits < max_bits) {
-        // ...we keep track of last non-empty node
-        if (node->node4) ret = node->node4.get();
-        uint8_t val = addr[31-bits];
-        // ...and we don't create left/right hand
-        if (val) {
-          if (node->right) node = node->right.get();
-          // ..and we break when road ends
-          else break;
-        } else {
-          if (node->left) node = node->left.get();
-          else break;
-        }
-        bits++;
-      }
-      // needed if we did not find one in loop
-      if (node->node4) ret = node->node4.get();
-    } else {
-      uint64_t* addr = (uint64_t*)value.sin6.sin6_addr.s6_addr;
-      max_bits = std::max(0,std::min(max_bits,128));
-      std::bitset<64> addr_low(be64toh(addr[1]));
-      std::bitset<64> addr_high(be64toh(addr[0]));
-      int bits = 0;
-      while(bits < max_bits) {
-        if (node->node6) ret = node->node6.get();
-        uint8_t val;
-        if (bits < 64) val = addr_high[63-bits];
-        else val = addr_low[127-bits];
-        if (val) {
-          if (node->right) node = node->right.get();
-          else break;
-        } else {
-          if (node->left) node = node->left.get();
-          else break;
-        }
-        bits++;
-      }
-      if (node->node6) ret = node->node6.get();
+    uint32_t idx = getRoot(value);
+    if (idx == npos) return nullptr;
+
+    max_bits = std::max(0, std::min(max_bits, value.sin4.sin_family == AF_INET ? 32 : 128));
+    uint64_t addr[2];
+    makeKey(value, addr);
+    const node_type *ret = nullptr;
+
+    while (idx != npos) {
+      const TreeNode& node = d_tree[idx];
+      // we stop at the first node that is longer than allowed or not a prefix of value
+      if (node.d_bits > max_bits || commonBits(node.d_key, addr, node.d_bits) < node.d_bits)
+        break;
+      // ...and we keep track of last non-empty node
+      if (node.value) ret = node.value.get();
+      if (node.d_bits == max_bits)
+        break;
+      idx = node.child[getBit(addr, node.d_bits)];
     }
 
     // this can be nullptr.
@@ -691,60 +752,15 @@ public:
 
   //<! Removes key from TreeMap. This does not clean up the tree.
   void erase(const key_type& key) {
-    TreeNode *node = root.get();
-
-    // no tree, no value
-    if ( node == nullptr ) return;
-
-    // exact same thing as above, except
-    if (key.getNetwork().sin4.sin_family == AF_INET) {
-      std::bitset<32> addr(be32toh(key.getNetwork().sin4.sin_addr.s_addr));
-      int bits = 0;
-      while(node && bits < key.getBits()) {
-        uint8_t val = addr[31-bits];
-        if (val) {
-          node = node->right.get();
-        } else {
-          node = node->left.get();
-        }
-        bits++;
-      }
-      if (node) {
-        for(auto it = _nodes.begin(); it != _nodes.end(); ) {
-          if (node->node4.get() == *it)
-            it = _nodes.erase(it);
-          else
-            it++;
-        }
-        node->node4.reset();
-      }
-    } else {
-      uint64_t* addr = (uint64_t*)key.getNetwork().sin6.sin6_addr.s6_addr;
-      std::bitset<64> addr_low(be64toh(addr[1]));
-      std::bitset<64> addr_high(be64toh(addr[0]));
-      int bits = 0;
-      while(node && bits < key.getBits()) {
-        uint8_t val;
-        if (bits < 64) val = addr_high[63-bits];
-        else val = addr_low[127-bits];
-        if (val) {
-          node = node->right.get();
-        } else {
-          node = node->left.get();
-        }
-        bits++;
-      }
-      if (node) {
-        for(auto it = _nodes.begin(); it != _nodes.end(); ) {
-          if (node->node6.get() == *it)
-            it = _nodes.erase(it);
-          else
-            it++;
-        }
+    uint32_t idx = findExact(key);
 
-        node->node6.reset();
-      }
-    }
+    // no node, no value
+    if (idx == npos || !d_tree[idx].value) return;
+
+    auto it = std::find(_nodes.begin(), _nodes.end(), d_tree[idx].value.get());
+    if (it != _nodes.end())
+      _nodes.erase(it);
+    d_tree[idx].value.reset();
   }
 
   void erase(const string& key) {
@@ -773,17 +789,22 @@ public:
   //<! Clean out the tree
   void clear() {
     _nodes.clear();
-    root.reset(nullptr);
+    d_tree.clear();
+    d_root4 = d_root6 = npos;
   }
 
   //<! swaps the contents, rhs is left with nullptr.
   void swap(NetmaskTree& rhs) {
-    root.swap(rhs.root);
+    d_tree.swap(rhs.d_tree);
+    std::swap(d_root4, rhs.d_root4);
+    std::swap(d_root6, rhs.d_root6);
     _nodes.swap(rhs._nodes);
   }
 
 private:
-  unique_ptr<TreeNode> root; //<! Root of our tree
+  std::vector<TreeNode> d_tree; //<! All nodes of our trie
+  uint32_t d_root4; //<! Index of the IPv4 root node, or npos
+  uint32_t d_root6; //<! Index of the IPv6 root node, or npos
   std::vector<node_type*> _nodes; //<! Container for actual values
 };
 
@@ -967,6 +967,14 @@ uint32_t burtle(const unsigned char* k, uint32_t length, uint32_t initval)
 
 uint32_t burtleCI(const unsigned char* k, uint32_t length, uint32_t initval)
 {
+  /* lowercasing in bulk first is a lot cheaper than doing it byte by byte below,
+     and anything up to the size of a DNS name fits on the stack */
+  unsigned char lowered[256];
+  if(length <= sizeof(lowered)) {
+    dns_tolower_copy(lowered, k, length);
+    return burtle(lowered, length, initval);
+  }
+
   uint32_t a,b,c,len;
 
    /* Set up the internal state */
@@ -172,7 +172,8 @@ int main()
 
 template<class EventKey, class EventVal>int MTasker<EventKey,EventVal>::waitEvent(EventKey &key, EventVal *val, unsigned int timeoutMsec, struct timeval* now)
 {
-  if(d_waiters.count(key)) { // there was already an exact same waiter
+  auto& hashedIndex = d_waiters.template get<HashedKeyTag>();
+  if(hashedIndex.count(key)) { // there was already an exact same waiter
     return -1;
   }
 
@@ -195,13 +196,14 @@ template<class EventKey, class EventVal>int MTasker<EventKey,EventVal>::waitEven
   w.tid=d_tid;
   w.key=key;
 
+  auto userspace = w.context;
   d_waiters.insert(w);
 #ifdef MTASKERTIMING
   unsigned int diff=d_threads[d_tid].dt.ndiff()/1000;
   d_threads[d_tid].totTime+=diff;
 #endif
   notifyStackSwitchToKernel();
-  pdns_swapcontext(*d_waiters.find(key)->context,d_kernel); // 'A' will return here when 'key' has arrived, hands over control to kernel first
+  pdns_swapcontext(*userspace,d_kernel); // 'A' will return here when 'key' has arrived, hands over control to kernel first
   notifyStackSwitchDone();
 #ifdef MTASKERTIMING
   d_threads[d_tid].dt.start();
@@ -237,9 +239,10 @@ template<class Key, class Val>void MTasker<Key,Val>::yield()
 */
 template<class EventKey, class EventVal>int MTasker<EventKey,EventVal>::sendEvent(const EventKey& key, const EventVal* val)
 {
-  typename waiters_t::iterator waiter=d_waiters.find(key);
+  auto& hashedIndex = d_waiters.template get<HashedKeyTag>();
+  auto waiter=hashedIndex.find(key);
 
-  if(waiter == d_waiters.end()) {
+  if(waiter == hashedIndex.end()) {
     //    cout<<"Event sent nobody was waiting for!"<<endl;
     return 0;
   }
@@ -251,7 +254,7 @@ template<class EventKey, class EventVal>int MTasker<EventKey,EventVal>::sendEven
   d_tid=waiter->tid;         // set tid 
   d_eventkey=waiter->key;        // pass waitEvent the exact key it was woken for
   auto userspace=std::move(waiter->context);
-  d_waiters.erase(waiter);             // removes the waitpoint
+  hashedIndex.erase(waiter);             // removes the waitpoint
   notifyStackSwitch(d_threads[d_tid].startOfStack, d_stacksize);
   pdns_swapcontext(d_kernel,*userspace); // swaps back to the above point 'A'
   notifyStackSwitchDone();
@@ -265,14 +268,21 @@ template<class EventKey, class EventVal>int MTasker<EventKey,EventVal>::sendEven
 */
 template<class Key, class Val>void MTasker<Key,Val>::makeThread(tfunc_t *start, void* val)
 {
-  auto uc=std::make_shared<pdns_ucontext_t>();
-  
-  uc->uc_link = &d_kernel; // come back to kernel after dying
-  uc->uc_stack.resize (d_stacksize);
+  std::shared_ptr<pdns_ucontext_t> uc;
+  if(!d_cachedContexts.empty()) {
+    // reuse the context and stack of a thread that has already finished
+    uc = std::move(d_cachedContexts.back());
+    d_cachedContexts.pop_back();
+  }
+  else {
+    uc = std::make_shared<pdns_ucontext_t>();
+    uc->uc_link = &d_kernel; // come back to kernel after dying
+    uc->uc_stack.resize (d_stacksize);
 #ifdef PDNS_USE_VALGRIND
-  uc->valgrind_id = VALGRIND_STACK_REGISTER(&uc->uc_stack[0],
-                                            &uc->uc_stack[uc->uc_stack.size()]);
+    uc->valgrind_id = VALGRIND_STACK_REGISTER(&uc->uc_stack[0],
+                                              &uc->uc_stack[uc->uc_stack.size()]);
 #endif /* PDNS_USE_VALGRIND */
+  }
 
   auto& thread = d_threads[d_maxtid];
   auto mt = this;
@@ -315,7 +325,14 @@ template<class Key, class Val>bool MTasker<Key,Val>::schedule(struct timeval*  n
     return true;
   }
   if(!d_zombiesQueue.empty()) {
-    d_threads.erase(d_zombiesQueue.front());
+    auto zombie = d_threads.find(d_zombiesQueue.front());
+    if(zombie != d_threads.end()) {
+      auto& uc = zombie->second.context;
+      if(d_cachedContexts.size() < d_maxCachedStacks && uc && uc.unique() && !uc->exception) {
+        d_cachedContexts.push_back(std::move(uc));
+      }
+      d_threads.erase(zombie);
+    }
     d_zombiesQueue.pop();
     return true;
   }
@@ -344,6 +361,8 @@ template<class Key, class Val>bool MTasker<Key,Val>::schedule(struct timeval*  n
       }
       else if(i->ttd.tv_sec)
         break;
+      else
+        ++i; // no timeout set, nothing to expire
     }
   }
   return false;
@@ -24,10 +24,11 @@
 #include <stdint.h>
 #include <queue>
 #include <vector>
-#include <map>
+#include <unordered_map>
 #include <time.h>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 #include "namespaces.hh"
 #include "misc.hh"
@@ -39,12 +40,14 @@ using namespace ::boost::multi_index;
 // #define MTASKERTIMING 1
 
 struct KeyTag {};
+struct HashedKeyTag {};
 
 //! The main MTasker class    
 /** The main MTasker class. See the main page for more information.
     \tparam EventKey Type of the key with which events are to be identified. Defaults to int.
     \tparam EventVal Type of the content or value of an event. Defaults to int. Cannot be set to void.
-    \note The EventKey needs to have an operator< defined because it is used as the key of an associative array
+    \note The EventKey needs to have an operator< defined because it is used as the key of an associative array,
+    and it needs to be hashable (boost::hash) with an operator== consistent with operator< for the exact lookups
 */
 
 template<class EventKey=int, class EventVal=int> class MTasker
@@ -66,11 +69,13 @@ private:
 #endif
   };
 
-  typedef std::map<int, ThreadInfo> mthreads_t;
+  typedef std::unordered_map<int, ThreadInfo> mthreads_t;
   mthreads_t d_threads;
+  std::vector<std::shared_ptr<pdns_ucontext_t>> d_cachedContexts;
   int d_tid;
   int d_maxtid;
   size_t d_stacksize;
+  size_t d_maxCachedStacks;
 
   EventVal d_waitval;
   enum waitstatusenum {Error=-1,TimeOut=0,Answer} d_waitstatus;
@@ -84,11 +89,14 @@ public:
     int tid;    
   };
 
+  /* the ordered index on the key is only there for partial (for example 'birthday') lookups and listings,
+     exact lookups by key should use the HashedKeyTag index */
   typedef multi_index_container<
     Waiter,
     indexed_by <
                 ordered_unique<member<Waiter,EventKey,&Waiter::key> >,
-                ordered_non_unique<tag<KeyTag>, member<Waiter,struct timeval,&Waiter::ttd> >
+                ordered_non_unique<tag<KeyTag>, member<Waiter,struct timeval,&Waiter::ttd> >,
+                hashed_unique<tag<HashedKeyTag>, member<Waiter,EventKey,&Waiter::key> >
                >
   > waiters_t;
 
@@ -109,8 +117,9 @@ public:
   /** Constructor with a small default stacksize. If any of your threads exceeds this stack, your application will crash. 
       This limit applies solely to the stack, the heap is not limited in any way. If threads need to allocate a lot of data,
       the use of new/delete is suggested. 
+      Up to maxCachedStacks contexts (and their stacks) of finished threads are kept around to be reused by makeThread().
    */
-  MTasker(size_t stacksize=8192) : d_tid(0), d_maxtid(0), d_stacksize(stacksize), d_waitstatus(Error)
+  MTasker(size_t stacksize=8192, size_t maxCachedStacks=0) : d_tid(0), d_maxtid(0), d_stacksize(stacksize), d_maxCachedStacks(maxCachedStacks), d_waitstatus(Error)
   {
     initMainStackBounds();
   }
@@ -127,6 +136,10 @@ public:
   int getTid(); 
   unsigned int getMaxStackUsage();
   unsigned int getUsec();
+  size_t getCachedStacksCount() const
+  {
+    return d_cachedContexts.size();
+  }
 
 private:
   EventKey d_eventkey;   // for waitEvent, contains exact key it was awoken for
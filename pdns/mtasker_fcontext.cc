@@ -149,8 +149,13 @@ threadWrapper (transfer_t const t) {
     notifyStackSwitchToKernel();
     /* Emulate the System V uc_link feature. */
     auto const next_ctx = ctx->uc_link->uc_mcontext;
+    /* This thread never runs again, and MTasker may hand its context (and
+       stack) to pdns_makecontext() for a new thread, so don't leave a stale
+       fcontext behind. */
+    ctx->uc_mcontext = nullptr;
 #if BOOST_VERSION < 106100
-    jump_fcontext (reinterpret_cast<fcontext_t*>(&ctx->uc_mcontext),
+    fcontext_t finished;
+    jump_fcontext (&finished,
                    static_cast<fcontext_t>(next_ctx),
                    static_cast<bool>(ctx->exception));
 #else
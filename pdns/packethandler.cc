@@ -45,6 +45,7 @@
 #include "dnsproxy.hh"
 #include "version.hh"
 #include "common_startup.hh"
+#include "auth-zonecache.hh"
 
 #if 0
 #undef DLOG
@@ -811,6 +812,8 @@ int PacketHandler::trySuperMasterSynchronous(DNSPacket *p, const DNSName& tsigke
       meta.push_back(tsigkeyname.toStringNoDot());
       db->setDomainMetadata(p->qdomain, "AXFR-MASTER-TSIG", meta);
     }
+    DomainInfo di;
+    g_zoneCache.add(p->qdomain, db->getDomainInfo(p->qdomain, di) ? di.id : -1);
   }
   catch(PDNSException& ae) {
     L<<Logger::Error<<"Database error trying to create "<<p->qdomain<<" for potential supermaster "<<remote<<": "<<ae.reason<<endl;
@@ -852,6 +855,7 @@ int PacketHandler::processNotify(DNSPacket *p)
     L<<Logger::Error<<"Received NOTIFY for "<<p->qdomain<<" from "<<p->getRemote()<<" for which we are not authoritative"<<endl;
     return trySuperMaster(p, p->getTSIGKeyname());
   }
+  g_zoneCache.add(p->qdomain, di.id); // might have been added to the backend behind our back
 
   meta.clear();
   if (B.getDomainMetadata(p->qdomain,"AXFR-MASTER-TSIG",meta) && meta.size() > 0) {
@@ -1228,6 +1232,8 @@ DNSPacket *PacketHandler::doQuestion(DNSPacket *p)
     }
 
     DNSName target=p->qdomain;
+    // the SOA, NS, DNAME and answer lookups for a name share one backend query
+    UeberBackend::BundleScope bundle(B);
 
     // catch chaos qclass requests
     if(p->qclass == QClass::CHAOS) {
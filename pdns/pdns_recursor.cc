@@ -144,6 +144,8 @@ static unsigned int g_maxTCPPerClient;
 static unsigned int g_networkTimeoutMsec;
 static unsigned int g_maxMThreads;
 static unsigned int g_numWorkerThreads;
+static unsigned int g_udpSourcePortMaxUses;
+static unsigned int g_udpSourcePortLifetime;
 static int g_tcpTimeout;
 static uint16_t g_udpTruncationThreshold;
 static std::atomic<bool> statsWanted;
@@ -389,12 +391,44 @@ public:
   {
   }
 
-  typedef set<int> socks_t;
+  struct SocketInfo
+  {
+    ComboAddress remote;
+    time_t created;
+    unsigned int uses;
+    bool idle;
+  };
+
+  typedef map<int, SocketInfo> socks_t;
   socks_t d_socks;
+  /* sockets that answered their query and can be reused for another one to the same
+     remote, see udp-source-port-max-uses */
+  typedef std::multimap<ComboAddress, int> idle_t;
+  idle_t d_idle;
 
   // returning -2 means: temporary OS error (ie, out of files), -1 means error related to remote
+  // returns 1 if an already connected socket was reused, 0 if a new one was created
   int getSocket(const ComboAddress& toaddr, int* fd)
   {
+    time_t now = time(nullptr);
+    for(auto idle = d_idle.find(toaddr); idle != d_idle.end() && idle->first == toaddr; idle = d_idle.find(toaddr)) {
+      int candidate = idle->second;
+      d_idle.erase(idle);
+      auto info = d_socks.find(candidate);
+      if(info == d_socks.end()) {
+        continue;
+      }
+      if(info->second.created + g_udpSourcePortLifetime < now) {
+        returnSocketLocked(info);
+        continue;
+      }
+      info->second.idle = false;
+      info->second.uses++;
+      g_stats.udpSocketsReused++;
+      *fd = candidate;
+      return 1;
+    }
+
     *fd=makeClientSocket(toaddr.sin4.sin_family);
     if(*fd < 0) // temporary error - receive exception otherwise
       return -2;
@@ -414,11 +448,33 @@ public:
       return -1;
     }
 
-    d_socks.insert(*fd);
+    d_socks[*fd] = SocketInfo{toaddr, now, 1, false};
     d_numsocks++;
     return 0;
   }
 
+  bool isIdle(int fd) const
+  {
+    auto i=d_socks.find(fd);
+    return i != d_socks.end() && i->second.idle;
+  }
+
+  // the query sent over this socket has been answered, keep it for another query to the same remote if allowed
+  void recycleSocket(int fd)
+  {
+    socks_t::iterator i=d_socks.find(fd);
+    if(i==d_socks.end()) {
+      throw PDNSException("Trying to recycle a socket (fd="+std::to_string(fd)+") not in the pool");
+    }
+    if(i->second.uses >= g_udpSourcePortMaxUses || i->second.created + g_udpSourcePortLifetime < time(nullptr)) {
+      returnSocketLocked(i);
+      return;
+    }
+    // stays registered in t_fdm, anything arriving while idle is unexpected
+    i->second.idle = true;
+    d_idle.insert(make_pair(i->second.remote, fd));
+  }
+
   void returnSocket(int fd)
   {
     socks_t::iterator i=d_socks.find(fd);
@@ -434,14 +490,23 @@ public:
     if(i==d_socks.end()) {
       throw PDNSException("Trying to return a socket not in the pool");
     }
+    if(i->second.idle) {
+      auto range = d_idle.equal_range(i->second.remote);
+      for(auto idle = range.first; idle != range.second; ++idle) {
+        if(idle->second == i->first) {
+          d_idle.erase(idle);
+          break;
+        }
+      }
+    }
     try {
-      t_fdm->removeReadFD(*i);
+      t_fdm->removeReadFD(i->first);
     }
     catch(FDMultiplexerException& e) {
       // we sometimes return a socket that has not yet been assigned to t_fdm
     }
     try {
-      closesocket(*i);
+      closesocket(i->first);
     }
     catch(const PDNSException& e) {
       L<<Logger::Error<<"Error closing returned UDP socket: "<<e.reason<<endl;
@@ -520,10 +585,14 @@ int asendto(const char *data, size_t len, int flags,
   if(ret < 0)
     return ret;
 
+  bool reused = ret == 1;
   pident.fd=*fd;
   pident.id=id;
 
-  t_fdm->addReadFD(*fd, handleUDPServerResponse, pident);
+  if(reused)
+    t_fdm->getReadParameter(*fd) = pident;
+  else
+    t_fdm->addReadFD(*fd, handleUDPServerResponse, pident);
   ret = send(*fd, data, len, 0);
 
   int tmp = errno;
@@ -1543,6 +1612,71 @@ static void handleNewTCPQuestion(int fd, FDMultiplexer::funcparam_t& )
   }
 }
 
+#ifdef HAVE_SENDMMSG
+/* when a batch of questions has been received with recvmmsg(), the answers to the
+   ones that hit the packet cache are collected here and sent with a single sendmmsg() */
+struct UDPResponseBatch
+{
+  void add(const string& response, const ComboAddress& remote, const ComboAddress& local)
+  {
+    d_responses.push_back(response);
+    d_remotes.push_back(remote);
+    d_locals.push_back(local);
+  }
+
+  void flush()
+  {
+    const size_t count = d_responses.size();
+    if(count == 0)
+      return;
+
+    d_msgs.resize(count);
+    d_iovs.resize(count);
+    d_cbufs.resize(count * s_cbufSize);
+    const bool addSource = g_fromtosockets.count(d_fd);
+    for(size_t idx = 0; idx < count; idx++) {
+      struct msghdr* msgh = &d_msgs.at(idx).msg_hdr;
+      fillMSGHdr(msgh, &d_iovs.at(idx), &d_cbufs.at(idx * s_cbufSize), 0, const_cast<char*>(d_responses.at(idx).c_str()), d_responses.at(idx).length(), &d_remotes.at(idx));
+      msgh->msg_control=NULL;
+      if(addSource) {
+        addCMsgSrcAddr(msgh, &d_cbufs.at(idx * s_cbufSize), &d_locals.at(idx), 0);
+      }
+      d_msgs.at(idx).msg_len = 0;
+    }
+
+    size_t sent = 0;
+    while(sent < count) {
+      int res = sendmmsg(d_fd, &d_msgs.at(sent), count - sent, 0);
+      if(res <= 0) {
+        if(g_logCommonErrors)
+          L<<Logger::Warning<<"Sending UDP reply to client "<<d_remotes.at(sent).toStringWithPort()<<" failed with: "<<strerror(errno)<<endl;
+        /* skip the one that failed */
+        sent++;
+        continue;
+      }
+      sent += res;
+    }
+
+    d_responses.clear();
+    d_remotes.clear();
+    d_locals.clear();
+  }
+
+  int d_fd{-1};
+
+private:
+  static const size_t s_cbufSize = 256;
+  vector<string> d_responses;
+  vector<ComboAddress> d_remotes;
+  vector<ComboAddress> d_locals;
+  vector<struct mmsghdr> d_msgs;
+  vector<struct iovec> d_iovs;
+  vector<char> d_cbufs;
+};
+
+static __thread UDPResponseBatch* t_udpResponseBatch;
+#endif /* HAVE_SENDMMSG */
+
 static string* doProcessUDPQuestion(const std::string& question, const ComboAddress& fromaddr, const ComboAddress& destaddr, struct timeval tv, int fd)
 {
   gettimeofday(&g_now, 0);
@@ -1654,17 +1788,25 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
       g_stats.packetCacheHits++;
       SyncRes::s_queries++;
       ageDNSPacket(response, age);
-      struct msghdr msgh;
-      struct iovec iov;
-      char cbuf[256];
-      fillMSGHdr(&msgh, &iov, cbuf, 0, (char*)response.c_str(), response.length(), const_cast<ComboAddress*>(&fromaddr));
-      msgh.msg_control=NULL;
-
-      if(g_fromtosockets.count(fd)) {
-	addCMsgSrcAddr(&msgh, cbuf, &destaddr, 0);
+#ifdef HAVE_SENDMMSG
+      if(t_udpResponseBatch && t_udpResponseBatch->d_fd == fd && fd >= 0) {
+        t_udpResponseBatch->add(response, fromaddr, destaddr);
+      }
+      else
+#endif /* HAVE_SENDMMSG */
+      {
+        struct msghdr msgh;
+        struct iovec iov;
+        char cbuf[256];
+        fillMSGHdr(&msgh, &iov, cbuf, 0, (char*)response.c_str(), response.length(), const_cast<ComboAddress*>(&fromaddr));
+        msgh.msg_control=NULL;
+
+        if(g_fromtosockets.count(fd)) {
+          addCMsgSrcAddr(&msgh, cbuf, &destaddr, 0);
+        }
+        if(sendmsg(fd, &msgh, 0) < 0 && g_logCommonErrors)
+          L<<Logger::Warning<<"Sending UDP reply to client "<<fromaddr.toStringWithPort()<<" failed with: "<<strerror(errno)<<endl;
       }
-      if(sendmsg(fd, &msgh, 0) < 0 && g_logCommonErrors)
-        L<<Logger::Warning<<"Sending UDP reply to client "<<fromaddr.toStringWithPort()<<" failed with: "<<strerror(errno)<<endl;
 
       if(response.length() >= sizeof(struct dnsheader)) {
         struct dnsheader tmpdh;
@@ -1721,20 +1863,9 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
 }
 
 
-static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
+// returns false if the remaining queries on this socket should not be processed right now
+static bool handleNewUDPDatagram(int fd, const char* data, size_t len, const ComboAddress& fromaddr, struct msghdr* msgh)
 {
-  ssize_t len;
-  char data[1500];
-  ComboAddress fromaddr;
-  struct msghdr msgh;
-  struct iovec iov;
-  char cbuf[256];
-
-  fromaddr.sin6.sin6_family=AF_INET6; // this makes sure fromaddr is big enough
-  fillMSGHdr(&msgh, &iov, cbuf, sizeof(cbuf), data, sizeof(data), &fromaddr);
-
-  for(;;)
-  if((len=recvmsg(fd, &msgh, 0)) >= 0) {
     if(t_remotes)
       t_remotes->push_back(fromaddr);
 
@@ -1743,7 +1874,7 @@ static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
         L<<Logger::Error<<"["<<MT->getTid()<<"] dropping UDP query from "<<fromaddr.toString()<<", address not matched by allow-from"<<endl;
 
       g_stats.unauthorizedUDP++;
-      return;
+      return false;
     }
     BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
     if(!fromaddr.sin4.sin_port) { // also works for IPv6
@@ -1751,10 +1882,10 @@ static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
         L<<Logger::Error<<"["<<MT->getTid()<<"] dropping UDP query from "<<fromaddr.toStringWithPort()<<", can't deal with port 0"<<endl;
 
       g_stats.clientParseError++; // not quite the best place to put it, but needs to go somewhere
-      return;
+      return false;
     }
     try {
-      dnsheader* dh=(dnsheader*)data;
+      const dnsheader* dh=(const dnsheader*)data;
 
       if(dh->qr) {
         g_stats.ignoredCount++;
@@ -1767,13 +1898,13 @@ static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
           L<<Logger::Error<<"Ignoring non-query opcode "<<dh->opcode<<" from "<<fromaddr.toString()<<" on server socket!"<<endl;
       }
       else {
-        string question(data, (size_t)len);
+        string question(data, len);
 	struct timeval tv={0,0};
-	HarvestTimestamp(&msgh, &tv);
+	HarvestTimestamp(msgh, &tv);
 	ComboAddress dest;
 	memset(&dest, 0, sizeof(dest)); // this makes sure we ignore this address if not returned by recvmsg above
         auto loc = rplookup(g_listenSocketsAddresses, fd);
-	if(HarvestDestinationAddress(&msgh, &dest)) {
+	if(HarvestDestinationAddress(msgh, &dest)) {
           // but.. need to get port too
           if(loc) 
             dest.sin4.sin_port = loc->sin4.sin_port;
@@ -1804,6 +1935,96 @@ static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
       if(g_logCommonErrors)
         L<<Logger::Error<<"Unable to parse packet from remote UDP client "<<fromaddr.toString() <<": "<<e.what()<<endl;
     }
+    return true;
+}
+
+#ifdef HAVE_RECVMMSG
+/* buffers used to receive up to s_batchSize questions with a single recvmmsg() */
+struct UDPReceiveBatch
+{
+  static const size_t s_batchSize = 32;
+  static const size_t s_dataSize = 1500;
+  static const size_t s_cbufSize = 256;
+
+  UDPReceiveBatch() : d_msgs(s_batchSize), d_iovs(s_batchSize), d_addrs(s_batchSize), d_data(s_batchSize * s_dataSize), d_cbufs(s_batchSize * s_cbufSize)
+  {
+  }
+
+  void prepare()
+  {
+    for(size_t idx = 0; idx < s_batchSize; idx++) {
+      d_addrs.at(idx).sin6.sin6_family=AF_INET6; // this makes sure the address is big enough
+      fillMSGHdr(&d_msgs.at(idx).msg_hdr, &d_iovs.at(idx), &d_cbufs.at(idx * s_cbufSize), s_cbufSize, &d_data.at(idx * s_dataSize), s_dataSize, &d_addrs.at(idx));
+      d_msgs.at(idx).msg_len = 0;
+    }
+  }
+
+  vector<struct mmsghdr> d_msgs;
+  vector<struct iovec> d_iovs;
+  vector<ComboAddress> d_addrs;
+  vector<char> d_data;
+  vector<char> d_cbufs;
+};
+
+static __thread UDPReceiveBatch* t_udpReceiveBatch;
+#endif /* HAVE_RECVMMSG */
+
+static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
+{
+#ifdef HAVE_RECVMMSG
+  if(!t_udpReceiveBatch)
+    t_udpReceiveBatch = new UDPReceiveBatch();
+  UDPReceiveBatch& batch = *t_udpReceiveBatch;
+#ifdef HAVE_SENDMMSG
+  if(!t_udpResponseBatch)
+    t_udpResponseBatch = new UDPResponseBatch();
+  UDPResponseBatch& responses = *t_udpResponseBatch;
+  /* the answers to questions distributed to another thread are sent by that thread */
+  responses.d_fd = g_weDistributeQueries ? -1 : fd;
+#endif /* HAVE_SENDMMSG */
+
+  for(;;) {
+    batch.prepare();
+    int received = recvmmsg(fd, batch.d_msgs.data(), UDPReceiveBatch::s_batchSize, 0, nullptr);
+    if(received <= 0) {
+      // cerr<<t_id<<" had error: "<<stringerror()<<"\n";
+      if(received < 0 && errno == EAGAIN)
+        g_stats.noPacketError++;
+      break;
+    }
+
+    bool keepGoing = true;
+    for(int idx = 0; idx < received; idx++) {
+      struct mmsghdr& msg = batch.d_msgs.at(idx);
+      if(!handleNewUDPDatagram(fd, &batch.d_data.at(idx * UDPReceiveBatch::s_dataSize), msg.msg_len, batch.d_addrs.at(idx), &msg.msg_hdr))
+        keepGoing = false;
+    }
+#ifdef HAVE_SENDMMSG
+    responses.flush();
+#endif /* HAVE_SENDMMSG */
+
+    if(!keepGoing || static_cast<size_t>(received) < UDPReceiveBatch::s_batchSize)
+      break;
+  }
+
+#ifdef HAVE_SENDMMSG
+  responses.d_fd = -1;
+#endif /* HAVE_SENDMMSG */
+#else
+  ssize_t len;
+  char data[1500];
+  ComboAddress fromaddr;
+  struct msghdr msgh;
+  struct iovec iov;
+  char cbuf[256];
+
+  fromaddr.sin6.sin6_family=AF_INET6; // this makes sure fromaddr is big enough
+  fillMSGHdr(&msgh, &iov, cbuf, sizeof(cbuf), data, sizeof(data), &fromaddr);
+
+  for(;;)
+  if((len=recvmsg(fd, &msgh, 0)) >= 0) {
+    if(!handleNewUDPDatagram(fd, data, (size_t)len, fromaddr, &msgh))
+      return;
   }
   else {
     // cerr<<t_id<<" had error: "<<stringerror()<<endl;
@@ -1811,6 +2032,7 @@ static void handleNewUDPQuestion(int fd, FDMultiplexer::funcparam_t& var)
       g_stats.noPacketError++;
     break;
   }
+#endif /* HAVE_RECVMMSG */
 }
 
 static void makeTCPServerSockets(unsigned int threadId)
@@ -2018,8 +2240,8 @@ static void doStats(void)
       (int)((cacheHits*100.0)/(cacheHits+cacheMisses))<<"% cache hits"<<endl;
 
     L<<Logger::Notice<<"stats: throttle map: "
-      << broadcastAccFunction<uint64_t>(pleaseGetThrottleSize) <<", ns speeds: "
-      << broadcastAccFunction<uint64_t>(pleaseGetNsSpeedsSize)<<endl;
+      << SyncRes::s_throttle.size() <<", ns speeds: "
+      << SyncRes::s_nsSpeeds.size()<<endl;
     L<<Logger::Notice<<"stats: outpacket/query ratio "<<(int)(SyncRes::s_outqueries*100.0/SyncRes::s_queries)<<"%";
     L<<Logger::Notice<<", "<<(int)(SyncRes::s_throttledqueries*100.0/(SyncRes::s_outqueries+SyncRes::s_throttledqueries))<<"% throttled, "
      <<SyncRes::s_nodelegated<<" no-delegation drops"<<endl;
@@ -2066,13 +2288,11 @@ static void houseKeeping(void *)
 
       t_sstorage->negcache.prune(::arg().asNum("max-cache-entries") / (g_numWorkerThreads * 10));
 
-      if(!((cleanCounter++)%40)) {  // this is a full scan!
+      if(!((cleanCounter++)%40) && t_id == 0) {  // this is a full scan! the speeds are shared, so only do it from one thread
 	time_t limit=now.tv_sec-300;
-	for(SyncRes::nsspeeds_t::iterator i = t_sstorage->nsSpeeds.begin() ; i!= t_sstorage->nsSpeeds.end(); )
-	  if(i->second.stale(limit))
-	    t_sstorage->nsSpeeds.erase(i++);
-	  else
-	    ++i;
+	SyncRes::s_nsSpeeds.eraseIf([limit](const DNSName&, const SyncRes::DecayingEwmaCollection& collection) {
+	    return collection.stale(limit);
+	  });
       }
       last_prune=time(0);
     }
@@ -2398,9 +2618,12 @@ static void handleUDPServerResponse(int fd, FDMultiplexer::funcparam_t& var)
     t_udpclientsocks->returnSocket(fd);
     string empty;
 
-    MT_t::waiters_t::iterator iter=MT->d_waiters.find(pid);
-    if(iter != MT->d_waiters.end())
+    auto& hashedIndex=MT->d_waiters.get<HashedKeyTag>();
+    auto hashedIter=hashedIndex.find(pid);
+    if(hashedIter != hashedIndex.end()) {
+      MT_t::waiters_t::iterator iter=MT->d_waiters.project<0>(hashedIter);
       doResends(iter, pid, empty);
+    }
 
     MT->sendEvent(pid, &empty); // this denotes error (does lookup again.. at least L1 will be hot)
     return;
@@ -2437,8 +2660,10 @@ static void handleUDPServerResponse(int fd, FDMultiplexer::funcparam_t& var)
   string packet;
   packet.assign(data, len);
 
-  MT_t::waiters_t::iterator iter=MT->d_waiters.find(pident);
-  if(iter != MT->d_waiters.end()) {
+  auto& hashedIndex=MT->d_waiters.get<HashedKeyTag>();
+  auto hashedIter=hashedIndex.find(pident);
+  if(hashedIter != hashedIndex.end()) {
+    MT_t::waiters_t::iterator iter=MT->d_waiters.project<0>(hashedIter);
     doResends(iter, pident, packet);
   }
 
@@ -2465,9 +2690,14 @@ retryWithName:
     if(g_logCommonErrors) {
       L<<Logger::Warning<<"Discarding unexpected packet from "<<fromaddr.toStringWithPort()<<": "<< (pident.domain.empty() ? "<empty>" : pident.domain.toString())<<", "<<pident.type<<", "<<MT->d_waiters.size()<<" waiters"<<endl;
     }
+    if(t_udpclientsocks->isIdle(fd)) {
+      // nothing should be sent to an idle socket, don't keep using a port that might be known
+      g_stats.udpIdleSocketUnexpected++;
+      t_udpclientsocks->returnSocket(fd);
+    }
   }
   else if(fd >= 0) {
-    t_udpclientsocks->returnSocket(fd);
+    t_udpclientsocks->recycleSocket(fd);
   }
 }
 
@@ -2829,6 +3059,8 @@ static int serviceMain(int argc, char*argv[])
   g_numWorkerThreads = ::arg().asNum("threads");
   g_numThreads = g_numWorkerThreads + g_weDistributeQueries;
   g_maxMThreads = ::arg().asNum("max-mthreads");
+  g_udpSourcePortMaxUses = std::max(::arg().asNum("udp-source-port-max-uses"), 1);
+  g_udpSourcePortLifetime = ::arg().asNum("udp-source-port-lifetime");
 
   g_gettagNeedsEDNSOptions = ::arg().mustDo("gettag-needs-edns-options");
 
@@ -2998,7 +3230,7 @@ try
     t_servfailqueryring->set_capacity(ringsize);
   }
 
-  MT=new MTasker<PacketID,string>(::arg().asNum("stack-size"));
+  MT=new MTasker<PacketID,string>(::arg().asNum("stack-size"), ::arg().asNum("stack-cache-size"));
 
   PacketID pident;
 
@@ -3125,6 +3357,7 @@ int main(int argc, char **argv)
 
   try {
     ::arg().set("stack-size","stack size per mthread")="200000";
+    ::arg().set("stack-cache-size","Number of stacks of finished mthreads to keep around for reuse, per thread")="100";
     ::arg().set("soa-minimum-ttl","Don't change")="0";
     ::arg().set("no-shuffle","Don't change")="off";
     ::arg().set("local-port","port to listen on")="53";
@@ -3214,6 +3447,8 @@ int main(int argc, char **argv)
     ::arg().setSwitch( "lowercase-outgoing","Force outgoing questions to lowercase")="no";
     ::arg().setSwitch("gettag-needs-edns-options", "If EDNS Options should be extracted before calling the gettag() hook")="no";
     ::arg().set("udp-truncation-threshold", "Maximum UDP response size before we truncate")="1680";
+    ::arg().set("udp-source-port-max-uses", "Maximum number of queries sent from the same outgoing UDP socket, 1 means a new socket for every query")="1";
+    ::arg().set("udp-source-port-lifetime", "Maximum number of seconds an outgoing UDP socket can be reused for")="60";
     ::arg().set("edns-outgoing-bufsize", "Outgoing EDNS buffer size")="1680";
     ::arg().set("minimum-ttl-override", "Set under adverse conditions, a minimum TTL")="0";
     ::arg().set("max-qperq", "Maximum outgoing queries per query")="50";
@@ -136,6 +136,13 @@ void RecordTextReader::xfrIP(uint32_t &val)
 
 
 void RecordTextReader::xfrIP6(std::string &val)
+{
+  uint8_t tmpbuf[16];
+  xfrIP6(tmpbuf);
+  val = std::string((char*)tmpbuf, sizeof(tmpbuf));
+}
+
+void RecordTextReader::xfrIP6(uint8_t (&val)[16])
 {
   struct in6_addr tmpbuf;
 
@@ -157,7 +164,7 @@ void RecordTextReader::xfrIP6(std::string &val)
     throw RecordTextException("while parsing IPv6 address: '" + address + "' is invalid");
   }
 
-  val = std::string((char*)tmpbuf.s6_addr, 16);
+  memcpy(val, tmpbuf.s6_addr, sizeof(val));
 
   d_pos += len;
 }
@@ -474,15 +481,20 @@ void RecordTextWriter::xfrIP(const uint32_t& val)
 
 void RecordTextWriter::xfrIP6(const std::string& val)
 {
-  char tmpbuf[16];
+  uint8_t tmpbuf[16];
+  memset(tmpbuf, 0, sizeof(tmpbuf));
+  val.copy((char*)tmpbuf, sizeof(tmpbuf));
+  xfrIP6(tmpbuf);
+}
+
+void RecordTextWriter::xfrIP6(const uint8_t (&val)[16])
+{
   char addrbuf[40];
 
   if(!d_string.empty())
    d_string.append(1,' ');
-  
-  val.copy(tmpbuf,16);
 
-  if (inet_ntop(AF_INET6, tmpbuf, addrbuf, sizeof addrbuf) == NULL)
+  if (inet_ntop(AF_INET6, val, addrbuf, sizeof addrbuf) == NULL)
     throw RecordTextException("Unable to convert to ipv6 address");
   
   d_string += std::string(addrbuf);
@@ -48,6 +48,7 @@ public:
   void xfrType(uint16_t& val);
   void xfrIP(uint32_t& val);
   void xfrIP6(std::string& val);
+  void xfrIP6(uint8_t (&val)[16]);
   void xfrTime(uint32_t& val);
 
   void xfrName(DNSName& val, bool compress=false, bool noDot=false);
@@ -78,6 +79,7 @@ public:
   void xfr8BitInt(const uint8_t& val);
   void xfrIP(const uint32_t& val);
   void xfrIP6(const std::string& val);
+  void xfrIP6(const uint8_t (&val)[16]);
   void xfrTime(const uint32_t& val);
   void xfrBase32HexBlob(const string& val);
 
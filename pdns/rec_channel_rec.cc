@@ -194,11 +194,6 @@ static uint64_t* pleaseDump(int fd)
   return new uint64_t(t_RC->doDump(fd) + dumpNegCache(t_sstorage->negcache, fd) + t_packetCache->doDump(fd));
 }
 
-static uint64_t* pleaseDumpNSSpeeds(int fd)
-{
-  return new uint64_t(t_RC->doDumpNSSpeeds(fd));
-}
-
 template<typename T>
 string doDumpNSSpeeds(T begin, T end)
 {
@@ -213,7 +208,7 @@ string doDumpNSSpeeds(T begin, T end)
     return "Error opening dump file for writing: "+string(strerror(errno))+"\n";
   uint64_t total = 0;
   try {
-    total = broadcastAccFunction<uint64_t>(boost::bind(pleaseDumpNSSpeeds, fd));
+    total = SyncRes::doDumpNSSpeeds(fd);
   }
   catch(...){}
 
@@ -619,14 +614,9 @@ static string doCurrentQueries()
   return broadcastAccFunction<string>(pleaseGetCurrentQueries);
 }
 
-uint64_t* pleaseGetThrottleSize()
-{
-  return new uint64_t(t_sstorage ? t_sstorage->throttle.size() : 0);
-}
-
 static uint64_t getThrottleSize()
 {
-  return broadcastAccFunction<uint64_t>(pleaseGetThrottleSize);
+  return SyncRes::s_throttle.size();
 }
 
 uint64_t* pleaseGetNegCacheSize()
@@ -640,24 +630,14 @@ uint64_t getNegCacheSize()
   return broadcastAccFunction<uint64_t>(pleaseGetNegCacheSize);
 }
 
-uint64_t* pleaseGetFailedHostsSize()
-{
-  uint64_t tmp=(t_sstorage ? t_sstorage->fails.size() : 0);
-  return new uint64_t(tmp);
-}
 uint64_t getFailedHostsSize()
 {
-  return broadcastAccFunction<uint64_t>(pleaseGetFailedHostsSize);
-}
-
-uint64_t* pleaseGetNsSpeedsSize()
-{
-  return new uint64_t(t_sstorage ? t_sstorage->nsSpeeds.size() : 0);
+  return SyncRes::s_fails.size();
 }
 
 uint64_t getNsSpeedsSize()
 {
-  return broadcastAccFunction<uint64_t>(pleaseGetNsSpeedsSize);
+  return SyncRes::s_nsSpeeds.size();
 }
 
 uint64_t* pleaseGetConcurrentQueries()
@@ -858,6 +838,8 @@ RecursorControlParser::RecursorControlParser()
   addGetStat("throttled-out", &SyncRes::s_throttledqueries);
   addGetStat("unreachables", &SyncRes::s_unreachables);
   addGetStat("chain-resends", &g_stats.chainResends);
+  addGetStat("udp-sockets-reused", &g_stats.udpSocketsReused);
+  addGetStat("udp-idle-socket-unexpected", &g_stats.udpIdleSocketUnexpected);
   addGetStat("tcp-clients", boost::bind(TCPConnection::getCurrentConnections));
 
 #ifdef __linux__
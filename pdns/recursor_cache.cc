@@ -19,16 +19,17 @@ unsigned int MemRecursorCache::size()
   return (unsigned int)d_cache.size();
 }
 
-// this function is too slow to poll!
-unsigned int MemRecursorCache::bytes()
+size_t MemRecursorCache::CacheEntry::computeBytes() const
 {
-  unsigned int ret=0;
-
-  for(cache_t::const_iterator i=d_cache.begin(); i!=d_cache.end(); ++i) {
-    ret+=sizeof(struct CacheEntry);
-    ret+=(unsigned int)i->d_qname.toString().length();
-    for(auto j=i->d_records.begin(); j!= i->d_records.end(); ++j)
-      ret+= sizeof(*j); // XXX WRONG we don't know the stored size! j->size();
+  size_t ret=sizeof(*this);
+  ret+=d_qname.getStorage().heapSize();
+  ret+=d_records.capacity() * sizeof(records_t::value_type);
+  ret+=d_signatures.capacity() * sizeof(decltype(d_signatures)::value_type);
+  for(const auto& record : d_records) {
+    ret+=record->serialize(d_qname).size();
+  }
+  for(const auto& signature : d_signatures) {
+    ret+=signature->serialize(d_qname).size();
   }
   return ret;
 }
@@ -42,7 +43,7 @@ int32_t MemRecursorCache::get(time_t now, const DNSName &qname, const QType& qt,
   if(!d_cachecachevalid || d_cachedqname!= qname) {
     //    cerr<<"had cache cache miss"<<endl;
     d_cachedqname=qname;
-    d_cachecache=d_cache.equal_range(tie(qname));
+    d_cachecache=d_cache.get<NameOnlyHashedTag>().equal_range(qname);
     d_cachecachevalid=true;
   }
   //  else cerr<<"had cache cache hit!"<<endl;
@@ -52,13 +53,13 @@ int32_t MemRecursorCache::get(time_t now, const DNSName &qname, const QType& qt,
 
   bool haveSubnetSpecific=false;
   if(d_cachecache.first!=d_cachecache.second) {
-    for(cache_t::const_iterator i=d_cachecache.first; i != d_cachecache.second; ++i) {
+    for(auto i=d_cachecache.first; i != d_cachecache.second; ++i) {
       if(!i->d_netmask.empty()) {
 	//	cout<<"Had a subnet specific hit: "<<i->d_netmask.toString()<<", query was for "<<who.toString()<<": match "<<i->d_netmask.match(who)<<endl;
 	haveSubnetSpecific=true;
       }
     }
-    for(cache_t::const_iterator i=d_cachecache.first; i != d_cachecache.second; ++i)
+    for(auto i=d_cachecache.first; i != d_cachecache.second; ++i)
       if(i->d_ttd > now && ((i->d_qtype == qt.getCode() || qt.getCode()==QType::ANY ||
 			    (qt.getCode()==QType::ADDR && (i->d_qtype == QType::A || i->d_qtype == QType::AAAA) )) 
 			    && (!haveSubnetSpecific || i->d_netmask.match(who)))
@@ -82,10 +83,11 @@ int32_t MemRecursorCache::get(time_t now, const DNSName &qname, const QType& qt,
 	if(signatures)  // if you do an ANY lookup you are hosed XXXX
 	  *signatures=i->d_signatures;
         if(res) {
+          auto firstIndexIterator = d_cache.project<OrderedTag>(i);
           if(res->empty())
-            moveCacheItemToFront(d_cache, i);
+            moveCacheItemToFront(d_cache, firstIndexIterator);
           else
-            moveCacheItemToBack(d_cache, i);
+            moveCacheItemToBack(d_cache, firstIndexIterator);
         }
         if(qt.getCode()!=QType::ANY && qt.getCode()!=QType::ADDR) // normally if we have a hit, we are done
           break;
@@ -158,6 +160,7 @@ void MemRecursorCache::replace(time_t now, const DNSName &qname, const QType& qt
     }
   }
   ce.d_records.clear();
+  ce.d_records.reserve(content.size());
 
   // limit TTL of auth->auth NSset update if needed, except for root 
   if(ce.d_auth && auth && qt.getCode()==QType::NS && !isNew && !qname.isRoot()) {
@@ -187,6 +190,9 @@ void MemRecursorCache::replace(time_t now, const DNSName &qname, const QType& qt
   if (!isNew) {
     moveCacheItemToBack(d_cache, stored);
   }
+  d_bytes -= stored->d_bytes;
+  ce.d_bytes = static_cast<uint32_t>(ce.computeBytes());
+  d_bytes += ce.d_bytes;
   d_cache.replace(stored, ce);
 }
 
@@ -194,16 +200,18 @@ int MemRecursorCache::doWipeCache(const DNSName& name, bool sub, uint16_t qtype)
 {
   int count=0;
   d_cachecachevalid=false;
-  pair<cache_t::iterator, cache_t::iterator> range;
 
   if(!sub) {
-    if(qtype==0xffff)
-      range=d_cache.equal_range(tie(name));
-    else
-      range=d_cache.equal_range(tie(name, qtype));
-    for(cache_t::const_iterator i=range.first; i != range.second; ) {
-      count++;
-      d_cache.erase(i++);
+    auto& idx = d_cache.get<NameOnlyHashedTag>();
+    auto range = idx.equal_range(name);
+    for(auto i=range.first; i != range.second; ) {
+      if(i->d_qtype == qtype || qtype == 0xffff) {
+        count++;
+        d_bytes -= i->d_bytes;
+        idx.erase(i++);
+      }
+      else
+        ++i;
     }
   }
   else {
@@ -212,6 +220,7 @@ int MemRecursorCache::doWipeCache(const DNSName& name, bool sub, uint16_t qtype)
 	break;
       if(iter->d_qtype == qtype || qtype == 0xffff) {
 	count++;
+	d_bytes -= iter->d_bytes;
 	d_cache.erase(iter++);
       }
       else 
@@ -249,29 +258,6 @@ bool MemRecursorCache::doAgeCache(time_t now, const DNSName& name, uint16_t qtyp
   return false;
 }
 
-uint64_t MemRecursorCache::doDumpNSSpeeds(int fd)
-{
-  FILE* fp=fdopen(dup(fd), "w");
-  if(!fp)
-    return 0;
-  fprintf(fp, "; nsspeed dump from thread follows\n;\n");
-  uint64_t count=0;
-
-  for(SyncRes::nsspeeds_t::iterator i = t_sstorage->nsSpeeds.begin() ; i!= t_sstorage->nsSpeeds.end(); ++i)
-  {
-    count++;
-    fprintf(fp, "%s -> ", i->first.toString().c_str());
-    for(SyncRes::DecayingEwmaCollection::collection_t::iterator j = i->second.d_collection.begin(); j!= i->second.d_collection.end(); ++j)
-    {
-      // typedef vector<pair<ComboAddress, DecayingEwma> > collection_t;
-      fprintf(fp, "%s/%f ", j->first.toString().c_str(), j->second.peek());
-    }
-    fprintf(fp, "\n");
-  }
-  fclose(fp);
-  return count;
-}
-
 uint64_t MemRecursorCache::doDump(int fd)
 {
   FILE* fp=fdopen(dup(fd), "w");
@@ -303,5 +289,7 @@ void MemRecursorCache::doPrune(void)
   d_cachecachevalid=false;
 
   unsigned int maxCached=::arg().asNum("max-cache-entries") / g_numThreads;
-  pruneCollection(d_cache, maxCached);
+  pruneCollection(d_cache, maxCached, 1000, [this](const CacheEntry& entry) {
+      d_bytes -= entry.d_bytes;
+    });
 }
@@ -33,6 +33,7 @@
 #undef L
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
@@ -52,14 +53,17 @@ public:
     cacheHits = cacheMisses = 0;
   }
   unsigned int size();
-  unsigned int bytes();
+  //! Approximation of the memory used by the entries, kept up to date on every change
+  uint64_t bytes() const
+  {
+    return d_bytes;
+  }
   int32_t get(time_t, const DNSName &qname, const QType& qt, vector<DNSRecord>* res, const ComboAddress& who, vector<std::shared_ptr<RRSIGRecordContent>>* signatures=0);
 
   void replace(time_t, const DNSName &qname, const QType& qt,  const vector<DNSRecord>& content, const vector<shared_ptr<RRSIGRecordContent>>& signatures, bool auth, boost::optional<Netmask> ednsmask=boost::optional<Netmask>());
   void doPrune(void);
   void doSlash(int perc);
   uint64_t doDump(int fd);
-  uint64_t doDumpNSSpeeds(int fd);
 
   int doWipeCache(const DNSName& name, bool sub, uint16_t qtype=0xffff);
   bool doAgeCache(time_t now, const DNSName& name, uint16_t qtype, uint32_t newTTL);
@@ -73,6 +77,9 @@ private:
       d_qname(key.get<0>()), d_qtype(key.get<1>()), d_auth(auth), d_ttd(0), d_records(records), d_netmask(key.get<2>())
     {}
 
+    //! Approximation of the memory used by this entry, rdata is counted in its wire format
+    size_t computeBytes() const;
+
     typedef vector<std::shared_ptr<DNSRecordContent>> records_t;
     vector<std::shared_ptr<RRSIGRecordContent>> d_signatures;
     time_t getTTD() const
@@ -83,15 +90,23 @@ private:
     DNSName d_qname; 
     uint16_t d_qtype;
     bool d_auth;
+    uint32_t d_bytes{0}; //!< computeBytes() as of the last replace(), fits in what would be padding
     time_t d_ttd;
     records_t d_records;
     Netmask d_netmask;
   };
 
+  struct OrderedTag {};
+  struct SequencedTag {};
+  struct NameOnlyHashedTag {};
+
+  /* The ordered index is only needed for subtree wipes (doWipeCache with sub=true),
+     exact lookups go through the hashed index on the name and do not have to
+     perform the costly canonical comparisons. */
   typedef multi_index_container<
     CacheEntry,
     indexed_by <
-                ordered_unique<
+                ordered_unique<tag<OrderedTag>,
                       composite_key< 
                         CacheEntry,
                         member<CacheEntry,DNSName,&CacheEntry::d_qname>,
@@ -100,12 +115,17 @@ private:
                       >,
 		  composite_key_compare<CanonDNSNameCompare, std::less<uint16_t>, std::less<Netmask> >
                 >,
-               sequenced<>
+               sequenced<tag<SequencedTag> >,
+               hashed_non_unique<tag<NameOnlyHashedTag>,
+                        member<CacheEntry,DNSName,&CacheEntry::d_qname>
+               >
                >
   > cache_t;
+  typedef cache_t::index<NameOnlyHashedTag>::type::iterator hashed_iterator_t;
 
   cache_t d_cache;
-  pair<cache_t::iterator, cache_t::iterator> d_cachecache;
+  uint64_t d_bytes{0}; //!< sum of d_bytes of all entries
+  pair<hashed_iterator_t, hashed_iterator_t> d_cachecache;
   DNSName d_cachedqname;
   bool d_cachecachevalid;
   bool attemptToRefreshNSTTL(const QType& qt, const vector<DNSRecord>& content, const CacheEntry& stored);
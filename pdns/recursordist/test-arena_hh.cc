@@ -0,0 +1 @@
+../test-arena_hh.cc
\ No newline at end of file
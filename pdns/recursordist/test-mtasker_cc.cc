@@ -0,0 +1 @@
+../test-mtasker_cc.cc
\ No newline at end of file
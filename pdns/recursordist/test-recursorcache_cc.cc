@@ -0,0 +1,85 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+#include <boost/test/unit_test.hpp>
+
+#include "arguments.hh"
+#include "dnsrecords.hh"
+#include "recursor_cache.hh"
+
+static void store(MemRecursorCache& cache, const DNSName& name, time_t ttd, const std::vector<std::string>& addresses)
+{
+  std::vector<DNSRecord> records;
+  for (const auto& address : addresses) {
+    DNSRecord dr;
+    dr.d_name = name;
+    dr.d_type = QType::A;
+    dr.d_class = QClass::IN;
+    dr.d_ttl = static_cast<uint32_t>(ttd);
+    dr.d_place = DNSResourceRecord::ANSWER;
+    dr.d_content = std::make_shared<ARecordContent>(ComboAddress(address));
+    records.push_back(dr);
+  }
+  cache.replace(ttd, name, QType(QType::A), records, std::vector<std::shared_ptr<RRSIGRecordContent>>(), true);
+}
+
+BOOST_AUTO_TEST_SUITE(recursorcache_cc)
+
+BOOST_AUTO_TEST_CASE(test_RecursorCacheBytes) {
+  MemRecursorCache cache;
+  time_t now = time(nullptr);
+  BOOST_CHECK_EQUAL(cache.bytes(), 0U);
+
+  store(cache, DNSName("www.powerdns.com."), now + 3600, {"192.0.2.1"});
+  const uint64_t www = cache.bytes();
+  BOOST_CHECK_GT(www, 0U);
+
+  store(cache, DNSName("mail.powerdns.com."), now + 3600, {"192.0.2.2", "192.0.2.3"});
+  const uint64_t mail = cache.bytes() - www;
+  BOOST_CHECK_GT(mail, www);
+
+  store(cache, DNSName("powerdns.net."), now + 3600, {"192.0.2.4"});
+  const uint64_t net = cache.bytes() - www - mail;
+  BOOST_CHECK_GT(net, 0U);
+  BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+  /* storing the same content again does not count the entry twice */
+  store(cache, DNSName("powerdns.net."), now + 3600, {"192.0.2.4"});
+  BOOST_CHECK_EQUAL(cache.bytes(), www + mail + net);
+
+  BOOST_CHECK_EQUAL(cache.doWipeCache(DNSName("www.powerdns.com."), false), 1);
+  BOOST_CHECK_EQUAL(cache.bytes(), mail + net);
+
+  BOOST_CHECK_EQUAL(cache.doWipeCache(DNSName("powerdns.com."), true), 1);
+  BOOST_CHECK_EQUAL(cache.bytes(), net);
+
+  BOOST_CHECK_EQUAL(cache.doWipeCache(DNSName("powerdns.net."), false, QType::AAAA), 0);
+  BOOST_CHECK_EQUAL(cache.bytes(), net);
+  BOOST_CHECK_EQUAL(cache.doWipeCache(DNSName("powerdns.net."), false), 1);
+  BOOST_CHECK_EQUAL(cache.bytes(), 0U);
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_RecursorCacheBytesAfterPrune) {
+  MemRecursorCache cache;
+  time_t now = time(nullptr);
+
+  /* expired entries are pruned first, then the oldest ones until the cache fits */
+  store(cache, DNSName("expired.powerdns.com."), now - 1, {"192.0.2.1"});
+  for (size_t idx = 0; idx < 10; idx++) {
+    store(cache, DNSName("host" + std::to_string(idx) + ".powerdns.com."), now + 3600, {"192.0.2.1"});
+  }
+  BOOST_CHECK_EQUAL(cache.size(), 11U);
+  const uint64_t all = cache.bytes();
+
+  ::arg().set("max-cache-entries", "") = "5";
+  cache.doPrune();
+  BOOST_CHECK_EQUAL(cache.size(), 5U);
+  BOOST_CHECK_LT(cache.bytes(), all);
+
+  ::arg().set("max-cache-entries", "") = "0";
+  cache.doPrune();
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+  BOOST_CHECK_EQUAL(cache.bytes(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
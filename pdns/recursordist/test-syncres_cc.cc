@@ -165,10 +165,10 @@ static void initSR(std::unique_ptr<SyncRes>& sr, bool edns0, bool dnssec, SyncRe
   sr->setLogMode(lm);
   t_sstorage->domainmap = g_initialDomainMap;
   t_sstorage->negcache.clear();
-  t_sstorage->nsSpeeds.clear();
-  t_sstorage->ednsstatus.clear();
-  t_sstorage->throttle.clear();
-  t_sstorage->fails.clear();
+  SyncRes::s_nsSpeeds.clear();
+  SyncRes::s_ednsstatus.clear();
+  SyncRes::s_throttle.clear();
+  SyncRes::s_fails.clear();
   t_sstorage->dnssecmap.clear();
 }
 
@@ -313,7 +313,7 @@ BOOST_AUTO_TEST_CASE(test_root_not_primed_and_no_response) {
   BOOST_CHECK(downServers.size() > 0);
   /* we explicitly refuse to mark the root servers down */
   for (const auto& server : downServers) {
-    BOOST_CHECK_EQUAL(t_sstorage->fails.value(server), 0);
+    BOOST_CHECK_EQUAL(SyncRes::s_fails.value(server), 0);
   }
 }
 
@@ -355,8 +355,10 @@ BOOST_AUTO_TEST_CASE(test_edns_formerr_fallback) {
   BOOST_CHECK_EQUAL(ret.size(), 1);
   BOOST_CHECK_EQUAL(queriesWithEDNS, 1);
   BOOST_CHECK_EQUAL(queriesWithoutEDNS, 1);
-  BOOST_CHECK_EQUAL(t_sstorage->ednsstatus.size(), 1);
-  BOOST_CHECK_EQUAL(t_sstorage->ednsstatus[noEDNSServer].mode, SyncRes::EDNSStatus::NOEDNS);
+  BOOST_CHECK_EQUAL(SyncRes::s_ednsstatus.size(), 1);
+  SyncRes::EDNSStatus status;
+  BOOST_REQUIRE(SyncRes::s_ednsstatus.get(noEDNSServer, status));
+  BOOST_CHECK_EQUAL(status.mode, SyncRes::EDNSStatus::NOEDNS);
 }
 
 BOOST_AUTO_TEST_CASE(test_edns_notimp_fallback) {
@@ -465,8 +467,8 @@ BOOST_AUTO_TEST_CASE(test_all_nss_down) {
   BOOST_CHECK_EQUAL(downServers.size(), 4);
 
   for (const auto& server : downServers) {
-    BOOST_CHECK_EQUAL(t_sstorage->fails.value(server), 1);
-    BOOST_CHECK(t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
+    BOOST_CHECK_EQUAL(SyncRes::s_fails.value(server), 1);
+    BOOST_CHECK(SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
   }
 }
 
@@ -513,8 +515,8 @@ BOOST_AUTO_TEST_CASE(test_all_nss_network_error) {
   BOOST_CHECK_EQUAL(downServers.size(), 4);
 
   for (const auto& server : downServers) {
-    BOOST_CHECK_EQUAL(t_sstorage->fails.value(server), 1);
-    BOOST_CHECK(t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
+    BOOST_CHECK_EQUAL(SyncRes::s_fails.value(server), 1);
+    BOOST_CHECK(SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
   }
 }
 
@@ -569,8 +571,8 @@ BOOST_AUTO_TEST_CASE(test_os_limit_errors) {
 
   /* Error is reported as "OS limit error" (-2) so the servers should _NOT_ be marked down */
   for (const auto& server : downServers) {
-    BOOST_CHECK_EQUAL(t_sstorage->fails.value(server), 0);
-    BOOST_CHECK(!t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
+    BOOST_CHECK_EQUAL(SyncRes::s_fails.value(server), 0);
+    BOOST_CHECK(!SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(server, target, QType::A)));
   }
 }
 
@@ -1125,7 +1127,7 @@ BOOST_AUTO_TEST_CASE(test_throttled_server) {
     });
 
   /* mark ns as down */
-  t_sstorage->throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), SyncRes::s_serverdownthrottletime, 10000);
+  SyncRes::s_throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), SyncRes::s_serverdownthrottletime, 10000);
 
   vector<DNSRecord> ret;
   int res = sr->beginResolve(target, QType(QType::A), QClass::IN, ret);
@@ -1146,14 +1148,14 @@ BOOST_AUTO_TEST_CASE(test_throttled_server_count) {
 
   const size_t blocks = 10;
   /* mark ns as down for 'blocks' queries */
-  t_sstorage->throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), SyncRes::s_serverdownthrottletime, blocks);
+  SyncRes::s_throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), SyncRes::s_serverdownthrottletime, blocks);
 
   for (size_t idx = 0; idx < blocks; idx++) {
-    BOOST_CHECK(t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
+    BOOST_CHECK(SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
   }
 
   /* we have been throttled 'blocks' times, we should not be throttled anymore */
-  BOOST_CHECK(!t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
+  BOOST_CHECK(!SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
 }
 
 BOOST_AUTO_TEST_CASE(test_throttled_server_time) {
@@ -1167,13 +1169,13 @@ BOOST_AUTO_TEST_CASE(test_throttled_server_time) {
 
   const size_t seconds = 1;
   /* mark ns as down for 'seconds' seconds */
-  t_sstorage->throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), seconds, 10000);
-  BOOST_CHECK(t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
+  SyncRes::s_throttle.throttle(time(nullptr), boost::make_tuple(ns, "", 0), seconds, 10000);
+  BOOST_CHECK(SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
 
   sleep(seconds + 1);
 
   /* we should not be throttled anymore */
-  BOOST_CHECK(!t_sstorage->throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
+  BOOST_CHECK(!SyncRes::s_throttle.shouldThrottle(time(nullptr), boost::make_tuple(ns, "", 0)));
 }
 
 BOOST_AUTO_TEST_CASE(test_dont_query_server) {
@@ -1449,12 +1451,12 @@ BOOST_AUTO_TEST_CASE(test_ns_speed) {
 
   /* make pdns-public-ns2.powerdns.com. the fastest NS, with its IPv6 address faster than the IPV4 one,
      then pdns-public-ns1.powerdns.com. on IPv4 */
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns1.powerdns.com.")].submit(ComboAddress("192.0.2.1:53"), 100, &now);
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns1.powerdns.com.")].submit(ComboAddress("[2001:DB8::1]:53"), 10000, &now);
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns2.powerdns.com.")].submit(ComboAddress("192.0.2.2:53"), 10, &now);
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns2.powerdns.com.")].submit(ComboAddress("[2001:DB8::2]:53"), 1, &now);
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns3.powerdns.com.")].submit(ComboAddress("192.0.2.3:53"), 10000, &now);
-  t_sstorage->nsSpeeds[DNSName("pdns-public-ns3.powerdns.com.")].submit(ComboAddress("[2001:DB8::3]:53"), 10000, &now);
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns1.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("192.0.2.1:53"), 100, &now); });
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns1.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("[2001:DB8::1]:53"), 10000, &now); });
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns2.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("192.0.2.2:53"), 10, &now); });
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns2.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("[2001:DB8::2]:53"), 1, &now); });
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns3.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("192.0.2.3:53"), 10000, &now); });
+  SyncRes::s_nsSpeeds.modify(DNSName("pdns-public-ns3.powerdns.com."), [&now](SyncRes::DecayingEwmaCollection& collection) { collection.submit(ComboAddress("[2001:DB8::3]:53"), 10000, &now); });
 
   vector<DNSRecord> ret;
   int res = sr->beginResolve(target, QType(QType::A), QClass::IN, ret);
@@ -5,6 +5,7 @@
 #include "qtype.hh"
 #include "dnspacket.hh"
 #include "auth-caches.hh"
+#include "auth-ixfrjournal.hh"
 #include "statbag.hh"
 #include "dnsseckeeper.hh"
 #include "base64.hh"
@@ -824,6 +825,7 @@ int PacketHandler::processUpdate(DNSPacket *p) {
     L<<Logger::Error<<msgPrefix<<"Backend for domain "<<p->qdomain<<" does not support transaction. Can't do Update packet."<<endl;
     return RCode::NotImp;
   }
+  IXFRJournalRecorder journal(di.backend, di.zone, di.id);
 
   // 3.2.1 and 3.2.2 - Prerequisite check
   for(MOADNSParser::answers_t::const_iterator i=mdp.d_answers.begin(); i != mdp.d_answers.end(); ++i) {
@@ -926,6 +928,7 @@ int PacketHandler::processUpdate(DNSPacket *p) {
           }
         }
 
+        journal.touch(rr->d_name, QType(rr->d_type));
         if (rr->d_class == QClass::NONE  && rr->d_type == QType::NS && rr->d_name == di.zone)
           nsRRtoDelete.push_back(rr);
         else
@@ -956,10 +959,12 @@ int PacketHandler::processUpdate(DNSPacket *p) {
     }
 
     if (changedRecords > 0) {
+      journal.finish();
       if (!di.backend->commitTransaction()) {
        L<<Logger::Error<<msgPrefix<<"Failed to commit updates!"<<endl;
         return RCode::ServFail;
       }
+      journal.commit();
 
       S.deposit("dnsupdate-changes", changedRecords);
 
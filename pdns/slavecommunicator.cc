@@ -26,6 +26,7 @@
 #include "utility.hh"
 #include "dnssecinfra.hh"
 #include "dnsseckeeper.hh"
+#include "auth-ixfrjournal.hh"
 #include "base32.hh"
 #include <errno.h>
 #include "communicator.hh"
@@ -171,6 +172,15 @@ void CommunicatorClass::ixfrSuck(const DNSName &domain, const TSIGTriplet& tt, c
         di.backend->replaceRRSet(di.id, g.first.first+domain, QType(g.first.second), replacement);
       }
       di.backend->commitTransaction();
+
+      if(g_ixfrJournal.isEnabled()) {
+        vector<DNSRecord> removed(remove), added(add);
+        for(auto& x : removed)
+          x.d_name += domain;
+        for(auto& x : added)
+          x.d_name += domain;
+        g_ixfrJournal.add(domain, removed, added);
+      }
     }
   }
   catch(std::exception& p) {
@@ -283,7 +293,7 @@ static vector<DNSResourceRecord> doAxfr(const ComboAddress& raddr, const DNSName
 }   
 
 
-void CommunicatorClass::suck(const DNSName &domain, const string &remote)
+void CommunicatorClass::suck(const DNSName &domain, const string &remote, std::unique_ptr<UeberBackend>& ub)
 {
   {
     Lock l(&d_lock);
@@ -295,7 +305,7 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
   RemoveSentinel rs(domain, this); // this removes us from d_inprogress when we go out of scope
 
   L<<Logger::Error<<"Initiating transfer of '"<<domain<<"' from remote '"<<remote<<"'"<<endl;
-  UeberBackend B; // fresh UeberBackend
+  UeberBackend& B = *ub; // kept by our retrieval thread
 
   DomainInfo di;
   di.backend=0;
@@ -402,6 +412,7 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
         }
         else {
           L<<Logger::Warning<<"Done with IXFR of '"<<domain<<"' from remote '"<<remote<<"', got "<<zs.numDeltas<<" delta"<<addS(zs.numDeltas)<<", serial now "<<zs.soa_serial<<endl;
+          d_suckdone++;
           return;
         }
       }
@@ -570,8 +581,10 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
     transaction = false;
     di.backend->setFresh(zs.domain_id);
     PC.purge(domain.toString()+"$");
+    g_ixfrJournal.clear(domain); // a full transfer has no delta to offer
 
 
+    d_suckdone++;
     L<<Logger::Error<<"AXFR done for '"<<domain<<"', zone committed with serial number "<<zs.soa_serial<<endl;
     if(::arg().mustDo("slave-renotify"))
       notifyDomain(domain);
@@ -582,6 +595,8 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
       L<<Logger::Error<<"Aborting possible open transaction for domain '"<<domain<<"' AXFR"<<endl;
       di.backend->abortTransaction();
     }
+    d_suckfailed++;
+    ub.reset(); // it may be in an unknown state, the next transfer gets a fresh one
   }
   catch(MOADNSException &re) {
     L<<Logger::Error<<"Unable to parse record during incoming AXFR of '"<<domain<<"' (MOADNSException): "<<re.what()<<endl;
@@ -589,6 +604,8 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
       L<<Logger::Error<<"Aborting possible open transaction for domain '"<<domain<<"' AXFR"<<endl;
       di.backend->abortTransaction();
     }
+    d_suckfailed++;
+    ub.reset();
   }
   catch(std::exception &re) {
     L<<Logger::Error<<"Unable to parse record during incoming AXFR of '"<<domain<<"' (std::exception): "<<re.what()<<endl;
@@ -596,6 +613,8 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
       L<<Logger::Error<<"Aborting possible open transaction for domain '"<<domain<<"' AXFR"<<endl;
       di.backend->abortTransaction();
     }
+    d_suckfailed++;
+    ub.reset();
   }
   catch(ResolverException &re) {
     L<<Logger::Error<<"Unable to AXFR zone '"<<domain<<"' from remote '"<<remote<<"' (resolver): "<<re.reason<<endl;
@@ -603,6 +622,8 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
       L<<Logger::Error<<"Aborting possible open transaction for domain '"<<domain<<"' AXFR"<<endl;
       di.backend->abortTransaction();
     }
+    d_suckfailed++;
+    ub.reset();
   }
   catch(PDNSException &ae) {
     L<<Logger::Error<<"Unable to AXFR zone '"<<domain<<"' from remote '"<<remote<<"' (PDNSException): "<<ae.reason<<endl;
@@ -610,6 +631,8 @@ void CommunicatorClass::suck(const DNSName &domain, const string &remote)
       L<<Logger::Error<<"Aborting possible open transaction for domain '"<<domain<<"' AXFR"<<endl;
       di.backend->abortTransaction();
     }
+    d_suckfailed++;
+    ub.reset();
   }
 }
 namespace {
@@ -6,6 +6,7 @@
 #include "misc.hh"
 #include "dnswriter.hh"
 #include "dnsrecords.hh"
+#include "mtasker.hh"
 #include <fstream>
 
 #ifndef RECURSOR
@@ -265,7 +266,6 @@ vector<uint8_t> makeBigDNSPacketReferral()
   rr.qtype = QType::NS;
   rr.ttl=3600;
   rr.qname=DNSName("com");
-  rr.d_place = DNSResourceRecord::ADDITIONAL;
 
   string gtld="x.gtld-servers.net";
   for(char c='a'; c<= 'm';++c) {
@@ -297,7 +297,7 @@ vector<uint8_t> makeBigDNSPacketReferral()
   DNSPacketWriter pw(packet, DNSName("www.google.com"), QType::A);
   //  shuffle(records);
   for(const auto& rec : records) {
-    pw.startRecord(rec.qname, rec.qtype.getCode(), rec.ttl, 1, rec.d_place);
+    pw.startRecord(rec.qname, rec.qtype.getCode(), rec.ttl, 1, DNSResourceRecord::ADDITIONAL);
     auto drc = DNSRecordContent::mastermake(rec.qtype.getCode(), 1, rec.content);
     drc->toPacket(pw);
     delete drc;
@@ -564,6 +564,57 @@ struct BigDNSPacketRefTest
 };
 
 
+struct AXFRPacketTest
+{
+  explicit AXFRPacketTest(unsigned int records) : d_records(records)
+  {
+    DNSName zone("example.com");
+    for(unsigned int n = 0; n < records; n++) {
+      DNSName name(DNSName("host" + std::to_string(n)) + zone);
+      if(n % 4 == 3) {
+        d_rrs.push_back({name, QType::MX, std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(QType::MX, 1, "10 mail" + std::to_string(n % 10) + ".example.com."))});
+      }
+      else if(n % 4 == 2) {
+        d_rrs.push_back({name, QType::CNAME, std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(QType::CNAME, 1, "host" + std::to_string(n - 1) + ".example.com."))});
+      }
+      else {
+        d_rrs.push_back({name, QType::A, std::shared_ptr<DNSRecordContent>(DNSRecordContent::mastermake(QType::A, 1, "192.0.2." + std::to_string(n % 256)))});
+      }
+    }
+  }
+
+  string getName() const
+  {
+    return "write "+std::to_string(d_records)+" record AXFR packet";
+  }
+
+  void operator()() const
+  {
+    getPacket();
+  }
+
+  vector<uint8_t> getPacket() const
+  {
+    vector<uint8_t> packet;
+    DNSPacketWriter pw(packet, DNSName("example.com"), QType::AXFR);
+    for(const auto& rr : d_rrs) {
+      pw.startRecord(rr.name, rr.qtype);
+      rr.content->toPacket(pw);
+    }
+    pw.commit();
+    return packet;
+  }
+
+  struct RR
+  {
+    DNSName name;
+    uint16_t qtype;
+    std::shared_ptr<DNSRecordContent> content;
+  };
+  unsigned int d_records;
+  vector<RR> d_rrs;
+};
+
 struct TCacheComp
 {
   bool operator()(const pair<string, QType>& a, const pair<string, QType>& b) const
@@ -620,7 +671,6 @@ struct ParsePacketTest
     
       rr.ttl=i->first.d_ttl;
       rr.content=i->first.d_content->getZoneRepresentation();  // this should be the serialised form
-      rr.d_place=(DNSResourceRecord::Place) i->first.d_place;
       lwr.d_result.push_back(rr);
     }
 
@@ -702,6 +752,81 @@ struct DNSNameParseTest
 
 };
 
+struct DNSNameCopyHashTest
+{
+  explicit DNSNameCopyHashTest(const std::string& name) : d_name(name)
+  {
+  }
+
+  string getName() const
+  {
+    return "DNSName copy+hash+countLabels ("+std::to_string(d_name.wirelength())+" bytes)";
+  }
+
+  void operator()() const
+  {
+    DNSName copy(d_name);
+    copy.hash();
+    copy.hash();
+    copy.countLabels();
+  }
+
+  DNSName d_name;
+};
+
+struct DNSNameCaseInsensitiveTest
+{
+  enum Op { Hash, Equals, Less, CanonCompare };
+
+  explicit DNSNameCaseInsensitiveTest(Op op) : d_op(op), d_pos(0)
+  {
+    /* roughly what a resolver sees: mostly short qnames, then a tail of long CDN and tracking names */
+    const unsigned int lengths[] = { 12, 15, 17, 19, 21, 23, 25, 28, 31, 35, 42, 55, 78, 120 };
+    for(unsigned int n = 0; n < 1024; n++) {
+      unsigned int target = lengths[n % (sizeof(lengths) / sizeof(lengths[0]))];
+      DNSName name("example.com");
+      for(unsigned int label = 0; name.wirelength() < target; label++) {
+        name = DNSName((label % 3 ? "Node" : "www-") + std::to_string(n * 31 + label)) + name;
+      }
+      d_names.push_back(name);
+      /* the same name in another case, so the comparisons have to look at every byte */
+      d_others.push_back(DNSName(toUpper(name.toString())));
+    }
+  }
+
+  string getName() const
+  {
+    static const char* ops[] = { "hash", "==", "<", "canonCompare" };
+    return string("DNSName case insensitive ") + ops[d_op] + " (1024 names)";
+  }
+
+  void operator()() const
+  {
+    const DNSName& a = d_names[d_pos % d_names.size()];
+    const DNSName& b = d_others[d_pos % d_others.size()];
+    d_pos++;
+    switch(d_op) {
+    case Hash:
+      g_ret = a.hash(1) == 0; // a non-zero init bypasses the cached value
+      break;
+    case Equals:
+      g_ret = a == b;
+      break;
+    case Less:
+      g_ret = a < b;
+      break;
+    case CanonCompare:
+      g_ret = a.canonCompare(b);
+      break;
+    }
+  }
+
+  Op d_op;
+  vector<DNSName> d_names;
+  vector<DNSName> d_others;
+  mutable unsigned int d_pos;
+};
+
 struct DNSNameRootTest
 {
   string getName() const
@@ -794,6 +919,168 @@ struct B64DecodeTest
 };
 
 
+static void mtaskerNOPThread(void*)
+{
+}
+
+struct MTaskerCreateTest
+{
+  explicit MTaskerCreateTest(size_t cachedStacks) : d_mt(std::make_shared<MTasker<>>(200000, cachedStacks)), d_cachedStacks(cachedStacks) {}
+
+  string getName() const
+  {
+    return (boost::format("mtasker create/run/reap, %d cached stacks") % d_cachedStacks).str();
+  }
+
+  void operator()() const
+  {
+    d_mt->makeThread(mtaskerNOPThread, nullptr);
+    while(d_mt->schedule());
+  }
+
+  std::shared_ptr<MTasker<>> d_mt;
+  size_t d_cachedStacks;
+};
+
+static void mtaskerWaitThread(void* p)
+{
+  auto mt = static_cast<MTasker<>*>(p);
+  int key=0;
+  for(;;) {
+    mt->waitEvent(key);
+  }
+}
+
+struct MTaskerSwitchTest
+{
+  MTaskerSwitchTest() : d_mt(std::make_shared<MTasker<>>(200000))
+  {
+    d_mt->makeThread(mtaskerWaitThread, d_mt.get());
+    while(d_mt->schedule());
+  }
+
+  string getName() const
+  {
+    return "mtasker sendEvent/waitEvent context switch";
+  }
+
+  void operator()() const
+  {
+    d_mt->sendEvent(0);
+  }
+
+  std::shared_ptr<MTasker<>> d_mt;
+};
+
+struct SuffixMatchTreeLookupTest
+{
+  explicit SuffixMatchTreeLookupTest(unsigned int entries, unsigned int parents=1000) : d_entries(entries), d_parents(parents), d_tree(std::make_shared<SuffixMatchTree<bool>>()), d_pos(0)
+  {
+    for(unsigned int n = 0; n < entries; n++) {
+      d_tree->add(DNSName("block" + std::to_string(n) + ".example" + std::to_string(n % parents) + ".com."), true);
+    }
+    for(unsigned int n = 0; n < 1024; n++) {
+      if(n % 2)
+        d_names.push_back(DNSName("www.sub.block" + std::to_string((n * 7919) % entries) + ".example" + std::to_string(((n * 7919) % entries) % parents) + ".com."));
+      else
+        d_names.push_back(DNSName("www.sub.notblocked" + std::to_string(n) + ".example" + std::to_string(n % parents) + ".com."));
+    }
+  }
+
+  string getName() const
+  {
+    return (boost::format("SuffixMatchTree lookup, %d entries below %d parents") % d_entries % d_parents).str();
+  }
+
+  void operator()() const
+  {
+    if(d_tree->lookup(d_names[d_pos++ % d_names.size()]))
+      d_matches++;
+  }
+
+  unsigned int d_entries;
+  unsigned int d_parents;
+  std::shared_ptr<SuffixMatchTree<bool>> d_tree;
+  vector<DNSName> d_names;
+  mutable unsigned int d_pos;
+  mutable unsigned int d_matches{0};
+};
+
+struct SuffixMatchTreeBuildTest
+{
+  // the names are added in a scrambled order, so they don't simply end up behind the last child
+  explicit SuffixMatchTreeBuildTest(unsigned int entries, unsigned int parents) : d_parents(parents)
+  {
+    for(unsigned int n = 0; n < entries; n++) {
+      unsigned int id = (static_cast<uint64_t>(n) * 7919) % entries;
+      d_names.push_back(DNSName("block" + std::to_string(id) + ".example" + std::to_string(id % parents) + ".com."));
+    }
+  }
+
+  string getName() const
+  {
+    return (boost::format("SuffixMatchTree build, %d entries below %d parents") % d_names.size() % d_parents).str();
+  }
+
+  void operator()() const
+  {
+    SuffixMatchTree<bool> tree;
+    for(const auto& name : d_names)
+      tree.add(name, true);
+  }
+
+  unsigned int d_parents;
+  vector<DNSName> d_names;
+};
+
+struct NetmaskTreeLookupTest
+{
+  explicit NetmaskTreeLookupTest(unsigned int entries, bool v6) : d_entries(entries), d_v6(v6), d_tree(std::make_shared<NetmaskTree<bool>>()), d_pos(0)
+  {
+    std::vector<std::pair<Netmask,bool>> prefixes;
+    prefixes.reserve(entries);
+    for(unsigned int n = 0; n < entries; n++) {
+      prefixes.push_back({Netmask(makeAddress(n * 2654435761U), d_v6 ? 48 : 24), true});
+    }
+    d_tree->insert(prefixes.begin(), prefixes.end());
+    for(unsigned int n = 0; n < 1024; n++) {
+      d_addresses.push_back(makeAddress(n * 40503U + (n % 2) * 2654435761U));
+    }
+  }
+
+  ComboAddress makeAddress(uint32_t n) const
+  {
+    ComboAddress ret;
+    if(d_v6) {
+      ret = ComboAddress("2001:db8::");
+      memcpy(ret.sin6.sin6_addr.s6_addr + 2, &n, sizeof(n));
+    }
+    else {
+      ret = ComboAddress("0.0.0.0");
+      ret.sin4.sin_addr.s_addr = n;
+    }
+    return ret;
+  }
+
+  string getName() const
+  {
+    return (boost::format("NetmaskTree IPv%d lookup, %d entries") % (d_v6 ? 6 : 4) % d_entries).str();
+  }
+
+  void operator()() const
+  {
+    if(d_tree->lookup(d_addresses[d_pos++ % d_addresses.size()]))
+      d_matches++;
+  }
+
+  unsigned int d_entries;
+  bool d_v6;
+  std::shared_ptr<NetmaskTree<bool>> d_tree;
+  vector<ComboAddress> d_addresses;
+  mutable unsigned int d_pos;
+  mutable unsigned int d_matches{0};
+};
+
 struct NOPTest
 {
   string getName() const
@@ -828,6 +1115,8 @@ try
   doRun(TypicalRefTest());
   doRun(BigRefTest());
   doRun(BigDNSPacketRefTest());
+  AXFRPacketTest axfr(1000);
+  doRun(axfr);
 
   auto packet = makeEmptyQuery();
   doRun(ParsePacketTest(packet, "empty-query"));
@@ -838,6 +1127,9 @@ try
 
   doRun(ParsePacketTest(packet, "typical-referral"));
 
+  auto axfrPacket = axfr.getPacket();
+  doRun(ParsePacketBareTest(axfrPacket, "1000 record AXFR"));
+
   doRun(SimpleCompressTest("www.france.ds9a.nl"));
 
   
@@ -891,6 +1183,27 @@ try
 
   doRun(DNSNameParseTest());
   doRun(DNSNameRootTest());
+  doRun(DNSNameCopyHashTest("www.powerdns.com"));
+  doRun(DNSNameCopyHashTest("a-longer-name.that-still-fits.inline.example"));
+
+  doRun(DNSNameCaseInsensitiveTest(DNSNameCaseInsensitiveTest::Hash));
+  doRun(DNSNameCaseInsensitiveTest(DNSNameCaseInsensitiveTest::Equals));
+  doRun(DNSNameCaseInsensitiveTest(DNSNameCaseInsensitiveTest::Less));
+  doRun(DNSNameCaseInsensitiveTest(DNSNameCaseInsensitiveTest::CanonCompare));
+
+  doRun(SuffixMatchTreeLookupTest(1000));
+  doRun(SuffixMatchTreeLookupTest(1000000));
+  doRun(SuffixMatchTreeLookupTest(200000, 1));
+  doRun(SuffixMatchTreeBuildTest(200000, 1000));
+  doRun(SuffixMatchTreeBuildTest(200000, 1));
+
+  doRun(NetmaskTreeLookupTest(1000, false));
+  doRun(NetmaskTreeLookupTest(1000000, false));
+  doRun(NetmaskTreeLookupTest(1000000, true));
+
+  doRun(MTaskerCreateTest(0));
+  doRun(MTaskerCreateTest(100));
+  doRun(MTaskerSwitchTest());
 
   cerr<<"Total runs: " << g_totalRuns<<endl;
 
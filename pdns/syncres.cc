@@ -57,6 +57,10 @@ unsigned int SyncRes::s_packetcachettl;
 unsigned int SyncRes::s_packetcacheservfailttl;
 unsigned int SyncRes::s_serverdownmaxfails;
 unsigned int SyncRes::s_serverdownthrottletime;
+SyncRes::nsspeeds_t SyncRes::s_nsSpeeds;
+SyncRes::ednsstatus_t SyncRes::s_ednsstatus;
+SyncRes::throttle_t SyncRes::s_throttle;
+SyncRes::fails_t SyncRes::s_fails;
 std::atomic<uint64_t> SyncRes::s_queries;
 std::atomic<uint64_t> SyncRes::s_outgoingtimeouts;
 std::atomic<uint64_t> SyncRes::s_outgoing4timeouts;
@@ -140,7 +144,7 @@ int SyncRes::beginResolve(const DNSName &qname, const QType &qtype, uint16_t qcl
   else if(qclass!=QClass::IN)
     return -1;
 
-  set<GetBestNSAnswer> beenthere;
+  beenthere_t beenthere(d_arena);
   int res=doResolve(qname, qtype, ret, 0, beenthere);
   return res;
 }
@@ -328,11 +332,31 @@ void SyncRes::doEDNSDumpAndClose(int fd)
     return;
   }
   fprintf(fp,"IP Address\tMode\tMode last updated at\n");
-  for(const auto& eds : t_sstorage->ednsstatus) {
-    fprintf(fp, "%s\t%d\t%s", eds.first.toString().c_str(), (int)eds.second.mode, ctime(&eds.second.modeSetAt));
-  }
+  s_ednsstatus.visit([fp](const ComboAddress& address, const EDNSStatus& status) {
+      fprintf(fp, "%s\t%d\t%s", address.toString().c_str(), (int)status.mode, ctime(&status.modeSetAt));
+    });
+
+  fclose(fp);
+}
 
+uint64_t SyncRes::doDumpNSSpeeds(int fd)
+{
+  FILE* fp=fdopen(dup(fd), "w");
+  if(!fp)
+    return 0;
+  fprintf(fp, "; nsspeed dump follows\n;\n");
+  uint64_t count=0;
+
+  s_nsSpeeds.visit([fp,&count](const DNSName& name, const DecayingEwmaCollection& collection) {
+      count++;
+      fprintf(fp, "%s -> ", name.toString().c_str());
+      for(const auto& entry : collection.d_collection) {
+        fprintf(fp, "%s/%f ", entry.first.toString().c_str(), entry.second.peek());
+      }
+      fprintf(fp, "\n");
+    });
   fclose(fp);
+  return count;
 }
 
 /* so here is the story. First we complete the full resolution process for a domain name. And only THEN do we decide
@@ -378,16 +402,27 @@ int SyncRes::asyncresolveWrapper(const ComboAddress& ip, bool ednsMANDATORY, con
      If '3', send bare queries
   */
 
-  SyncRes::EDNSStatus* ednsstatus;
-  ednsstatus = &t_sstorage->ednsstatus[ip]; // does this include port? YES
-
-  if(ednsstatus->modeSetAt && ednsstatus->modeSetAt + 3600 < d_now.tv_sec) {
-    *ednsstatus=SyncRes::EDNSStatus();
-    //    cerr<<"Resetting EDNS Status for "<<ip.toString()<<endl);
-  }
+  /* we work on a copy since the status is shared with the other threads and we are going to yield,
+     it is written back once we have learned something */
+  SyncRes::EDNSStatus ednsstatus;
+  s_ednsstatus.modify(ip, [this,&ednsstatus](EDNSStatus& status) { // does this include port? YES
+      if(status.modeSetAt && status.modeSetAt + 3600 < d_now.tv_sec) {
+        status=SyncRes::EDNSStatus();
+        //    cerr<<"Resetting EDNS Status for "<<ip.toString()<<endl);
+      }
+      ednsstatus = status;
+    });
 
-  SyncRes::EDNSStatus::EDNSMode& mode=ednsstatus->mode;
+  SyncRes::EDNSStatus::EDNSMode& mode=ednsstatus.mode;
   SyncRes::EDNSStatus::EDNSMode oldmode = mode;
+  const time_t oldModeSetAt = ednsstatus.modeSetAt;
+  auto storeStatus = [&ip,&ednsstatus,oldmode,oldModeSetAt]() {
+    if(ednsstatus.mode != oldmode || ednsstatus.modeSetAt != oldModeSetAt) {
+      s_ednsstatus.modify(ip, [&ednsstatus](EDNSStatus& status) {
+          status = ednsstatus;
+        });
+    }
+  };
   int EDNSLevel=0;
   auto luaconfsLocal = g_luaconfs.getLocal();
   ResolveContext ctx;
@@ -413,10 +448,12 @@ int SyncRes::asyncresolveWrapper(const ComboAddress& ip, bool ednsMANDATORY, con
       ret=asyncresolve(ip, domain, type, doTCP, sendRDQuery, EDNSLevel, now, srcmask, ctx, luaconfsLocal->outgoingProtobufServer, res);
     }
     if(ret < 0) {
+      storeStatus();
       return ret; // transport error, nothing to learn here
     }
 
     if(ret == 0) { // timeout, not doing anything with it now
+      storeStatus();
       return ret;
     }
     else if(mode==EDNSStatus::UNKNOWN || mode==EDNSStatus::EDNSOK || mode == EDNSStatus::EDNSIGNORANT ) {
@@ -437,11 +474,13 @@ int SyncRes::asyncresolveWrapper(const ComboAddress& ip, bool ednsMANDATORY, con
       }
       
     }
-    if(oldmode != mode || !ednsstatus->modeSetAt)
-      ednsstatus->modeSetAt=d_now.tv_sec;
+    if(oldmode != mode || !ednsstatus.modeSetAt)
+      ednsstatus.modeSetAt=d_now.tv_sec;
     //    cerr<<"Result: ret="<<ret<<", EDNS-level: "<<EDNSLevel<<", haveEDNS: "<<res->d_haveEDNS<<", new mode: "<<mode<<endl;  
+    storeStatus();
     return ret;
   }
+  storeStatus();
   return ret;
 }
 
@@ -454,7 +493,7 @@ int SyncRes::asyncresolveWrapper(const ComboAddress& ip, bool ednsMANDATORY, con
  * \param beenthere
  * \return DNS RCODE or -1 (Error) or -2 (RPZ hit)
  */
-int SyncRes::doResolve(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, set<GetBestNSAnswer>& beenthere)
+int SyncRes::doResolve(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, beenthere_t& beenthere)
 {
   string prefix;
   if(doLog()) {
@@ -519,7 +558,7 @@ int SyncRes::doResolve(const DNSName &qname, const QType &qtype, vector<DNSRecor
   DNSName subdomain(qname);
   if(qtype == QType::DS) subdomain.chopOff();
 
-  NsSet nsset;
+  NsSet nsset(d_arena);
   bool flawedNSSet=false;
 
   // the two retries allow getBestNSNamesFromCache&co to reprime the root
@@ -550,7 +589,7 @@ static bool ipv6First(const ComboAddress& a, const ComboAddress& b)
 
 /** This function explicitly goes out for A or AAAA addresses
 */
-vector<ComboAddress> SyncRes::getAddrs(const DNSName &qname, unsigned int depth, set<GetBestNSAnswer>& beenthere)
+vector<ComboAddress> SyncRes::getAddrs(const DNSName &qname, unsigned int depth, beenthere_t& beenthere)
 {
   typedef vector<DNSRecord> res_t;
   res_t res;
@@ -608,14 +647,18 @@ vector<ComboAddress> SyncRes::getAddrs(const DNSName &qname, unsigned int depth,
     random_shuffle(ret.begin(), ret.end(), dns_random);
 
     // move 'best' address for this nameserver name up front
-    nsspeeds_t::iterator best = t_sstorage->nsSpeeds.find(qname);
+    ComboAddress best;
+    bool haveBest = s_nsSpeeds.update(qname, [&best](DecayingEwmaCollection& collection) {
+        best = collection.d_best;
+        return true;
+      });
 
-    if(best != t_sstorage->nsSpeeds.end())
+    if(haveBest)
       for(ret_t::iterator i=ret.begin(); i != ret.end(); ++i) {
-        if(*i==best->second.d_best) {  // got the fastest one
+        if(*i==best) {  // got the fastest one
           if(i!=ret.begin()) {
             *i=*ret.begin();
-            *ret.begin()=best->second.d_best;
+            *ret.begin()=best;
           }
           break;
         }
@@ -625,7 +668,7 @@ vector<ComboAddress> SyncRes::getAddrs(const DNSName &qname, unsigned int depth,
   return ret;
 }
 
-void SyncRes::getBestNSFromCache(const DNSName &qname, const QType& qtype, vector<DNSRecord>& bestns, bool* flawedNSSet, unsigned int depth, set<GetBestNSAnswer>& beenthere)
+void SyncRes::getBestNSFromCache(const DNSName &qname, const QType& qtype, vector<DNSRecord>& bestns, bool* flawedNSSet, unsigned int depth, beenthere_t& beenthere)
 {
   string prefix;
   DNSName subdomain(qname);
@@ -677,7 +720,7 @@ void SyncRes::getBestNSFromCache(const DNSName &qname, const QType& qtype, vecto
           LOG(prefix<<qname<<": We have NS in cache for '"<<subdomain<<"' but part of LOOP (already seen "<<answer.qname<<")! Trying less specific NS"<<endl);
 	  ;
           if(doLog())
-            for( set<GetBestNSAnswer>::const_iterator j=beenthere.begin();j!=beenthere.end();++j) {
+            for( beenthere_t::const_iterator j=beenthere.begin();j!=beenthere.end();++j) {
 	      bool neo = !(*j< answer || answer<*j);
 	      LOG(prefix<<qname<<": beenthere"<<(neo?"*":"")<<": "<<j->qname<<"|"<<DNSRecordContent::NumberToType(j->qtype)<<" ("<<(unsigned int)j->bestns.size()<<")"<<endl);
             }
@@ -713,7 +756,7 @@ SyncRes::domainmap_t::const_iterator SyncRes::getBestAuthZone(DNSName* qname) co
 }
 
 /** doesn't actually do the work, leaves that to getBestNSFromCache */
-DNSName SyncRes::getBestNSNamesFromCache(const DNSName &qname, const QType& qtype, NsSet& nsset, bool* flawedNSSet, unsigned int depth, set<GetBestNSAnswer>&beenthere)
+DNSName SyncRes::getBestNSNamesFromCache(const DNSName &qname, const QType& qtype, NsSet& nsset, bool* flawedNSSet, unsigned int depth, beenthere_t& beenthere)
 {
   DNSName subdomain(qname);
   DNSName authdomain(qname);
@@ -782,7 +825,7 @@ bool SyncRes::doCNAMECacheCheck(const DNSName &qname, const QType &qtype, vector
 	}
 
         if(qtype != QType::CNAME) { // perhaps they really wanted a CNAME!
-          set<GetBestNSAnswer>beenthere;
+          beenthere_t beenthere(d_arena);
           res=doResolve(std::dynamic_pointer_cast<CNAMERecordContent>(j->d_content)->getTarget(), qtype, ret, depth+1, beenthere);
         }
         else
@@ -938,7 +981,9 @@ inline vector<DNSName> SyncRes::shuffleInSpeedOrder(NsSet &tnameservers, const s
 
   for(const auto& val: rnameservers) {
     double speed;
-    speed=t_sstorage->nsSpeeds[val].get(&d_now);
+    s_nsSpeeds.modify(val, [this,&speed](DecayingEwmaCollection& collection) {
+        speed=collection.get(&d_now);
+      });
     speeds[val]=speed;
   }
   random_shuffle(rnameservers.begin(),rnameservers.end(), dns_random);
@@ -1052,7 +1097,7 @@ bool SyncRes::nameserverIPBlockedByRPZ(const DNSFilterEngine& dfe, const ComboAd
   return false;
 }
 
-vector<ComboAddress> SyncRes::retrieveAddressesForNS(const std::string& prefix, const DNSName& qname, vector<DNSName >::const_iterator& tns, const unsigned int depth, set<GetBestNSAnswer>& beenthere, const vector<DNSName >& rnameservers, NsSet& nameservers, bool& sendRDQuery, bool& pierceDontQuery, bool& flawedNSSet)
+vector<ComboAddress> SyncRes::retrieveAddressesForNS(const std::string& prefix, const DNSName& qname, vector<DNSName >::const_iterator& tns, const unsigned int depth, beenthere_t& beenthere, const vector<DNSName >& rnameservers, NsSet& nameservers, bool& sendRDQuery, bool& pierceDontQuery, bool& flawedNSSet)
 {
   vector<ComboAddress> result;
 
@@ -1080,12 +1125,12 @@ bool SyncRes::throttledOrBlocked(const std::string& prefix, const ComboAddress&
 {
   extern NetmaskGroup* g_dontQuery;
 
-  if(t_sstorage->throttle.shouldThrottle(d_now.tv_sec, boost::make_tuple(remoteIP, "", 0))) {
+  if(s_throttle.shouldThrottle(d_now.tv_sec, boost::make_tuple(remoteIP, "", 0))) {
     LOG(prefix<<qname<<": server throttled "<<endl);
     s_throttledqueries++; d_throttledqueries++;
     return true;
   }
-  else if(t_sstorage->throttle.shouldThrottle(d_now.tv_sec, boost::make_tuple(remoteIP, qname, qtype.getCode()))) {
+  else if(s_throttle.shouldThrottle(d_now.tv_sec, boost::make_tuple(remoteIP, qname, qtype.getCode()))) {
     LOG(prefix<<qname<<": query throttled "<<endl);
     s_throttledqueries++; d_throttledqueries++;
     return true;
@@ -1114,8 +1159,8 @@ RCode::rcodes_ SyncRes::updateCacheFromRecords(const std::string& prefix, LWResu
       return tie(name, type) < tie(rhs.name, rhs.type);
     }
   };
-  typedef map<CacheKey, CachePair> tcache_t;
-  tcache_t tcache;
+  typedef map<CacheKey, CachePair, std::less<CacheKey>, ArenaAllocator<pair<const CacheKey, CachePair> > > tcache_t;
+  tcache_t tcache(d_arena);
 
   for(const auto& rec : lwr.d_records) {
     if(rec.d_type == QType::RRSIG) {
@@ -1319,7 +1364,7 @@ bool SyncRes::processRecords(const std::string& prefix, const DNSName& qname, co
  */
 int SyncRes::doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, const DNSName &qname, const QType &qtype,
                          vector<DNSRecord>&ret,
-                         unsigned int depth, set<GetBestNSAnswer>&beenthere)
+                         unsigned int depth, beenthere_t& beenthere)
 {
   auto luaconfsLocal = g_luaconfs.getLocal();
   string prefix;
@@ -1454,16 +1499,18 @@ int SyncRes::doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, con
               }
 
               if(resolveret!=-2) { // don't account for resource limits, they are our own fault
-		t_sstorage->nsSpeeds[*tns].submit(*remoteIP, 1000000, &d_now); // 1 sec
+		s_nsSpeeds.modify(*tns, [this,&remoteIP](DecayingEwmaCollection& collection) {
+                    collection.submit(*remoteIP, 1000000, &d_now); // 1 sec
+                  });
 
 		// code below makes sure we don't filter COM or the root
-                if (s_serverdownmaxfails > 0 && (auth != g_rootdnsname) && t_sstorage->fails.incr(*remoteIP) >= s_serverdownmaxfails) {
+                if (s_serverdownmaxfails > 0 && (auth != g_rootdnsname) && s_fails.incr(*remoteIP) >= s_serverdownmaxfails) {
                   LOG(prefix<<qname<<": Max fails reached resolving on "<< remoteIP->toString() <<". Going full throttle for "<< s_serverdownthrottletime <<" seconds" <<endl);
-                  t_sstorage->throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, "", 0), s_serverdownthrottletime, 10000); // mark server as down
+                  s_throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, "", 0), s_serverdownthrottletime, 10000); // mark server as down
                 } else if(resolveret==-1)
-                  t_sstorage->throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 60, 100); // unreachable, 1 minute or 100 queries
+                  s_throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 60, 100); // unreachable, 1 minute or 100 queries
                 else
-                  t_sstorage->throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 10, 5);  // timeout
+                  s_throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 10, 5);  // timeout
               }
               continue;
             }
@@ -1472,17 +1519,17 @@ int SyncRes::doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, con
 
             if(lwr.d_rcode==RCode::ServFail || lwr.d_rcode==RCode::Refused) {
               LOG(prefix<<qname<<": "<<*tns<<" ("<<remoteIP->toString()<<") returned a "<< (lwr.d_rcode==RCode::ServFail ? "ServFail" : "Refused") << ", trying sibling IP or NS"<<endl);
-              t_sstorage->throttle.throttle(d_now.tv_sec,boost::make_tuple(*remoteIP, qname, qtype.getCode()),60,3); // servfail or refused
+              s_throttle.throttle(d_now.tv_sec,boost::make_tuple(*remoteIP, qname, qtype.getCode()),60,3); // servfail or refused
               continue;
             }
 
             if(s_serverdownmaxfails > 0)
-              t_sstorage->fails.clear(*remoteIP);
+              s_fails.clear(*remoteIP);
 
             break;  // this IP address worked!
           wasLame:; // well, it didn't
             LOG(prefix<<qname<<": status=NS "<<*tns<<" ("<< remoteIP->toString() <<") is lame for '"<<auth<<"', trying sibling IP or NS"<<endl);
-            t_sstorage->throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 60, 100); // lame
+            s_throttle.throttle(d_now.tv_sec, boost::make_tuple(*remoteIP, qname, qtype.getCode()), 60, 100); // lame
           }
         }
 
@@ -1506,7 +1553,9 @@ int SyncRes::doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, con
         */
         //        cout<<"msec: "<<lwr.d_usec/1000.0<<", "<<g_avgLatency/1000.0<<'\n';
 
-        t_sstorage->nsSpeeds[*tns].submit(*remoteIP, lwr.d_usec, &d_now);
+        s_nsSpeeds.modify(*tns, [this,&remoteIP,&lwr](DecayingEwmaCollection& collection) {
+            collection.submit(*remoteIP, lwr.d_usec, &d_now);
+          });
       }
 
       if(s_minimumTTL) {
@@ -1544,7 +1593,7 @@ int SyncRes::doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, con
         }
         LOG(prefix<<qname<<": status=got a CNAME referral, starting over with "<<newtarget<<endl);
 
-        set<GetBestNSAnswer> beenthere2;
+        beenthere_t beenthere2(d_arena);
         return doResolve(newtarget, qtype, ret, depth + 1, beenthere2);
       }
       if(lwr.d_rcode==RCode::NXDomain) {
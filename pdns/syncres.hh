@@ -28,6 +28,7 @@
 #include <vector>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <cmath>
 #include <iostream>
@@ -43,12 +44,15 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/optional.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
+#include <boost/functional/hash.hpp>
 #include "mtasker.hh"
 #include "iputils.hh"
 #include "validate.hh"
 #include "ednssubnet.hh"
 #include "filterpo.hh"
 #include "negcache.hh"
+#include "lock.hh"
+#include "arena.hh"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -63,15 +67,160 @@ void primeHints(void);
 
 class RecursorLua4;
 
+/* only lives for the duration of a single resolution, so its nodes come from the arena of the SyncRes */
 typedef map<
   DNSName,
   pair<
     vector<ComboAddress>,
     bool
-  >
+  >,
+  std::less<DNSName>,
+  ArenaAllocator<pair<const DNSName, pair<vector<ComboAddress>, bool> > >
 > NsSet;
 
-template<class Thing> class Throttle : public boost::noncopyable
+/** A hash map split in shards, each one protected by its own lock, so that it can be
+    shared by all the worker threads without them all contending on a single lock.
+    Values are never handed out by reference, they can only be accessed with the
+    shard lock held, via the functors passed to the methods below.
+*/
+template<class Key, class Value, class Hash=std::hash<Key>, class KeyEqual=std::equal_to<Key> > class ShardedMap : public boost::noncopyable
+{
+public:
+  explicit ShardedMap(size_t shards=128) : d_shards(shards)
+  {
+  }
+
+  //! Calls f(Value&) on the entry for key, creating it first if needed
+  template<typename F> void modify(const Key& key, F f)
+  {
+    Shard& shard = getShard(key);
+    Lock l(&shard.d_mut);
+    f(shard.d_map[key]);
+  }
+
+  //! Calls f(Value&) on the entry for key if it exists, and removes it if f returns false. Returns true if the entry exists and was kept
+  template<typename F> bool update(const Key& key, F f)
+  {
+    Shard& shard = getShard(key);
+    Lock l(&shard.d_mut);
+    auto it = shard.d_map.find(key);
+    if(it == shard.d_map.end()) {
+      return false;
+    }
+    if(!f(it->second)) {
+      shard.d_map.erase(it);
+      return false;
+    }
+    return true;
+  }
+
+  //! Copies the entry for key to value, returns false if there is no such entry
+  bool get(const Key& key, Value& value) const
+  {
+    const Shard& shard = getShard(key);
+    Lock l(&shard.d_mut);
+    auto it = shard.d_map.find(key);
+    if(it == shard.d_map.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+
+  void erase(const Key& key)
+  {
+    Shard& shard = getShard(key);
+    Lock l(&shard.d_mut);
+    shard.d_map.erase(key);
+  }
+
+  //! Removes all entries for which pred(const Key&, const Value&) returns true, returns the number of removed entries
+  template<typename P> uint64_t eraseIf(P pred)
+  {
+    uint64_t erased = 0;
+    for(auto& shard : d_shards) {
+      Lock l(&shard.d_mut);
+      for(auto it = shard.d_map.begin(); it != shard.d_map.end(); ) {
+        if(pred(it->first, it->second)) {
+          it = shard.d_map.erase(it);
+          erased++;
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+    return erased;
+  }
+
+  //! Calls f(const Key&, const Value&) for every entry, one shard at a time
+  template<typename F> void visit(F f) const
+  {
+    for(const auto& shard : d_shards) {
+      Lock l(&shard.d_mut);
+      for(const auto& entry : shard.d_map) {
+        f(entry.first, entry.second);
+      }
+    }
+  }
+
+  size_t size() const
+  {
+    size_t ret = 0;
+    for(const auto& shard : d_shards) {
+      Lock l(&shard.d_mut);
+      ret += shard.d_map.size();
+    }
+    return ret;
+  }
+
+  void clear()
+  {
+    for(auto& shard : d_shards) {
+      Lock l(&shard.d_mut);
+      shard.d_map.clear();
+    }
+  }
+
+private:
+  struct Shard
+  {
+    Shard()
+    {
+      pthread_mutex_init(&d_mut, nullptr);
+    }
+    ~Shard()
+    {
+      pthread_mutex_destroy(&d_mut);
+    }
+    std::unordered_map<Key, Value, Hash, KeyEqual> d_map;
+    mutable pthread_mutex_t d_mut;
+  };
+
+  Shard& getShard(const Key& key)
+  {
+    return d_shards[Hash()(key) % d_shards.size()];
+  }
+
+  const Shard& getShard(const Key& key) const
+  {
+    return d_shards[Hash()(key) % d_shards.size()];
+  }
+
+  vector<Shard> d_shards;
+};
+
+struct ComboAddressHash
+{
+  size_t operator()(const ComboAddress& ca) const
+  {
+    size_t seed = ComboAddress::addressOnlyHash()(ca);
+    boost::hash_combine(seed, ca.sin4.sin_port);
+    return seed;
+  }
+};
+
+template<class Thing, class Hash=std::hash<Thing> > class Throttle : public boost::noncopyable
 {
 public:
   Throttle()
@@ -85,36 +234,27 @@ public:
     if(now > d_last_clean + 300 ) {
 
       d_last_clean=now;
-      for(typename cont_t::iterator i=d_cont.begin();i!=d_cont.end();) {
-        if( i->second.ttd < now) {
-          d_cont.erase(i++);
-        }
-        else
-          ++i;
-      }
-    }
-
-    typename cont_t::iterator i=d_cont.find(t);
-    if(i==d_cont.end())
-      return false;
-    if(now > i->second.ttd || i->second.count == 0) {
-      d_cont.erase(i);
-      return false;
+      d_cont.eraseIf([now](const Thing&, const entry& e) {
+          return e.ttd < now;
+        });
     }
-    i->second.count--;
 
-    return true; // still listed, still blocked
+    return d_cont.update(t, [now](entry& e) {
+        if(now > e.ttd || e.count == 0) {
+          return false;
+        }
+        e.count--;
+        return true; // still listed, still blocked
+      });
   }
   void throttle(time_t now, const Thing& t, time_t ttl=0, unsigned int tries=0)
   {
-    typename cont_t::iterator i=d_cont.find(t);
     entry e={ now+(ttl ? ttl : d_ttl), tries ? tries : d_limit};
 
-    if(i==d_cont.end()) {
-      d_cont[t]=e;
-    }
-    else if(i->second.ttd > e.ttd || (i->second.count) < e.count)
-      d_cont[t]=e;
+    d_cont.modify(t, [&e](entry& existing) {
+        if(existing.ttd == 0 || existing.ttd > e.ttd || existing.count < e.count)
+          existing=e;
+      });
   }
 
   unsigned int size() const
@@ -129,13 +269,13 @@ public:
 private:
   unsigned int d_limit;
   time_t d_ttl;
-  time_t d_last_clean;
+  std::atomic<time_t> d_last_clean;
   struct entry
   {
     time_t ttd;
     unsigned int count;
   };
-  typedef map<Thing,entry> cont_t;
+  typedef ShardedMap<Thing,entry,Hash> cont_t;
   cont_t d_cont;
 };
 
@@ -214,7 +354,7 @@ private:
   bool d_needinit;
 };
 
-template<class Thing> class Counters : public boost::noncopyable
+template<class Thing, class Hash=std::hash<Thing> > class Counters : public boost::noncopyable
 {
 public:
   Counters()
@@ -222,44 +362,32 @@ public:
   }
   unsigned long value(const Thing& t) const
   {
-    typename cont_t::const_iterator i=d_cont.find(t);
-
-    if(i==d_cont.end()) {
-      return 0;
-    }
-    return (unsigned long)i->second;
+    unsigned long ret=0;
+    d_cont.get(t, ret);
+    return ret;
   }
   unsigned long incr(const Thing& t)
   {
-    typename cont_t::iterator i=d_cont.find(t);
-
-    if(i==d_cont.end()) {
-      d_cont[t]=1;
-      return 1;
-    }
-    else {
-      if (i->second < std::numeric_limits<unsigned long>::max())
-        i->second++;
-      return (unsigned long)i->second;
-   }
+    unsigned long ret=0;
+    d_cont.modify(t, [&ret](unsigned long& value) {
+        if (value < std::numeric_limits<unsigned long>::max())
+          value++;
+        ret=value;
+      });
+    return ret;
   }
   unsigned long decr(const Thing& t)
   {
-    typename cont_t::iterator i=d_cont.find(t);
-
-    if(i!=d_cont.end() && --i->second == 0) {
-      d_cont.erase(i);
-      return 0;
-    } else
-      return (unsigned long)i->second;
+    unsigned long ret=0;
+    d_cont.update(t, [&ret](unsigned long& value) {
+        ret=--value;
+        return ret != 0;
+      });
+    return ret;
   }
   void clear(const Thing& t)
   {
-    typename cont_t::iterator i=d_cont.find(t);
-
-    if(i!=d_cont.end()) {
-      d_cont.erase(i);
-    }
+    d_cont.erase(t);
   }
   void clear()
   {
@@ -270,7 +398,7 @@ public:
     return d_cont.size();
   }
 private:
-  typedef map<Thing,unsigned long> cont_t;
+  typedef ShardedMap<Thing,unsigned long,Hash> cont_t;
   cont_t d_cont;
 };
 
@@ -464,7 +592,7 @@ public:
     ComboAddress d_best;
   };
 
-  typedef map<DNSName, DecayingEwmaCollection> nsspeeds_t;  
+  typedef ShardedMap<DNSName, DecayingEwmaCollection> nsspeeds_t;
 
   struct EDNSStatus
   {
@@ -473,7 +601,7 @@ public:
     time_t modeSetAt;
   };
 
-  typedef map<ComboAddress, EDNSStatus> ednsstatus_t;
+  typedef ShardedMap<ComboAddress, EDNSStatus, ComboAddressHash> ednsstatus_t;
 
   static bool s_noEDNSPing;
   static bool s_noEDNS;
@@ -501,9 +629,20 @@ public:
   typedef map<DNSName, AuthDomain> domainmap_t;
 
 
-  typedef Throttle<boost::tuple<ComboAddress,DNSName,uint16_t> > throttle_t;
+  struct ThrottleKeyHash
+  {
+    size_t operator()(const boost::tuple<ComboAddress,DNSName,uint16_t>& key) const
+    {
+      size_t seed = ComboAddressHash()(key.get<0>());
+      boost::hash_combine(seed, key.get<1>().hash());
+      boost::hash_combine(seed, key.get<2>());
+      return seed;
+    }
+  };
+
+  typedef Throttle<boost::tuple<ComboAddress,DNSName,uint16_t>, ThrottleKeyHash> throttle_t;
 
-  typedef Counters<ComboAddress> fails_t;
+  typedef Counters<ComboAddress, ComboAddressHash> fails_t;
 
   static unsigned int s_maxnegttl;
   static unsigned int s_maxcachettl;
@@ -516,11 +655,16 @@ public:
   static bool s_nopacketcache;
   static string s_serverID;
 
+  /* infrastructure state, shared by all the worker threads so that what one
+     of them learns about an authoritative server benefits all the others */
+  static nsspeeds_t s_nsSpeeds;
+  static ednsstatus_t s_ednsstatus;
+  static throttle_t s_throttle;
+  static fails_t s_fails;
+
+  static uint64_t doDumpNSSpeeds(int fd);
+
   struct StaticStorage {
-    nsspeeds_t nsSpeeds;
-    ednsstatus_t ednsstatus;
-    throttle_t throttle;
-    fails_t fails;
     domainmap_t* domainmap;
     map<DNSName, bool> dnssecmap;
     NegCache negcache;
@@ -528,25 +672,26 @@ public:
 
 private:
   struct GetBestNSAnswer;
+  typedef set<GetBestNSAnswer, std::less<GetBestNSAnswer>, ArenaAllocator<GetBestNSAnswer> > beenthere_t;
   int doResolveAt(NsSet &nameservers, DNSName auth, bool flawedNSSet, const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret,
-                  unsigned int depth, set<GetBestNSAnswer>&beenthere);
-  int doResolve(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, set<GetBestNSAnswer>& beenthere);
+                  unsigned int depth, beenthere_t& beenthere);
+  int doResolve(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, beenthere_t& beenthere);
   bool doOOBResolve(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, int &res);
   domainmap_t::const_iterator getBestAuthZone(DNSName* qname) const;
   bool doCNAMECacheCheck(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, int &res);
   bool doCacheCheck(const DNSName &qname, const QType &qtype, vector<DNSRecord>&ret, unsigned int depth, int &res);
-  void getBestNSFromCache(const DNSName &qname, const QType &qtype, vector<DNSRecord>&bestns, bool* flawedNSSet, unsigned int depth, set<GetBestNSAnswer>& beenthere);
-  DNSName getBestNSNamesFromCache(const DNSName &qname, const QType &qtype, NsSet& nsset, bool* flawedNSSet, unsigned int depth, set<GetBestNSAnswer>&beenthere);
+  void getBestNSFromCache(const DNSName &qname, const QType &qtype, vector<DNSRecord>&bestns, bool* flawedNSSet, unsigned int depth, beenthere_t& beenthere);
+  DNSName getBestNSNamesFromCache(const DNSName &qname, const QType &qtype, NsSet& nsset, bool* flawedNSSet, unsigned int depth, beenthere_t& beenthere);
 
   inline vector<DNSName> shuffleInSpeedOrder(NsSet &nameservers, const string &prefix);
   bool moreSpecificThan(const DNSName& a, const DNSName &b) const;
-  vector<ComboAddress> getAddrs(const DNSName &qname, unsigned int depth, set<GetBestNSAnswer>& beenthere);
+  vector<ComboAddress> getAddrs(const DNSName &qname, unsigned int depth, beenthere_t& beenthere);
 
   bool nameserversBlockedByRPZ(const DNSFilterEngine& dfe, const NsSet& nameservers);
   bool nameserverIPBlockedByRPZ(const DNSFilterEngine& dfe, const ComboAddress&);
   bool throttledOrBlocked(const std::string& prefix, const ComboAddress& remoteIP, const DNSName& qname, const QType& qtype, bool pierceDontQuery);
 
-  vector<ComboAddress> retrieveAddressesForNS(const std::string& prefix, const DNSName& qname, vector<DNSName >::const_iterator& tns, const unsigned int depth, set<GetBestNSAnswer>& beenthere, const vector<DNSName >& rnameservers, NsSet& nameservers, bool& sendRDQuery, bool& pierceDontQuery, bool& flawedNSSet);
+  vector<ComboAddress> retrieveAddressesForNS(const std::string& prefix, const DNSName& qname, vector<DNSName >::const_iterator& tns, const unsigned int depth, beenthere_t& beenthere, const vector<DNSName >& rnameservers, NsSet& nameservers, bool& sendRDQuery, bool& pierceDontQuery, bool& flawedNSSet);
   RCode::rcodes_ updateCacheFromRecords(const std::string& prefix, LWResult& lwr, const DNSName& qname, const DNSName& auth, NsSet& nameservers, const DNSName& tns, const boost::optional<Netmask>);
   bool processRecords(const std::string& prefix, const DNSName& qname, const QType& qtype, const DNSName& auth, LWResult& lwr, const bool sendRDQuery, vector<DNSRecord>& ret, set<DNSName>& nsset, DNSName& newtarget, DNSName& newauth, bool& realreferral, bool& negindic, bool& sawDS);
 
@@ -556,6 +701,9 @@ private:
 
   boost::optional<Netmask> getEDNSSubnetMask(const ComboAddress& local, const DNSName&dn, const ComboAddress& rem);
 
+  /* backs the NsSets, beenthere sets and such that only live during a resolution,
+     everything in there is released at once when we are destroyed */
+  Arena d_arena;
   ostringstream d_trace;
   shared_ptr<RecursorLua4> d_pdl;
   boost::optional<const EDNSSubnetOpts&> d_incomingECS;
@@ -642,8 +790,27 @@ struct PacketID
 
     return tie(domain, fd, id) < tie(b.domain, b.fd, b.id);
   }
+
+  bool operator==(const PacketID& b) const
+  {
+    int ourSock= sock ? sock->getHandle() : 0;
+    int bSock = b.sock ? b.sock->getHandle() : 0;
+    return tie(remote, ourSock, type, fd, id) == tie(b.remote, bSock, b.type, b.fd, b.id) && domain == b.domain;
+  }
 };
 
+inline size_t hash_value(const PacketID& pid)
+{
+  size_t seed = pid.domain.hash();
+  boost::hash_combine(seed, ComboAddress::addressOnlyHash()(pid.remote));
+  boost::hash_combine(seed, pid.remote.sin4.sin_port);
+  boost::hash_combine(seed, pid.sock ? pid.sock->getHandle() : 0);
+  boost::hash_combine(seed, pid.type);
+  boost::hash_combine(seed, pid.fd);
+  boost::hash_combine(seed, pid.id);
+  return seed;
+}
+
 struct PacketIDBirthdayCompare: public std::binary_function<PacketID, PacketID, bool>
 {
   bool operator()(const PacketID& a, const PacketID& b) const
@@ -689,6 +856,8 @@ struct RecursorStats
   std::atomic<uint64_t> overCapacityDrops;
   std::atomic<uint64_t> ipv6queries;
   std::atomic<uint64_t> chainResends;
+  std::atomic<uint64_t> udpSocketsReused;
+  std::atomic<uint64_t> udpIdleSocketUnexpected;
   std::atomic<uint64_t> nsSetInvalidations;
   std::atomic<uint64_t> ednsPingMatches;
   std::atomic<uint64_t> ednsPingMismatches;
@@ -766,13 +935,11 @@ int directResolve(const DNSName& qname, const QType& qtype, int qclass, vector<D
 template<class T> T broadcastAccFunction(const boost::function<T*()>& func, bool skipSelf=false);
 
 SyncRes::domainmap_t* parseAuthAndForwards();
-uint64_t* pleaseGetNsSpeedsSize();
 uint64_t* pleaseGetCacheSize();
 uint64_t* pleaseGetNegCacheSize();
 uint64_t* pleaseGetCacheHits();
 uint64_t* pleaseGetCacheMisses();
 uint64_t* pleaseGetConcurrentQueries();
-uint64_t* pleaseGetThrottleSize();
 uint64_t* pleaseGetPacketCacheHits();
 uint64_t* pleaseGetPacketCacheSize();
 uint64_t* pleaseWipeCache(const DNSName& canon, bool subtree=false);
@@ -24,6 +24,7 @@
 #endif
 #include <boost/algorithm/string.hpp>
 #include "auth-packetcache.hh"
+#include "auth-ixfrjournal.hh"
 #include "utility.hh"
 #include "dnssecinfra.hh"
 #include "dnsseckeeper.hh"
@@ -570,6 +571,8 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
     outpacket->d_dnssecOk=true; // RFC 5936, 2.2.5 'SHOULD'
 
   L<<Logger::Error<<"AXFR of domain '"<<target<<"' initiated by "<<q->getRemote()<<endl;
+  DTime xfrTime;
+  xfrTime.set();
 
   // determine if zone exists and AXFR is allowed using existing backend before spawning a new backend.
   SOAData sd;
@@ -759,16 +762,48 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
   }
 
 
+  auto sendChunks = [&](bool final) {
+    for(;;) {
+      outpacket->getRRS() = csp.getChunk(final);
+      if(outpacket->getRRS().empty())
+        break;
+      if(haveTSIGDetails && !tsigkeyname.empty())
+        outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
+      sendPacket(outpacket, outsock);
+      trc.d_mac=outpacket->d_trc.d_mac;
+      outpacket=getFreshAXFRPacket(q);
+    }
+  };
+
   const bool rectify = !(presignedZone || ::arg().mustDo("disable-axfr-rectify"));
   set<DNSName> qnames, nsset, terms;
   vector<DNSZoneRecord> zrrs;
+  int records=0;
+
+  // Signed zones need all names before the first NSEC(3) can be made and
+  // RRsets in one piece for signing, so those are collected and sorted.
+  // Anything else goes out in the order of the backend's list(), which
+  // keeps the memory for an AXFR down to a few chunks.
+  auto addRecord = [&](const DNSZoneRecord& rec) {
+    if(securedZone) {
+      zrrs.push_back(rec);
+      return;
+    }
+    if(rec.dr.d_type == QType::RRSIG || !rec.dr.d_type || rec.dr.d_type == QType::SOA)
+      return;
+    if(::arg().mustDo("direct-dnskey") && (rec.dr.d_type == QType::DNSKEY || rec.dr.d_type == QType::CDNSKEY || rec.dr.d_type == QType::CDS))
+      return;
+    records++;
+    if(csp.submit(rec))
+      sendChunks(false);
+  };
 
   // Add the CDNSKEY and CDS records we created earlier
   for (auto const &synth_zrr : cds)
-    zrrs.push_back(synth_zrr);
+    addRecord(synth_zrr);
 
   for (auto const &synth_zrr : cdnskey)
-    zrrs.push_back(synth_zrr);
+    addRecord(synth_zrr);
 
   while(sd.db->get(zrr)) {
     if(zrr.dr.d_name.isPartOf(target)) {
@@ -785,14 +820,14 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
         for(const auto& ip: ips) {
           zrr.dr.d_type = ip.dr.d_type;
           zrr.dr.d_content = ip.dr.d_content;
-          zrrs.push_back(zrr);
+          addRecord(zrr);
         }
       }
       else {
-        zrrs.push_back(zrr);
+        addRecord(zrr);
       }
 
-      if (rectify) {
+      if (rectify && securedZone) {
         if (zrr.dr.d_type) {
           qnames.insert(zrr.dr.d_name);
           if(zrr.dr.d_type == QType::NS && zrr.dr.d_name!=target)
@@ -887,7 +922,7 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
   unsigned int udiff;
   DTime dt;
   dt.set();
-  int records=0;
+  size_t buffered = zrrs.size();
   for(DNSZoneRecord &zrr :  zrrs) {
     if (zrr.dr.d_type == QType::RRSIG) {
       if(presignedZone && getRR<RRSIGRecordContent>(zrr.dr)->d_type == QType::NSEC3) {
@@ -921,20 +956,8 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
     if(zrr.dr.d_type == QType::SOA)
       continue; // skip SOA - would indicate end of AXFR
 
-    if(csp.submit(zrr)) {
-      for(;;) {
-        outpacket->getRRS() = csp.getChunk();
-        if(!outpacket->getRRS().empty()) {
-          if(haveTSIGDetails && !tsigkeyname.empty())
-            outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
-          sendPacket(outpacket, outsock);
-          trc.d_mac=outpacket->d_trc.d_mac;
-          outpacket=getFreshAXFRPacket(q);
-        }
-        else
-          break;
-      }
-    }
+    if(csp.submit(zrr))
+      sendChunks(false);
   }
   /*
   udiff=dt.udiffNoReset();
@@ -972,20 +995,8 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
           zrr.dr.d_type = QType::NSEC3;
           zrr.dr.d_place = DNSResourceRecord::ANSWER;
           zrr.auth=true;
-          if(csp.submit(zrr)) {
-            for(;;) {
-              outpacket->getRRS() = csp.getChunk();
-              if(!outpacket->getRRS().empty()) {
-                if(haveTSIGDetails && !tsigkeyname.empty())
-                  outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true);
-                sendPacket(outpacket, outsock);
-                trc.d_mac=outpacket->d_trc.d_mac;
-                outpacket=getFreshAXFRPacket(q);
-              }
-              else
-                break;
-            }
-          }
+          if(csp.submit(zrr))
+            sendChunks(false);
         }
       }
     }
@@ -1007,20 +1018,8 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
       zrr.dr.d_type = QType::NSEC;
       zrr.dr.d_place = DNSResourceRecord::ANSWER;
       zrr.auth=true;
-      if(csp.submit(zrr)) {
-        for(;;) {
-          outpacket->getRRS() = csp.getChunk();
-          if(!outpacket->getRRS().empty()) {
-            if(haveTSIGDetails && !tsigkeyname.empty())
-              outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true); 
-            sendPacket(outpacket, outsock);
-            trc.d_mac=outpacket->d_trc.d_mac;
-            outpacket=getFreshAXFRPacket(q);
-          }
-          else
-            break;
-        }
-      }
+      if(csp.submit(zrr))
+        sendChunks(false);
     }
   }
   /*
@@ -1029,18 +1028,7 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
   cerr<<"Outstanding: "<<csp.d_outstanding<<", "<<csp.d_queued - csp.d_signed << endl;
   cerr<<"Ready for consumption: "<<csp.getReady()<<endl;
   * */
-  for(;;) { 
-    outpacket->getRRS() = csp.getChunk(true); // flush the pipe
-    if(!outpacket->getRRS().empty()) {
-      if(haveTSIGDetails && !tsigkeyname.empty())
-        outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, true); // first answer is 'normal'
-      sendPacket(outpacket, outsock);
-      trc.d_mac=outpacket->d_trc.d_mac;
-      outpacket=getFreshAXFRPacket(q);
-    }
-    else 
-      break;
-  }
+  sendChunks(true); // flush the pipe
   
   udiff=dt.udiffNoReset();
   if(securedZone) 
@@ -1057,7 +1045,23 @@ int TCPNameserver::doAXFR(const DNSName &target, shared_ptr<DNSPacket> q, int ou
   sendPacket(outpacket, outsock);
   
   DLOG(L<<"last packet - close"<<endl);
-  L<<Logger::Error<<"AXFR of domain '"<<target<<"' to "<<q->getRemote()<<" finished"<<endl;
+  udiff=xfrTime.udiffNoReset();
+  if(securedZone) {
+    buffered += nsecxrepo.size();
+    S.inc("axfr-out-buffered");
+  }
+  else
+    S.inc("axfr-out-streamed");
+  if(udiff < 1000000)
+    S.inc("axfr-out-duration-0-1");
+  else if(udiff < 10000000)
+    S.inc("axfr-out-duration-1-10");
+  else if(udiff < 100000000)
+    S.inc("axfr-out-duration-10-100");
+  else
+    S.inc("axfr-out-duration-slow");
+
+  L<<Logger::Error<<"AXFR of domain '"<<target<<"' to "<<q->getRemote()<<" finished, "<<records<<" records in "<<udiff/1000<<" ms, "<<buffered<<" held in memory"<<endl;
 
   return 1;
 }
@@ -1146,25 +1150,25 @@ int TCPNameserver::doIXFR(shared_ptr<DNSPacket> q, int outsock)
     return 0;
   }
 
-  string soaedit;
-  dk.getSoaEdit(target, soaedit);
-  if (!rfc1982LessThan(serial, calculateEditSOA(sd, soaedit))) {
-    TSIGRecordContent trc;
-    DNSName tsigkeyname;
-    string tsigsecret;
+  TSIGRecordContent trc;
+  DNSName tsigkeyname;
+  string tsigsecret;
 
-    bool haveTSIGDetails = q->getTSIGDetails(&trc, &tsigkeyname);
+  bool haveTSIGDetails = q->getTSIGDetails(&trc, &tsigkeyname);
 
-    if(haveTSIGDetails && !tsigkeyname.empty()) {
-      string tsig64;
-      DNSName algorithm=trc.d_algoName; // FIXME400: was toLowerCanonic, compare output
-      if (algorithm == DNSName("hmac-md5.sig-alg.reg.int"))
-        algorithm = DNSName("hmac-md5");
-      Lock l(&s_plock);
-      s_P->getBackend()->getTSIGKey(tsigkeyname, &algorithm, &tsig64);
-      B64Decode(tsig64, tsigsecret);
-    }
+  if(haveTSIGDetails && !tsigkeyname.empty()) {
+    string tsig64;
+    DNSName algorithm=trc.d_algoName; // FIXME400: was toLowerCanonic, compare output
+    if (algorithm == DNSName("hmac-md5.sig-alg.reg.int"))
+      algorithm = DNSName("hmac-md5");
+    Lock l(&s_plock);
+    s_P->getBackend()->getTSIGKey(tsigkeyname, &algorithm, &tsig64);
+    B64Decode(tsig64, tsigsecret);
+  }
 
+  string soaedit;
+  dk.getSoaEdit(target, soaedit);
+  if (!rfc1982LessThan(serial, calculateEditSOA(sd, soaedit))) {
     UeberBackend signatureDB;
 
     // SOA *must* go out first, our signing pipe might reorder
@@ -1188,11 +1192,65 @@ int TCPNameserver::doIXFR(shared_ptr<DNSPacket> q, int outsock)
     sendPacket(outpacket, outsock);
 
     L<<Logger::Error<<"IXFR of domain '"<<target<<"' to "<<q->getRemote()<<" finished"<<endl;
+    S.inc("ixfr-out-uptodate");
+
+    return 1;
+  }
+
+  // The journal holds records as the backend has them, so only zones we send
+  // out unchanged can be served from it. Signed zones would need the RRSIGs
+  // and NSEC(3) records that changed along with them.
+  AuthIXFRJournal::deltas_t deltas;
+  if(soaedit.empty() && (!securedZone || dk.isPresigned(target)) && g_ixfrJournal.get(target, serial, sd.serial, deltas)) {
+    DNSResourceRecord soa = makeDNSRRFromSOAData(sd);
+    DNSZoneRecord dzrsoa;
+    dzrsoa.dr=DNSRecord(soa);
+    dzrsoa.auth=true;
+
+    bool first = true;
+    size_t records = 0;
+    auto sendOut = [&]() {
+      if(haveTSIGDetails && !tsigkeyname.empty())
+        outpacket->setTSIGDetails(trc, tsigkeyname, tsigsecret, trc.d_mac, !first);
+      sendPacket(outpacket, outsock);
+      trc.d_mac = outpacket->d_trc.d_mac;
+      outpacket = getFreshAXFRPacket(q);
+      first = false;
+    };
+    auto addRecord = [&](const DNSRecord& rec) {
+      DNSZoneRecord zrr;
+      zrr.dr = rec;
+      zrr.dr.d_place = DNSResourceRecord::ANSWER;
+      zrr.auth = true;
+      outpacket->addRecord(zrr);
+      records++;
+      if(outpacket->getRRS().size() >= 100)
+        sendOut();
+    };
+
+    // RFC 1995, 4: our SOA, then for every change the old SOA, the removed
+    // records, the new SOA and the added records, and our SOA again
+    addRecord(dzrsoa.dr);
+    for(const auto& delta : deltas) {
+      addRecord(delta->oldSOA);
+      for(const auto& rec : delta->removed)
+        addRecord(rec);
+      addRecord(delta->newSOA);
+      for(const auto& rec : delta->added)
+        addRecord(rec);
+    }
+    addRecord(dzrsoa.dr);
+    if(!outpacket->getRRS().empty())
+      sendOut();
+
+    L<<Logger::Error<<"IXFR of domain '"<<target<<"' to "<<q->getRemote()<<" finished from journal, "<<deltas.size()<<" change"<<addS(deltas.size())<<", "<<records<<" records"<<endl;
+    S.inc("ixfr-out-journal");
 
     return 1;
   }
 
   L<<Logger::Error<<"IXFR fallback to AXFR for domain '"<<target<<"' our serial "<<sd.serial<<endl;
+  S.inc("ixfr-out-axfr");
   return doAXFR(q->qdomain, q, outsock);
 }
 
@@ -0,0 +1,87 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arena.hh"
+
+BOOST_AUTO_TEST_SUITE(arena_hh)
+
+BOOST_AUTO_TEST_CASE(test_arena_alignment) {
+  Arena arena;
+  BOOST_CHECK_EQUAL(arena.getBlockCount(), 0);
+
+  for(size_t n = 1; n < 100; n++) {
+    void* ptr = arena.allocate(n, 1);
+    BOOST_REQUIRE(ptr != nullptr);
+    memset(ptr, 0xff, n);
+    void* aligned = arena.allocate(sizeof(uint64_t), alignof(uint64_t));
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(aligned) % alignof(uint64_t), 0);
+  }
+  BOOST_CHECK_EQUAL(arena.getBlockCount(), 1);
+
+  arena.release();
+  BOOST_CHECK_EQUAL(arena.getBlockCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_blocks) {
+  Arena arena;
+
+  /* fill more than one block */
+  for(size_t n = 0; n < 3 * Arena::s_blockSize / 64; n++) {
+    arena.allocate(64, 8);
+  }
+  BOOST_CHECK_GE(arena.getBlockCount(), 3);
+
+  /* larger than a block */
+  char* large = static_cast<char*>(arena.allocate(4 * Arena::s_blockSize, 16));
+  memset(large, 0, 4 * Arena::s_blockSize);
+  size_t count = arena.getBlockCount();
+  BOOST_CHECK_GE(count, 4);
+
+  /* and we can carry on after that */
+  arena.allocate(64, 8);
+  BOOST_CHECK_EQUAL(arena.getBlockCount(), count + 1);
+
+  /* the last allocation can be given back and is handed out again */
+  void* last = arena.allocate(128, 8);
+  arena.deallocate(last, 128);
+  BOOST_CHECK_EQUAL(arena.allocate(128, 8), last);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_containers) {
+  Arena arena;
+  typedef std::map<std::string, std::vector<int>, std::less<std::string>, ArenaAllocator<std::pair<const std::string, std::vector<int> > > > map_t;
+
+  map_t map(arena);
+  for(int n = 0; n < 1000; n++) {
+    map[std::to_string(n)].push_back(n);
+  }
+  BOOST_CHECK_EQUAL(map.size(), 1000);
+  BOOST_CHECK_EQUAL(map["42"].at(0), 42);
+
+  map_t copy(map);
+  BOOST_CHECK(copy.get_allocator() == map.get_allocator());
+  copy.erase("42");
+  BOOST_CHECK_EQUAL(copy.size(), 999);
+  BOOST_CHECK_EQUAL(map.size(), 1000);
+
+  std::vector<uint64_t, ArenaAllocator<uint64_t> > vect(arena);
+  for(uint64_t n = 0; n < 10000; n++) {
+    vect.push_back(n);
+  }
+  BOOST_CHECK_EQUAL(vect.at(9999), 9999);
+
+  Arena other;
+  BOOST_CHECK(ArenaAllocator<int>(arena) != ArenaAllocator<int>(other));
+  BOOST_CHECK(ArenaAllocator<int>(arena) == ArenaAllocator<char>(arena));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
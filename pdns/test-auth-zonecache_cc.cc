@@ -0,0 +1,157 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+#include "auth-zonecache.hh"
+#include "dnsbackend.hh"
+
+BOOST_AUTO_TEST_SUITE(auth_zonecache_cc)
+
+static DomainInfo makeDomain(const string& zone, int id)
+{
+  DomainInfo di;
+  di.zone = DNSName(zone);
+  di.id = id;
+  return di;
+}
+
+BOOST_AUTO_TEST_CASE(test_replace) {
+  AuthZoneCache cache;
+  cache.setRefreshInterval(3600);
+  BOOST_CHECK(!cache.isEnabled());
+
+  vector<DomainInfo> zones;
+  zones.push_back(makeDomain("example.com", 1));
+  zones.push_back(makeDomain("sub.example.com", 2));
+  zones.push_back(makeDomain("example.net", 3));
+  cache.replace(zones);
+  BOOST_CHECK(cache.isEnabled());
+  BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+  DNSName zone;
+  int zoneId;
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.com"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("example.com"));
+  BOOST_CHECK_EQUAL(zoneId, 1);
+
+  BOOST_CHECK(cache.getEntry(DNSName("a.b.sub.example.com"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("sub.example.com"));
+  BOOST_CHECK_EQUAL(zoneId, 2);
+
+  BOOST_CHECK(cache.getEntry(DNSName("example.net"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zoneId, 3);
+
+  BOOST_CHECK(!cache.getEntry(DNSName("com"), zone, zoneId));
+  BOOST_CHECK(!cache.getEntry(DNSName("example.org"), zone, zoneId));
+  BOOST_CHECK_EQUAL(cache.getHits(), 3U);
+  BOOST_CHECK_EQUAL(cache.getMisses(), 2U);
+
+  zones.clear();
+  zones.push_back(makeDomain("example.org", 4));
+  cache.replace(zones);
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(!cache.getEntry(DNSName("www.example.com"), zone, zoneId));
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.org"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zoneId, 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_add_remove) {
+  AuthZoneCache cache;
+
+  DNSName zone;
+  int zoneId;
+  /* without a refresh interval the cache is not in use */
+  cache.add(DNSName("example.com"), 1);
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+  BOOST_CHECK(!cache.getEntry(DNSName("example.com"), zone, zoneId));
+
+  cache.setRefreshInterval(3600);
+  cache.replace(vector<DomainInfo>());
+  cache.add(DNSName("example.com"), 1);
+  cache.add(DNSName("example.com"), 1);
+  cache.add(DNSName("sub.example.com"), 2);
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+  BOOST_CHECK(cache.getEntry(DNSName("www.sub.example.com"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zoneId, 2);
+
+  cache.remove(DNSName("sub.example.com"));
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(cache.getEntry(DNSName("www.sub.example.com"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("example.com"));
+  BOOST_CHECK_EQUAL(zoneId, 1);
+
+  /* removing a zone that is not there, or only covered by a parent, is a no-op */
+  cache.remove(DNSName("sub.example.com"));
+  cache.remove(DNSName("www.example.com"));
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.com"), zone, zoneId));
+
+  cache.remove(DNSName("example.com"));
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+  BOOST_CHECK(!cache.getEntry(DNSName("www.example.com"), zone, zoneId));
+}
+
+BOOST_AUTO_TEST_CASE(test_add_during_replace) {
+  AuthZoneCache cache;
+  cache.setRefreshInterval(3600);
+
+  vector<DomainInfo> zones;
+  zones.push_back(makeDomain("example.com", 1));
+  cache.replace(zones);
+
+  /* the refresh reads the zone list, then a zone gets created before the
+     list is swapped in: the new zone must survive the replace */
+  cache.startReplace();
+  zones.clear();
+  zones.push_back(makeDomain("example.com", 1));
+  zones.push_back(makeDomain("example.net", 2));
+  cache.add(DNSName("example.org"), 3);
+  cache.add(DNSName("example.net"), 2);
+  cache.replace(zones);
+
+  BOOST_CHECK_EQUAL(cache.size(), 3U);
+  DNSName zone;
+  int zoneId;
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.org"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zone, DNSName("example.org"));
+  BOOST_CHECK_EQUAL(zoneId, 3);
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.net"), zone, zoneId));
+  BOOST_CHECK_EQUAL(zoneId, 2);
+
+  /* changes are only replayed by the replace that follows startReplace() */
+  zones.clear();
+  zones.push_back(makeDomain("example.com", 1));
+  cache.replace(zones);
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(!cache.getEntry(DNSName("www.example.org"), zone, zoneId));
+}
+
+BOOST_AUTO_TEST_CASE(test_remove_during_replace) {
+  AuthZoneCache cache;
+  cache.setRefreshInterval(3600);
+
+  vector<DomainInfo> zones;
+  zones.push_back(makeDomain("example.com", 1));
+  zones.push_back(makeDomain("example.net", 2));
+  cache.replace(zones);
+
+  /* the zone list still has example.net, but it was deleted in the meantime */
+  cache.startReplace();
+  cache.remove(DNSName("example.net"));
+  cache.add(DNSName("example.org"), 3);
+  cache.remove(DNSName("example.org"));
+  cache.replace(zones);
+
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  DNSName zone;
+  int zoneId;
+  BOOST_CHECK(cache.getEntry(DNSName("www.example.com"), zone, zoneId));
+  BOOST_CHECK(!cache.getEntry(DNSName("www.example.net"), zone, zoneId));
+  BOOST_CHECK(!cache.getEntry(DNSName("www.example.org"), zone, zoneId));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -249,6 +249,38 @@ BOOST_AUTO_TEST_CASE(test_Append) {
   BOOST_CHECK(dn == DNSName("www.powerdns.com."));
 }
 
+BOOST_AUTO_TEST_CASE(test_AppendSelf) {
+  DNSName name("www.powerdns.com.");
+  name += name;
+  BOOST_CHECK_EQUAL(name.toString(), "www.powerdns.com.www.powerdns.com.");
+  BOOST_CHECK_EQUAL(name.countLabels(), 6);
+  BOOST_CHECK_EQUAL(name.hash(), DNSName("www.powerdns.com.www.powerdns.com.").hash());
+
+  /* fits inline on its own, but not twice: the buffer we read from moves */
+  DNSName longer("a-label-that-nearly-fills-the-inline.storage.");
+  longer += longer;
+  BOOST_CHECK_EQUAL(longer.toString(), "a-label-that-nearly-fills-the-inline.storage.a-label-that-nearly-fills-the-inline.storage.");
+  BOOST_CHECK_EQUAL(longer.countLabels(), 4);
+
+  DNSNameStorage storage("0123456789", 10);
+  std::string expected("0123456789");
+  while(storage.size() < 200) {
+    storage.append(storage.data(), storage.size());
+    expected.append(expected);
+  }
+  BOOST_CHECK_EQUAL(std::string(storage.data(), storage.size()), expected);
+  BOOST_CHECK_GT(storage.heapSize(), 0U);
+
+  storage.insert(3, storage.data() + 5, 4);
+  expected.insert(3, expected.substr(5, 4));
+  BOOST_CHECK_EQUAL(std::string(storage.data(), storage.size()), expected);
+
+  storage.replace(2, 10, storage);
+  expected.replace(2, 10, expected);
+  BOOST_CHECK_EQUAL(std::string(storage.data(), storage.size()), expected);
+  BOOST_CHECK_EQUAL(storage.c_str()[storage.size()], 0);
+}
+
 BOOST_AUTO_TEST_CASE(test_packetCompress) {
   reportBasicTypes();
   vector<unsigned char> packet;
@@ -286,6 +318,40 @@ BOOST_AUTO_TEST_CASE(test_packetCompress) {
 
 }
 
+BOOST_AUTO_TEST_CASE(test_packetCompressRollback) {
+  reportBasicTypes();
+  vector<unsigned char> packet;
+  DNSPacketWriter dpw(packet, DNSName("www.ds9a.nl."), QType::NS);
+  dpw.startRecord(DNSName("ds9a.nl"), QType::NS, 3600, QClass::IN, DNSResourceRecord::AUTHORITY);
+  NSRecordContent("ns1.powerdns.nl.").toPacket(dpw);
+  dpw.startRecord(DNSName("ds9a.nl"), QType::NS, 3600, QClass::IN, DNSResourceRecord::AUTHORITY);
+  NSRecordContent("ns2.powerdns.nl.").toPacket(dpw);
+  dpw.commit();
+  dpw.startRecord(DNSName("ds9a.nl"), QType::NS, 3600, QClass::IN, DNSResourceRecord::AUTHORITY);
+  NSRecordContent("ns3.example.com.").toPacket(dpw);
+  dpw.rollback();
+  dpw.startRecord(DNSName("ds9a.nl"), QType::NS, 3600, QClass::IN, DNSResourceRecord::AUTHORITY);
+  NSRecordContent("ns4.example.org.").toPacket(dpw);
+  dpw.startRecord(DNSName("NS1.powerdns.NL"), QType::A, 3600, QClass::IN, DNSResourceRecord::ADDITIONAL);
+  ARecordContent("192.0.2.1").toPacket(dpw);
+  dpw.startRecord(DNSName("ns4.example.org"), QType::A, 3600, QClass::IN, DNSResourceRecord::ADDITIONAL);
+  ARecordContent("192.0.2.4").toPacket(dpw);
+  dpw.commit();
+
+  string str((const char*)&packet[0], (const char*)&packet[0] + packet.size());
+  BOOST_CHECK(str.find("example.com") == string::npos);
+  BOOST_CHECK_EQUAL(str.find("example"), str.rfind("example"));
+  BOOST_CHECK_EQUAL(str.find("powerdns"), str.rfind("powerdns"));
+
+  MOADNSParser mdp(false, str);
+  BOOST_REQUIRE_EQUAL(mdp.d_answers.size(), 5);
+  BOOST_CHECK_EQUAL(mdp.d_answers.at(0).first.d_content->getZoneRepresentation(), "ns1.powerdns.nl.");
+  BOOST_CHECK_EQUAL(mdp.d_answers.at(1).first.d_content->getZoneRepresentation(), "ns2.powerdns.nl.");
+  BOOST_CHECK_EQUAL(mdp.d_answers.at(2).first.d_content->getZoneRepresentation(), "ns4.example.org.");
+  BOOST_CHECK_EQUAL(mdp.d_answers.at(3).first.d_name, DNSName("ns1.powerdns.nl."));
+  BOOST_CHECK_EQUAL(mdp.d_answers.at(4).first.d_name, DNSName("ns4.example.org."));
+}
+
 BOOST_AUTO_TEST_CASE(test_packetCompressLong) {
   reportBasicTypes();
   vector<unsigned char> packet;
@@ -357,6 +423,43 @@ BOOST_AUTO_TEST_CASE(test_hash) {
   BOOST_CHECK(stdev < 10);      
 }
 
+BOOST_AUTO_TEST_CASE(test_cached_properties) {
+  DNSName name("www.powerdns.com.");
+  size_t hash = name.hash();
+  BOOST_CHECK_EQUAL(name.countLabels(), 3);
+
+  BOOST_CHECK(name.chopOff());
+  BOOST_CHECK_EQUAL(name.countLabels(), 2);
+  BOOST_CHECK_EQUAL(name.hash(), DNSName("powerdns.com.").hash());
+
+  name.prependRawLabel("www");
+  BOOST_CHECK_EQUAL(name.countLabels(), 3);
+  BOOST_CHECK_EQUAL(name.hash(), hash);
+
+  name.appendRawLabel("a-rather-long-label-so-that-we-do-not-fit-inline-anymore");
+  BOOST_CHECK_EQUAL(name.countLabels(), 4);
+  BOOST_CHECK_EQUAL(name.toString(), "www.powerdns.com.a-rather-long-label-so-that-we-do-not-fit-inline-anymore.");
+  DNSName copy(name);
+  BOOST_CHECK_EQUAL(copy.hash(), name.hash());
+  BOOST_CHECK(copy == name);
+  DNSName moved(std::move(copy));
+  BOOST_CHECK(moved == name);
+  BOOST_CHECK_EQUAL(moved.countLabels(), 4);
+
+  name.makeUsRelative(DNSName("com.a-rather-long-label-so-that-we-do-not-fit-inline-anymore."));
+  BOOST_CHECK_EQUAL(name.toString(), "www.powerdns.");
+  BOOST_CHECK_EQUAL(name.countLabels(), 2);
+
+  name += DNSName("com.");
+  BOOST_CHECK_EQUAL(name.hash(), hash);
+  BOOST_CHECK_EQUAL(name.makeLowerCase().hash(), hash);
+  name.trimToLabels(1);
+  BOOST_CHECK_EQUAL(name.toString(), "com.");
+  name.clear();
+  BOOST_CHECK(name.empty());
+  BOOST_CHECK_EQUAL(name.countLabels(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(test_hashContainer) {
   std::unordered_set<DNSName> s;
   s.insert(DNSName("www.powerdns.com"));
@@ -528,6 +631,27 @@ BOOST_AUTO_TEST_CASE(test_suffixmatch_tree) {
   BOOST_CHECK(smt.lookup(DNSName("images.bbc.co.uk.")) == nullptr);
   BOOST_CHECK(smt.lookup(DNSName("www.news.gov.uk.")) == nullptr);
 
+  // the closest enclosing name wins, even below a deeper branch that does not match
+  smt.add(DNSName("bbc.co.uk."), DNSName("bbc.co.uk."));
+  BOOST_REQUIRE(smt.lookup(DNSName("www.news.bbc.co.uk.")));
+  BOOST_CHECK_EQUAL(*smt.lookup(DNSName("www.news.bbc.co.uk.")), DNSName("news.bbc.co.uk."));
+  BOOST_REQUIRE(smt.lookup(DNSName("www.sport.bbc.co.uk.")));
+  BOOST_CHECK_EQUAL(*smt.lookup(DNSName("www.sport.bbc.co.uk.")), DNSName("bbc.co.uk."));
+  smt.add(DNSName("a.b.ezdns.it."), DNSName("a.b.ezdns.it."));
+  BOOST_REQUIRE(smt.lookup(DNSName("c.b.ezdns.it.")));
+  BOOST_CHECK_EQUAL(*smt.lookup(DNSName("c.b.ezdns.it.")), ezdns);
+
+  smt.remove(DNSName("news.bbc.co.uk."));
+  BOOST_REQUIRE(smt.lookup(DNSName("www.news.bbc.co.uk.")));
+  BOOST_CHECK_EQUAL(*smt.lookup(DNSName("www.news.bbc.co.uk.")), DNSName("bbc.co.uk."));
+  smt.remove(DNSName("bbc.co.uk."));
+  BOOST_CHECK(smt.lookup(DNSName("www.news.bbc.co.uk.")) == nullptr);
+  smt.remove(DNSName("does.not.exist."));
+  smt.remove(DNSName("b.ezdns.it.")); // not added, only on the path to a.b.ezdns.it
+  BOOST_REQUIRE(smt.lookup(DNSName("a.b.ezdns.it.")));
+  BOOST_CHECK_EQUAL(*smt.lookup(DNSName("a.b.ezdns.it.")), DNSName("a.b.ezdns.it."));
+  BOOST_REQUIRE(smt.lookup(DNSName("www.powerdns.org.")));
+
   smt.add(g_rootdnsname, g_rootdnsname); // block the root
   BOOST_REQUIRE(smt.lookup(DNSName("a.root-servers.net.")));
   BOOST_CHECK_EQUAL(*smt.lookup(DNSName("a.root-servers.net.")), g_rootdnsname);
@@ -868,4 +992,58 @@ BOOST_AUTO_TEST_CASE(test_getlastlabel) {
   // Check if the last label is indeed returned
   BOOST_CHECK_EQUAL(ans, DNSName("com"));
 }
+
+BOOST_AUTO_TEST_CASE(test_case_insensitive_kernels) {
+  /* the vectorized comparisons and hash have to agree with the obvious byte by byte versions */
+  const string alphabet("aAbBzZ09-_\x80\xc1\xe1@[`{");
+  srandom(42);
+  vector<DNSName> names;
+  for(unsigned int n = 0; n < 2000; n++) {
+    DNSName name;
+    bool longLabels = n % 10 == 0;
+    unsigned int labels = 1 + random() % (longLabels ? 3 : 6);
+    for(unsigned int l = 0; l < labels; l++) {
+      string label;
+      unsigned int len = 1 + random() % (longLabels ? 63 : 12);
+      for(unsigned int c = 0; c < len; c++)
+        label.append(1, alphabet.at(random() % alphabet.size()));
+      name.appendRawLabel(label);
+    }
+    names.push_back(name);
+    /* the same name with a different case, and one sharing its tail */
+    string mixed = name.toDNSString();
+    for(auto& c : mixed)
+      if(random() % 2)
+        c = dns_toupper(c);
+    names.push_back(DNSName(mixed.c_str(), mixed.size(), 0, false));
+    names.push_back(DNSName("x") + name);
+  }
+
+  auto lowered = [](const DNSName& name) {
+    string ret = name.toDNSString();
+    for(auto& c : ret)
+      c = dns_tolower(c);
+    return ret;
+  };
+
+  for(size_t n = 0; n < names.size(); n++) {
+    const DNSName& a = names.at(n);
+    const string la = lowered(a);
+    BOOST_CHECK_EQUAL(a.hash(), burtle(reinterpret_cast<const unsigned char*>(la.c_str()), la.size(), 0));
+    for(size_t m = n >= 3 ? n - 3 : 0; m < names.size() && m < n + 4; m++) {
+      const DNSName& b = names.at(m);
+      const string lb = lowered(b);
+      BOOST_CHECK_EQUAL(a == b, la == lb);
+      BOOST_CHECK_EQUAL(a < b, std::lexicographical_compare(la.rbegin(), la.rend(), lb.rbegin(), lb.rend(), [](unsigned char x, unsigned char y) { return x < y; }));
+      BOOST_CHECK_EQUAL(a.canonCompare(b), a.slowCanonCompare(b));
+      bool partOf = false;
+      DNSName parent(a);
+      do {
+        partOf = partOf || lowered(parent) == lb;
+      } while(parent.chopOff());
+      BOOST_CHECK_EQUAL(a.isPartOf(b), partOf);
+    }
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
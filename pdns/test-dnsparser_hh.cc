@@ -4,7 +4,9 @@
 #include "config.h"
 #endif
 #include <boost/test/unit_test.hpp>
+#include <random>
 #include "dnsparser.hh"
+#include "dnsrecords.hh"
 
 BOOST_AUTO_TEST_SUITE(test_dnsparser_hh)
 
@@ -18,4 +20,112 @@ BOOST_AUTO_TEST_CASE(test_type_lowercase) {
   BOOST_CHECK_EQUAL(lc_result, uc_result);
 }
 
+static vector<uint8_t> makeViewTestPacket()
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter pw(packet, DNSName("www.powerdns.com"), QType::A);
+  pw.getHeader()->qr = 1;
+  pw.startRecord(DNSName("www.powerdns.com"), QType::CNAME, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+  pw.xfrName(DNSName("powerdns.com"), true);
+  pw.startRecord(DNSName("powerdns.com"), QType::A, 60, QClass::IN, DNSResourceRecord::ANSWER);
+  pw.xfrIP(htonl(0x7f000001));
+  pw.startRecord(DNSName("powerdns.com"), QType::MX, 120, QClass::IN, DNSResourceRecord::ANSWER);
+  pw.xfr16BitInt(10);
+  pw.xfrName(DNSName("mail.powerdns.com"), true);
+  pw.startRecord(DNSName("powerdns.com"), QType::NS, 86400, QClass::IN, DNSResourceRecord::AUTHORITY);
+  pw.xfrName(DNSName("ns1.powerdns.com"), true);
+  pw.startRecord(DNSName("ns1.powerdns.com"), QType::TXT, 30, QClass::IN, DNSResourceRecord::ADDITIONAL);
+  pw.xfrText("\"hello\" \"world\"");
+  pw.addOpt(4096, 0, 0);
+  pw.commit();
+  return packet;
+}
+
+BOOST_AUTO_TEST_CASE(test_packetview_matches_parser) {
+  reportBasicTypes();
+  const auto packet = makeViewTestPacket();
+  MOADNSParser mdp(false, (const char*)packet.data(), packet.size());
+  DNSPacketView view((const char*)packet.data(), packet.size());
+
+  BOOST_CHECK_EQUAL(view.getHeader().qdcount, 1);
+  BOOST_CHECK_EQUAL(view.getHeader().ancount, mdp.d_header.ancount);
+  BOOST_CHECK_EQUAL(view.getHeader().nscount, mdp.d_header.nscount);
+  BOOST_CHECK_EQUAL(view.getHeader().arcount, mdp.d_header.arcount);
+  BOOST_CHECK_EQUAL(view.getQName(), mdp.d_qname);
+  BOOST_CHECK_EQUAL(view.getQType(), QType::A);
+  BOOST_CHECK_EQUAL(view.getQClass(), QClass::IN);
+  BOOST_CHECK(view.nameEquals(view.getQNameOffset(), DNSName("WWW.PowerDNS.com")));
+  BOOST_CHECK(!view.nameEquals(view.getQNameOffset(), DNSName("powerdns.com")));
+  BOOST_CHECK(!view.nameEquals(view.getQNameOffset(), DNSName("www.powerdns.co")));
+
+  BOOST_REQUIRE_EQUAL(view.getRecordsCount(), mdp.d_answers.size());
+  size_t n = 0;
+  for(const auto& record : view) {
+    const DNSRecord& dr = mdp.d_answers.at(n).first;
+    BOOST_CHECK_EQUAL(record.d_place, dr.d_place);
+    BOOST_CHECK_EQUAL(record.d_type, dr.d_type);
+    BOOST_CHECK_EQUAL(record.d_class, dr.d_class);
+    BOOST_CHECK_EQUAL(record.d_ttl, dr.d_ttl);
+    BOOST_CHECK_EQUAL(record.d_rdataLength, dr.d_clen);
+    BOOST_CHECK_EQUAL(view.getName(record), dr.d_name);
+    BOOST_CHECK(view.nameEquals(record.d_nameOffset, dr.d_name));
+    BOOST_CHECK_EQUAL(view.getContent(record)->getZoneRepresentation(), dr.d_content->getZoneRepresentation());
+    const DNSRecord copy = view.getDNSRecord(record);
+    BOOST_CHECK(copy == dr);
+    ++n;
+  }
+  BOOST_CHECK_EQUAL(n, mdp.d_answers.size());
+  BOOST_CHECK_EQUAL(getDNSPacketMinTTL((const char*)packet.data(), packet.size()), 30);
+  BOOST_CHECK_EQUAL(getDNSPacketLength((const char*)packet.data(), packet.size()), packet.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_packetview_truncated) {
+  reportBasicTypes();
+  const auto packet = makeViewTestPacket();
+
+  for(size_t len = 0; len < packet.size(); len++) {
+    /* the records in there now run past the end, we must notice */
+    vector<uint8_t> truncated(packet.begin(), packet.begin() + len);
+    BOOST_CHECK_THROW({
+        DNSPacketView view((const char*)truncated.data(), truncated.size());
+        for(const auto& record : view) {
+          (void) record;
+        }
+      }, MOADNSException);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_packetview_fuzz) {
+  reportBasicTypes();
+  const auto packet = makeViewTestPacket();
+  std::mt19937 gen(42);
+
+  /* throw random garbage at the view, everything it does not like has to end up as a MOADNSException */
+  for(unsigned int iteration = 0; iteration < 20000; iteration++) {
+    vector<uint8_t> mutated(packet);
+    unsigned int changes = 1 + gen() % 4;
+    for(unsigned int n = 0; n < changes; n++) {
+      mutated.at(gen() % mutated.size()) = gen() % 256;
+    }
+    if(gen() % 4 == 0) {
+      mutated.resize(gen() % mutated.size());
+    }
+
+    try {
+      DNSPacketView view((const char*)mutated.data(), mutated.size());
+      if(view.hasQuestion()) {
+        view.nameEquals(view.getQNameOffset(), DNSName("www.powerdns.com"));
+        view.getQName();
+      }
+      for(const auto& record : view) {
+        BOOST_CHECK_LE(static_cast<size_t>(record.d_rdataOffset) + record.d_rdataLength, mutated.size());
+        view.nameEquals(record.d_nameOffset, DNSName("powerdns.com"));
+        view.getDNSRecord(record);
+      }
+    }
+    catch(const MOADNSException& e) {
+    }
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_NO_MAIN
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <boost/test/unit_test.hpp>
+#include "mtasker.hh"
+
+BOOST_AUTO_TEST_SUITE(mtasker_cc)
+
+static int g_result;
+
+static void doSomething(void* p)
+{
+  MTasker<>* mt = reinterpret_cast<MTasker<>*>(p);
+  int i=12, o;
+  if (mt->waitEvent(i, &o) == 1)
+    g_result = o;
+}
+
+static void addOne(void* p)
+{
+  (*reinterpret_cast<int*>(p))++;
+}
+
+BOOST_AUTO_TEST_CASE(test_Simple) {
+  MTasker<> mt;
+  mt.makeThread(doSomething, &mt);
+  struct timeval now;
+  gettimeofday(&now, 0);
+  bool first=true;
+  int o=24;
+  for(;;) {
+    while(mt.schedule(&now)) {
+    }
+    if(first) {
+      mt.sendEvent(12, &o);
+      first=false;
+    }
+    if(mt.noProcesses())
+      break;
+  }
+  BOOST_CHECK_EQUAL(g_result, o);
+}
+
+BOOST_AUTO_TEST_CASE(test_CachedStacksAreReused) {
+  MTasker<> mt(16384, 4);
+  int count = 0;
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 8; i++)
+      mt.makeThread(addOne, &count);
+    while(mt.schedule()) {
+    }
+    BOOST_CHECK(mt.noProcesses());
+    BOOST_CHECK_EQUAL(mt.getCachedStacksCount(), 4U);
+  }
+  BOOST_CHECK_EQUAL(count, 24);
+}
+
+BOOST_AUTO_TEST_CASE(test_CachedStacksAfterWaiting) {
+  MTasker<> mt(16384, 2);
+  struct timeval now;
+  gettimeofday(&now, 0);
+
+  for (int round = 0; round < 3; round++) {
+    g_result = 0;
+    int o = round + 1;
+    mt.makeThread(doSomething, &mt);
+    while(mt.schedule(&now)) {
+    }
+    mt.sendEvent(12, &o);
+    while(mt.schedule(&now)) {
+    }
+    BOOST_CHECK(mt.noProcesses());
+    BOOST_CHECK_EQUAL(g_result, o);
+    BOOST_CHECK_EQUAL(mt.getCachedStacksCount(), 1U);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
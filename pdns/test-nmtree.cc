@@ -95,4 +95,34 @@ BOOST_AUTO_TEST_CASE(test_scale) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_erase_bulk) {
+  NetmaskTree<int> nmt;
+  nmt.insert(Netmask("10.0.0.0/8")).second=1;
+  nmt.insert(Netmask("10.1.2.0/24")).second=3;
+  nmt.insert(Netmask("10.1.0.0/16")).second=2;
+  nmt.insert(Netmask("10.128.0.0/9")).second=4;
+
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.1.2.3"))->second, 3);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.1.3.3"))->second, 2);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.200.3.3"))->second, 4);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.2.3.3"))->second, 1);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.1.2.3"), 16)->second, 2);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("11.2.3.3")), (void*)0);
+
+  nmt.erase(Netmask("10.1.0.0/16"));
+  BOOST_CHECK_EQUAL(nmt.size(), 3);
+  BOOST_CHECK(!nmt.has_key(Netmask("10.1.0.0/16")));
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.1.3.3"))->second, 1);
+  BOOST_CHECK_EQUAL(nmt.lookup(ComboAddress("10.1.2.3"))->second, 3);
+
+  std::vector<std::pair<Netmask,int> > prefixes{{Netmask("192.0.2.0/24"), 1}, {Netmask("192.0.0.0/8"), 2}, {Netmask("2001:db8::/32"), 3}, {Netmask("192.0.2.0/24"), 4}};
+  NetmaskTree<int> bulk;
+  bulk.insert(prefixes.begin(), prefixes.end());
+  BOOST_CHECK_EQUAL(bulk.size(), 3);
+  BOOST_CHECK_EQUAL(bulk.lookup(ComboAddress("192.0.2.1"))->second, 4);
+  BOOST_CHECK_EQUAL(bulk.lookup(ComboAddress("192.1.2.1"))->second, 2);
+  BOOST_CHECK_EQUAL(bulk.lookup(ComboAddress("2001:db8::1"))->second, 3);
+  BOOST_CHECK_EQUAL(bulk.lookup(ComboAddress("2001:db9::1")), (void*)0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
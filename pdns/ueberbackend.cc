@@ -26,6 +26,7 @@
 #include <boost/archive/binary_oarchive.hpp>
 
 #include "auth-querycache.hh"
+#include "auth-zonecache.hh"
 #include "utility.hh"
 
 
@@ -54,6 +55,8 @@ pthread_mutex_t UeberBackend::instances_lock=PTHREAD_MUTEX_INITIALIZER;
 
 // initially we are blocked
 bool UeberBackend::d_go=false;
+AtomicCounter UeberBackend::s_backendQueries(0);
+AtomicCounter UeberBackend::s_bundleAnswers(0);
 pthread_mutex_t  UeberBackend::d_mut = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t UeberBackend::d_cond = PTHREAD_COND_INITIALIZER;
 
@@ -92,6 +95,8 @@ bool UeberBackend::createDomain(const DNSName &domain)
 {
   for(DNSBackend* mydb :  backends) {
     if(mydb->createDomain(domain)) {
+      DomainInfo di;
+      g_zoneCache.add(domain, mydb->getDomainInfo(domain, di) ? di.id : -1);
       return true;
     }
   }
@@ -248,6 +253,28 @@ void UeberBackend::getUpdatedMasters(vector<DomainInfo>* domains)
 
 bool UeberBackend::getAuth(DNSPacket *p, SOAData *sd, const DNSName &target)
 {
+  // The zone cache knows all zones, so a single SOA lookup for the closest
+  // one replaces asking every backend about every label of target
+  if(sd->db != (DNSBackend *)-1 && g_zoneCache.isEnabled()) {
+    DNSName lookupName(target);
+    DNSName zone;
+    int zoneId;
+    if(p->qtype == QType::DS)
+      lookupName.chopOff(); // the DS lives in the parent
+    bool found = g_zoneCache.getEntry(lookupName, zone, zoneId);
+    if(!found && lookupName != target) {
+      // DS at the apex of a zone whose parent we don't host, answered from the zone itself
+      found = g_zoneCache.getEntry(target, zone, zoneId);
+    }
+    if(!found)
+      return false;
+    if(getSOA(zone, *sd, p)) {
+      sd->qname = zone;
+      return true;
+    }
+    DLOG(L<<Logger::Error<<"zone cache entry "<<zone<<" has no SOA, walking the backends"<<endl);
+  }
+
   bool found = false;
   int cstat;
   DNSName choppedOff(target);
@@ -378,7 +405,8 @@ bool UeberBackend::getSOAUncached(const DNSName &domain, SOAData &sd, DNSPacket
   d_question.qname=domain;
   d_question.zoneId=-1;
 
-  for(vector<DNSBackend *>::const_iterator i=backends.begin();i!=backends.end();++i)
+  for(vector<DNSBackend *>::const_iterator i=backends.begin();i!=backends.end();++i) {
+    ++s_backendQueries;
     if((*i)->getSOA(domain, sd, p)) {
       if( d_cache_ttl ) {
         DNSZoneRecord rr;
@@ -394,6 +422,7 @@ bool UeberBackend::getSOAUncached(const DNSName &domain, SOAData &sd, DNSPacket
       }
       return true;
     }
+  }
 
   if(d_negcache_ttl)
     addNegCache(d_question);
@@ -423,6 +452,8 @@ UeberBackend::UeberBackend(const string &pname)
 
   d_tid=pthread_self();
   d_stale=false;
+  d_bundling=false;
+  d_canBundle=true;
 
   backends=BackendMakers().all(pname=="key-only");
 }
@@ -546,7 +577,18 @@ void UeberBackend::lookup(const QType &qtype,const DNSName &qname, DNSPacket *pk
       //      cout<<"UeberBackend::lookup("<<qname<<"|"<<DNSRecordContent::NumberToType(qtype.getCode())<<"): uncached"<<endl;
       d_negcached=d_cached=false;
       d_answers.clear(); 
-      (d_handle.d_hinterBackend=backends[d_handle.i++])->lookup(qtype, qname,pkt_p,zoneId);
+      if(d_bundling && d_canBundle && zoneId >= 0 && qname.countLabels() && answerFromBundle(qtype, qname, pkt_p, zoneId)) {
+        d_cached=true;
+        d_cachehandleiter = d_answers.begin();
+        if(d_answers.empty())
+          addNegCache(d_question);
+        else
+          addCache(d_question, d_answers);
+      }
+      else {
+        ++s_backendQueries;
+        (d_handle.d_hinterBackend=backends[d_handle.i++])->lookup(qtype, qname,pkt_p,zoneId);
+      }
     } 
     else if(cstat==0) {
       //      cout<<"UeberBackend::lookup("<<qname<<"|"<<DNSRecordContent::NumberToType(qtype.getCode())<<"): NEGcached"<<endl;
@@ -565,6 +607,68 @@ void UeberBackend::lookup(const QType &qtype,const DNSName &qname, DNSPacket *pk
   d_handle.parent=this;
 }
 
+void UeberBackend::startBundle()
+{
+  d_bundles.clear();
+  d_bundling=true;
+}
+
+void UeberBackend::endBundle()
+{
+  d_bundles.clear();
+  d_bundling=false;
+}
+
+/* Fills d_answers with what the backends would have answered for qtype, using
+   one query per backend for all qtypes of qname. Like handle::get(), the first
+   backend with matching records wins. Returns false if a backend can't do
+   bundles, in which case the caller does a regular lookup. */
+bool UeberBackend::answerFromBundle(const QType &qtype, const DNSName &qname, DNSPacket *pkt_p, int zoneId)
+{
+  Bundle* bundle = nullptr;
+  for(auto& b : d_bundles) {
+    if(b.zoneId == zoneId && b.qname == qname) {
+      bundle = &b;
+      break;
+    }
+  }
+
+  if(!bundle) {
+    if(d_bundles.size() >= 8) // only the names of a single question live here
+      d_bundles.erase(d_bundles.begin());
+    d_bundles.push_back(Bundle());
+    bundle = &d_bundles.back();
+    bundle->qname = qname;
+    bundle->zoneId = zoneId;
+    bundle->fetched.resize(backends.size(), false);
+    bundle->records.resize(backends.size());
+  }
+
+  bool queried = false;
+  for(size_t n = 0; n < backends.size(); ++n) {
+    if(!bundle->fetched[n]) {
+      queried = true;
+      ++s_backendQueries;
+      if(!backends[n]->lookupBundle(qname, zoneId, pkt_p, bundle->records[n])) {
+        d_canBundle=false; // backends don't change during our lifetime
+        d_bundles.clear();
+        return false;
+      }
+      bundle->fetched[n] = true;
+    }
+
+    for(const auto& rr : bundle->records[n]) {
+      if(qtype.getCode() == QType::ANY || rr.dr.d_type == qtype.getCode())
+        d_answers.push_back(rr);
+    }
+    if(!d_answers.empty())
+      break;
+  }
+  if(!queried)
+    ++s_bundleAnswers;
+  return true;
+}
+
 void UeberBackend::getAllDomains(vector<DomainInfo> *domains, bool include_disabled) {
   for (vector<DNSBackend*>::iterator i = backends.begin(); i != backends.end(); ++i )
   {
@@ -572,6 +676,13 @@ void UeberBackend::getAllDomains(vector<DomainInfo> *domains, bool include_disab
   }
 }
 
+void UeberBackend::updateZoneCache() {
+  vector<DomainInfo> zones;
+  g_zoneCache.startReplace();
+  getAllDomains(&zones);
+  g_zoneCache.replace(zones);
+}
+
 bool UeberBackend::get(DNSZoneRecord &rr)
 {
   // cout<<"UeberBackend::get(DNSZoneRecord) called"<<endl;
@@ -647,6 +758,7 @@ bool UeberBackend::handle::get(DNSZoneRecord &r)
            <<" out of answers, taking next"<<endl);
       
       d_hinterBackend=parent->backends[i++];
+      ++s_backendQueries;
       d_hinterBackend->lookup(qtype,qname,pkt_p,parent->d_domain_id);
     }
     else 
@@ -98,11 +98,35 @@ public:
 
   void lookup(const QType &, const DNSName &qdomain, DNSPacket *pkt_p=0,  int zoneId=-1);
 
+  //! Until endBundle(), lookups with a zoneId fetch all records of their name in one backend query and answer later qtypes for that name from it
+  void startBundle();
+  void endBundle();
+
+  //! Scopes a lookup bundle to the lifetime of this object
+  class BundleScope : public boost::noncopyable
+  {
+  public:
+    explicit BundleScope(UeberBackend& ub) : d_ub(ub)
+    {
+      d_ub.startBundle();
+    }
+    ~BundleScope()
+    {
+      d_ub.endBundle();
+    }
+  private:
+    UeberBackend& d_ub;
+  };
+
+  static AtomicCounter s_backendQueries; //!< lookups sent to a backend
+  static AtomicCounter s_bundleAnswers; //!< lookups answered from a bundle
+
   bool getAuth(DNSPacket *p, SOAData *sd, const DNSName &target);
   bool getSOA(const DNSName &domain, SOAData &sd, DNSPacket *p=0);
   bool getSOAUncached(const DNSName &domain, SOAData &sd, DNSPacket *p=0);  // same, but ignores cache
   bool get(DNSZoneRecord &r);
   void getAllDomains(vector<DomainInfo> *domains, bool include_disabled=false);
+  void updateZoneCache(); //!< refills the zone cache from getAllDomains()
 
   void getUnfreshSlaveInfos(vector<DomainInfo>* domains);
   void getUpdatedMasters(vector<DomainInfo>* domains);
@@ -145,6 +169,17 @@ private:
     QType qtype;
   }d_question;
 
+  struct Bundle
+  {
+    DNSName qname;
+    int zoneId;
+    vector<bool> fetched; //!< per backend, in the order they are asked
+    vector<vector<DNSZoneRecord> > records;
+  };
+  vector<Bundle> d_bundles;
+  bool d_bundling;
+  bool d_canBundle;
+
   unsigned int d_cache_ttl, d_negcache_ttl;
   int d_domain_id;
   int d_ancount;
@@ -155,6 +190,7 @@ private:
   bool d_stale;
 
   int cacheHas(const Question &q, vector<DNSZoneRecord> &rrs);
+  bool answerFromBundle(const QType &qtype, const DNSName &qname, DNSPacket *pkt_p, int zoneId);
   void addNegCache(const Question &q);
   void addCache(const Question &q, const vector<DNSZoneRecord> &rrs);
   
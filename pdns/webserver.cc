@@ -33,10 +33,43 @@
 #include "json.hh"
 #include "arguments.hh"
 #include <yahttp/router.hpp>
+#include <deque>
+#include <limits>
+#include <poll.h>
+#include "lock.hh"
+
+// Connections are passed between the thread in WebServer::go(), which waits
+// for them to become readable, and the worker threads, which serve one
+// request and then hand the connection back if the client wants to keep it.
+struct WebConnection {
+  WebConnection(Socket* client_) : client(client_) {}
+  ~WebConnection()
+  {
+    delete client; // close socket
+  }
+
+  Socket* client;
+  string pending; //!< received after the previous request, the start of the next one
+};
+
+struct connectionQueue {
+  connectionQueue()
+  {
+    pthread_mutex_init(&lock, 0);
+    pthread_cond_init(&cond, 0);
+  }
+  ~connectionQueue()
+  {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+  }
 
-struct connectionThreadData {
   WebServer* webServer{nullptr};
-  Socket* client{nullptr};
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  std::deque<WebConnection*> readable;  //!< waiting for a worker
+  std::vector<WebConnection*> keptAlive; //!< waiting to go back into the poll set
+  int wakeupPipe[2];
 };
 
 json11::Json HttpRequest::json()
@@ -85,6 +118,46 @@ bool HttpRequest::compareHeader(const string &header_name, const string &expecte
 }
 
 
+size_t HttpRequest::readBody(char* buf, size_t len)
+{
+  if (d_bodyPos < body.size()) {
+    size_t n = std::min(len, body.size() - d_bodyPos);
+    memcpy(buf, body.c_str() + d_bodyPos, n);
+    d_bodyPos += n;
+    return n;
+  }
+  if (!d_client || !d_bodyLeft)
+    return 0;
+
+  ssize_t bytes = d_client->readWithTimeout(buf, std::min(len, d_bodyLeft), 5);
+  if (bytes <= 0)
+    throw NetworkError("Client went away while sending the request body");
+  d_bodyLeft -= bytes;
+  return bytes;
+}
+
+void HttpResponse::setStreamingBody(BodyProducer producer)
+{
+  streaming = true;
+  renderer = [producer](const YaHTTP::HTTPBase*, std::ostream& os, bool chunked) -> size_t {
+    string piece;
+    size_t total = 0;
+    while (producer(piece)) {
+      if (piece.empty())
+        continue;
+      if (chunked)
+        os << std::hex << piece.size() << std::dec << "\r\n" << piece << "\r\n";
+      else
+        os << piece;
+      total += piece.size();
+      piece.clear();
+    }
+    if (chunked)
+      os << "0\r\n\r\n";
+    return total;
+  };
+}
+
 void HttpResponse::setBody(const json11::Json& document)
 {
   document.dump(this->body);
@@ -108,10 +181,13 @@ static void bareHandlerWrapper(WebServer::HandlerFunction handler, YaHTTP::Reque
   handler(static_cast<HttpRequest*>(req), static_cast<HttpResponse*>(resp));
 }
 
-void WebServer::registerBareHandler(const string& url, HandlerFunction handler)
+// routes whose handlers read the request body themselves carry this name
+static const string s_streamBodyRoute = "stream-body";
+
+void WebServer::registerBareHandler(const string& url, HandlerFunction handler, bool streamBody)
 {
   YaHTTP::THandlerFunction f = boost::bind(&bareHandlerWrapper, handler, _1, _2);
-  YaHTTP::Router::Any(url, f);
+  YaHTTP::Router::Any(url, f, streamBody ? s_streamBodyRoute : "");
 }
 
 static bool optionsHandler(HttpRequest* req, HttpResponse* resp) {
@@ -174,9 +250,9 @@ static void apiWrapper(WebServer::HandlerFunction handler, HttpRequest* req, Htt
   }
 }
 
-void WebServer::registerApiHandler(const string& url, HandlerFunction handler) {
+void WebServer::registerApiHandler(const string& url, HandlerFunction handler, bool streamBody) {
   HandlerFunction f = boost::bind(&apiWrapper, handler, _1, _2);
-  registerBareHandler(url, f);
+  registerBareHandler(url, f, streamBody);
 }
 
 static void webWrapper(WebServer::HandlerFunction handler, HttpRequest* req, HttpResponse* resp) {
@@ -198,13 +274,41 @@ void WebServer::registerWebHandler(const string& url, HandlerFunction handler) {
   registerBareHandler(url, f);
 }
 
-static void *WebServerConnectionThreadStart(void *p) {
-  connectionThreadData* data = static_cast<connectionThreadData*>(p);
+static void *WebServerWorkerThreadStart(void *p) {
+  connectionQueue* queue = static_cast<connectionQueue*>(p);
   pthread_detach(pthread_self());
-  data->webServer->serveConnection(data->client);
 
-  delete data->client; // close socket
-  delete data;
+  for(;;) {
+    WebConnection* conn;
+    {
+      Lock l(&queue->lock);
+      while(queue->readable.empty())
+        pthread_cond_wait(&queue->cond, &queue->lock);
+      conn = queue->readable.front();
+      queue->readable.pop_front();
+    }
+
+    if(!queue->webServer->serveConnection(conn->client, conn->pending)) {
+      delete conn;
+      continue;
+    }
+
+    if(!conn->pending.empty()) {
+      // the client already sent (part of) its next request, poll() won't tell us
+      Lock l(&queue->lock);
+      queue->readable.push_back(conn);
+      pthread_cond_signal(&queue->cond);
+      continue;
+    }
+
+    {
+      Lock l(&queue->lock);
+      queue->keptAlive.push_back(conn);
+    }
+    char c = 0;
+    if(write(queue->wakeupPipe[1], &c, 1) != 1)
+      L<<Logger::Error<<"Unable to wake up the webserver thread: "<<stringerror()<<endl;
+  }
 
   return NULL;
 }
@@ -281,54 +385,254 @@ void WebServer::handleRequest(HttpRequest& req, HttpResponse& resp)
 
   if (req.method == "HEAD") {
     resp.body = "";
-  } else {
+    if (resp.streaming)
+      resp.renderer = YaHTTP::HTTPBase::SendBodyRender();
+  } else if (!resp.streaming) {
     resp.headers["Content-Length"] = std::to_string(resp.body.size());
   }
 }
 
-void WebServer::serveConnection(Socket *client)
+namespace {
+// Writes what a response renders straight to the client, so a streamed body
+// never has to be held in memory as a whole.
+class SocketStreamBuf : public std::streambuf
+{
+public:
+  SocketStreamBuf(Socket* client, int timeout) : d_client(client), d_timeout(timeout)
+  {
+    setp(d_buf, d_buf + sizeof(d_buf));
+  }
+
+protected:
+  int overflow(int c) override
+  {
+    flushBuffer();
+    if (c != traits_type::eof()) {
+      *pptr() = c;
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override
+  {
+    flushBuffer();
+    return 0;
+  }
+
+private:
+  void flushBuffer()
+  {
+    if (pptr() > pbase())
+      d_client->writenWithTimeout(pbase(), pptr() - pbase(), d_timeout);
+    setp(d_buf, d_buf + sizeof(d_buf));
+  }
+
+  Socket* d_client;
+  int d_timeout;
+  char d_buf[16384];
+};
+
+// Streamed transfers keep a worker busy for as long as the client and the
+// backend take, so only some of the workers may be used for them at a time.
+class StreamingSlot
+{
+public:
+  StreamingSlot(std::atomic<int>& inUse) : d_inUse(inUse)
+  {
+  }
+  ~StreamingSlot()
+  {
+    if (d_held)
+      d_inUse--;
+  }
+
+  bool acquire(int max)
+  {
+    if (d_held)
+      return true;
+    if (++d_inUse > max) {
+      d_inUse--;
+      return false;
+    }
+    d_held = true;
+    return true;
+  }
+
+private:
+  std::atomic<int>& d_inUse;
+  bool d_held{false};
+};
+
+static void setTooManyStreams(HttpResponse& resp)
+{
+  resp = HttpResponse();
+  resp.headers["Content-Type"] = "application/json";
+  resp.headers["Retry-After"] = "1";
+  resp.setErrorResult("Too many streamed transfers in progress, try again later", 503);
+  resp.headers["Server"] = "PowerDNS/" VERSION;
+  resp.headers["Connection"] = "close";
+  resp.headers["Content-Length"] = std::to_string(resp.body.size());
+}
+}
+
+bool WebServer::serveConnection(Socket *client, string& pending)
 try {
   HttpRequest req;
   YaHTTP::AsyncRequestLoader yarl;
   yarl.initialize(&req);
   int timeout = 5;
+  // the whole request has to arrive within this, not just each read, so a
+  // client trickling in bytes can't keep a worker from serving others
+  const time_t deadline = time(0) + 2 * timeout;
+  string head;
+  head.swap(pending);
+  bool gotData = !head.empty();
   client->setNonBlocking();
 
+  // Only the headers are fed to the parser at first. Once the route is known,
+  // the body either follows through the parser, or is left for the handler.
+  // The parser checks the size limit as soon as it sees Content-Length, which
+  // must not stop streamed bodies.
+  const auto maxRequestSize = req.max_request_size;
+  req.max_request_size = std::numeric_limits<ssize_t>::max();
+
+  auto readSome = [client, deadline, timeout](char* buf, size_t len) {
+    time_t left = deadline - time(0);
+    if (left <= 0)
+      throw NetworkError("timeout reading the request");
+    return client->readWithTimeout(buf, len, std::min(left, static_cast<time_t>(timeout)));
+  };
+
+  // The parser drops whatever follows a Content-Length body, so it only gets
+  // the body and the rest is kept for the next request.
+  size_t bodyLeft = 0;
+  auto feedBody = [&req, &yarl, &bodyLeft, &pending](const string& data) {
+    if (yarl.chunked || data.size() <= bodyLeft) {
+      if (!yarl.chunked)
+        bodyLeft -= data.size();
+      req.complete = yarl.feed(data);
+      return;
+    }
+    pending.append(data, bodyLeft, string::npos);
+    req.complete = yarl.feed(data.substr(0, bodyLeft));
+    bodyLeft = 0;
+  };
+
   try {
+    bool gotHeaders = false;
+    char buf[4096];
     while(!req.complete) {
-      int bytes;
-      char buf[1024];
-      bytes = client->readWithTimeout(buf, sizeof(buf), timeout);
-      if (bytes > 0) {
-        string data = string(buf, bytes);
-        req.complete = yarl.feed(data);
-      } else {
-        // read error OR EOF
+      if (gotHeaders) {
+        ssize_t bytes = readSome(buf, sizeof(buf));
+        if (bytes <= 0) // read error OR EOF
+          break;
+        feedBody(string(buf, bytes));
+        continue;
+      }
+
+      auto pos = head.find("\r\n\r\n");
+      size_t sepLen = 4;
+      auto lfPos = head.find("\n\n");
+      if (lfPos < pos) {
+        pos = lfPos;
+        sepLen = 2;
+      }
+      if (pos == string::npos) {
+        if (head.size() > 65536)
+          break; // request stays incomplete
+        ssize_t bytes = readSome(buf, sizeof(buf));
+        if (bytes <= 0) // read error OR EOF
+          break;
+        gotData = true;
+        head.append(buf, bytes);
+        continue;
+      }
+      gotHeaders = true;
+      string data = head.substr(pos + sepLen);
+      req.complete = yarl.feed(head.substr(0, pos + sepLen));
+      head.clear();
+      if (req.complete) {
+        pending = data;
         break;
       }
+
+      YaHTTP::THandlerFunction handler;
+      if (!yarl.chunked && YaHTTP::Router::Route(&req, handler) && req.routeName == s_streamBodyRoute) {
+        if (data.size() > yarl.minbody) {
+          pending = data.substr(yarl.minbody);
+          data.resize(yarl.minbody);
+        }
+        req.d_client = client;
+        req.d_bodyLeft = yarl.minbody - data.size();
+        req.complete = true;
+        yarl.finalize();
+        req.body = data;
+        break;
+      }
+
+      req.max_request_size = maxRequestSize;
+      if (!yarl.chunked && static_cast<ssize_t>(yarl.minbody) > maxRequestSize)
+        break; // request stays incomplete
+      bodyLeft = yarl.minbody;
+      if (!data.empty())
+        feedBody(data);
     }
-    yarl.finalize();
+    if (!req.d_client)
+      yarl.finalize();
   } catch (YaHTTP::ParseError &e) {
     // request stays incomplete
   }
 
+  if (!gotData) // client closed a kept-alive connection
+    return false;
+
   HttpResponse resp;
-  WebServer::handleRequest(req, resp);
-  ostringstream ss;
-  resp.write(ss);
-  string reply = ss.str();
+  StreamingSlot slot(d_streaming);
+  if (req.d_client && !slot.acquire(d_maxStreaming)) {
+    setTooManyStreams(resp);
+  } else {
+    WebServer::handleRequest(req, resp);
+    if (resp.streaming && !slot.acquire(d_maxStreaming))
+      setTooManyStreams(resp);
+  }
 
-  client->writenWithTimeout(reply.c_str(), reply.size(), timeout);
+  // HTTP/1.1 keeps the connection unless told otherwise, HTTP/1.0 only when asked to
+  // After a chunked body the parser keeps what follows to itself, so the
+  // client has to reconnect for its next request.
+  bool keepAlive = false;
+  if (req.complete && !req.d_bodyLeft && !yarl.chunked) {
+    auto header = req.headers.find("connection");
+    string connection = header != req.headers.end() ? toLower(header->second) : "";
+    keepAlive = req.version >= 11 ? connection.find("close") == string::npos : connection.find("keep-alive") != string::npos;
+  }
+  if (resp.streaming && req.version < 11) {
+    // no chunked encoding, the end of the connection marks the end of the body
+    resp.version = req.version;
+    keepAlive = false;
+  }
+  if (keepAlive)
+    resp.headers["Connection"] = "keep-alive";
+
+  SocketStreamBuf buf(client, timeout);
+  std::ostream os(&buf);
+  os.exceptions(std::ios::badbit);
+  resp.write(os);
+  os.flush();
+  return keepAlive;
 }
 catch(PDNSException &e) {
   L<<Logger::Error<<"HTTP Exception: "<<e.reason<<endl;
+  return false;
 }
 catch(std::exception &e) {
   if(strstr(e.what(), "timeout")==0)
     L<<Logger::Error<<"HTTP STL Exception: "<<e.what()<<endl;
+  return false;
 }
 catch(...) {
   L<<Logger::Error<<"HTTP: Unknown exception"<<endl;
+  return false;
 }
 
 WebServer::WebServer(const string &listenaddress, int port) : d_server(NULL)
@@ -354,41 +658,100 @@ void WebServer::go()
   if(!d_server)
     return;
   try {
-    pthread_t tid;
-
     NetmaskGroup acl;
     acl.toMasks(::arg()["webserver-allow-from"]);
 
+    // the workers block on this, so it lives as long as the process does
+    connectionQueue* queue = new connectionQueue;
+    queue->webServer = this;
+    if(pipe(queue->wakeupPipe) < 0)
+      throw PDNSException("Unable to create webserver wakeup pipe: "+stringerror());
+    setNonBlocking(queue->wakeupPipe[0]);
+
+    int threads = ::arg().asNum("webserver-threads");
+    if(threads < 1)
+      threads = 1;
+    d_maxStreaming = std::max(1, threads / 2);
+    for(int n = 0; n < threads; ++n) {
+      pthread_t tid;
+      pthread_create(&tid, 0, &WebServerWorkerThreadStart, (void *)queue);
+    }
+
+    // connections between requests, with the time they were last active
+    const time_t idleTimeout = 5;
+    std::map<int, std::pair<WebConnection*, time_t> > idle;
+    vector<struct pollfd> pfds;
+
+    auto dispatch = [queue](WebConnection* conn) {
+      Lock l(&queue->lock);
+      queue->readable.push_back(conn);
+      pthread_cond_signal(&queue->cond);
+    };
+
     while(true) {
-      // data and data->client will be freed by thread
-      connectionThreadData *data = new connectionThreadData;
-      data->webServer = this;
+      pfds.clear();
+      pfds.push_back({d_server->getHandle(), POLLIN, 0});
+      pfds.push_back({queue->wakeupPipe[0], POLLIN, 0});
+      for(const auto& conn : idle)
+        pfds.push_back({conn.first, POLLIN, 0});
+
+      if(poll(pfds.data(), pfds.size(), 1000) < 0) {
+        if(errno == EINTR)
+          continue;
+        throw PDNSException("poll() on webserver sockets failed: "+stringerror());
+      }
+      time_t now = time(0);
+
+      for(size_t n = 2; n < pfds.size(); ++n) {
+        auto conn = idle.find(pfds[n].fd);
+        if(pfds[n].revents) { // a new request, or the client went away
+          dispatch(conn->second.first);
+          idle.erase(conn);
+        }
+        else if(now - conn->second.second >= idleTimeout) {
+          delete conn->second.first;
+          idle.erase(conn);
+        }
+      }
+
+      if(pfds[1].revents) {
+        char buf[64];
+        while(read(queue->wakeupPipe[0], buf, sizeof(buf)) > 0)
+          ;
+        Lock l(&queue->lock);
+        for(WebConnection* conn : queue->keptAlive)
+          idle[conn->client->getHandle()] = {conn, now};
+        queue->keptAlive.clear();
+      }
+
+      if(!pfds[0].revents)
+        continue;
+
+      Socket* client = nullptr;
       try {
-        data->client = d_server->accept();
-        if (data->client->acl(acl)) {
-          pthread_create(&tid, 0, &WebServerConnectionThreadStart, (void *)data);
+        client = d_server->accept();
+        if (!client)
+          continue;
+        if (client->acl(acl)) {
+          idle[client->getHandle()] = {new WebConnection(client), now};
         } else {
           ComboAddress remote;
-          if (data->client->getRemote(remote))
+          if (client->getRemote(remote))
             L<<Logger::Error<<"Webserver closing socket: remote ("<< remote.toString() <<") does not match 'webserver-allow-from'"<<endl;
-          delete data->client; // close socket
-          delete data;
+          delete client; // close socket
         }
       }
       catch(PDNSException &e) {
         L<<Logger::Error<<"PDNSException while accepting a connection in main webserver thread: "<<e.reason<<endl;
-        delete data->client;
-        delete data;
+        delete client;
       }
       catch(std::exception &e) {
         L<<Logger::Error<<"STL Exception while accepting a connection in main webserver thread: "<<e.what()<<endl;
-        delete data->client;
-        delete data;
+        delete client;
       }
       catch(...) {
         L<<Logger::Error<<"Unknown exception while accepting a connection in main webserver thread"<<endl;
-        delete data->client;
-        delete data;
+        delete client;
       }
     }
   }
@@ -24,6 +24,7 @@
 #include <map>
 #include <string>
 #include <list>
+#include <atomic>
 #include <boost/utility.hpp>
 #include <yahttp/yahttp.hpp>
 #include "json11.hpp"
@@ -44,6 +45,18 @@ public:
   // checks password _only_.
   bool compareAuthorization(const string &expected_password);
   bool compareHeader(const string &header_name, const string &expected_value);
+
+  /** Reads up to len bytes of the body, 0 when all of it has been read. For
+      handlers registered with streamBody set, this reads from the client
+      while the handler runs, otherwise it returns what is in body. */
+  size_t readBody(char* buf, size_t len);
+
+private:
+  friend class WebServer;
+
+  Socket* d_client{nullptr}; //!< set when the body is still to be read from the client
+  size_t d_bodyPos{0};
+  size_t d_bodyLeft{0};
 };
 
 class HttpResponse: public YaHTTP::Response {
@@ -54,6 +67,13 @@ public:
   void setBody(const json11::Json& document);
   void setErrorResult(const std::string& message, const int status);
   void setSuccessResult(const std::string& message, const int status = 200);
+
+  /** The body is produced while it is being sent: producer is called until
+      it returns false, and each time fills piece with the next part. */
+  typedef boost::function<bool(std::string& piece)> BodyProducer;
+  void setStreamingBody(BodyProducer producer);
+
+  bool streaming{false};
 };
 
 
@@ -129,6 +149,10 @@ public:
     return d_server_socket.accept();
   }
 
+  int getHandle() const {
+    return d_server_socket.getHandle();
+  }
+
 protected:
   Socket d_server_socket;
 };
@@ -140,15 +164,19 @@ public:
   void bind();
   void go();
 
-  void serveConnection(Socket *client);
+  /** Serves one request, returns true if the client may send another one
+      over \a client. That request starts with \a pending, which is filled
+      with anything the client sent past the one served. */
+  bool serveConnection(Socket *client, string& pending);
   void handleRequest(HttpRequest& request, HttpResponse& resp);
 
   typedef boost::function<void(HttpRequest* req, HttpResponse* resp)> HandlerFunction;
-  void registerApiHandler(const string& url, HandlerFunction handler);
+  //! with streamBody, the handler reads the request body itself through HttpRequest::readBody()
+  void registerApiHandler(const string& url, HandlerFunction handler, bool streamBody=false);
   void registerWebHandler(const string& url, HandlerFunction handler);
 
 protected:
-  void registerBareHandler(const string& url, HandlerFunction handler);
+  void registerBareHandler(const string& url, HandlerFunction handler, bool streamBody=false);
 
   virtual Server* createServer() {
     return new Server(d_listenaddress, d_port);
@@ -158,6 +186,10 @@ protected:
   int d_port;
   string d_password;
   Server* d_server;
+
+private:
+  std::atomic<int> d_streaming{0}; //!< requests with a streamed body or response being served
+  int d_maxStreaming{1};
 };
 
 #endif /* WEBSERVER_HH */
@@ -30,6 +30,7 @@
 #include "json.hh"
 #include "version.hh"
 #include "arguments.hh"
+#include "lock.hh"
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
@@ -192,10 +193,18 @@ void apiServerSearchLog(HttpRequest* req, HttpResponse* resp) {
   resp->setBody(logGrep(req->getvars["q"], ::arg()["api-logfile"], prefix));
 }
 
-void apiServerStatistics(HttpRequest* req, HttpResponse* resp) {
-  if(req->method != "GET")
-    throw HttpMethodNotAllowedException();
+static pthread_mutex_t s_statisticsLock = PTHREAD_MUTEX_INITIALIZER;
+static string s_statisticsSnapshot;
+static time_t s_statisticsRendered;
+static std::atomic<unsigned int> s_statisticsInterval{0};
 
+void apiSetStatisticsInterval(unsigned int seconds)
+{
+  s_statisticsInterval = seconds;
+}
+
+static void renderStatistics(string& body)
+{
   map<string,string> items;
   productServerStatisticsFetch(items);
 
@@ -209,7 +218,29 @@ void apiServerStatistics(HttpRequest* req, HttpResponse* resp) {
     });
   }
 
-  resp->setBody(doc);
+  body.clear();
+  Json(doc).dump(body);
+}
+
+void apiServerStatistics(HttpRequest* req, HttpResponse* resp) {
+  if(req->method != "GET")
+    throw HttpMethodNotAllowedException();
+
+  unsigned int interval = s_statisticsInterval;
+  if(!interval) {
+    renderStatistics(resp->body);
+    return;
+  }
+
+  // monitoring tends to poll this often, from many places, so everyone
+  // within the same interval gets the same document
+  time_t now = time(0);
+  Lock l(&s_statisticsLock);
+  if(now - s_statisticsRendered >= (time_t)interval) {
+    renderStatistics(s_statisticsSnapshot);
+    s_statisticsRendered = now;
+  }
+  resp->body = s_statisticsSnapshot;
 }
 
 DNSName apiNameToDNSName(const string& name) {
@@ -32,6 +32,7 @@ void apiServerDetail(HttpRequest* req, HttpResponse* resp);
 void apiServerConfig(HttpRequest* req, HttpResponse* resp);
 void apiServerSearchLog(HttpRequest* req, HttpResponse* resp);
 void apiServerStatistics(HttpRequest* req, HttpResponse* resp);
+void apiSetStatisticsInterval(unsigned int seconds); //!< reuse the statistics document for this long, 0 renders it for every request
 
 // helpers
 DNSName apiZoneIdToName(const string& id);
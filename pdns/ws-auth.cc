@@ -44,6 +44,8 @@
 #include "zoneparser-tng.hh"
 #include "common_startup.hh"
 #include "auth-caches.hh"
+#include "auth-zonecache.hh"
+#include "auth-ixfrjournal.hh"
 
 using json11::Json;
 
@@ -61,6 +63,7 @@ AuthWebServer::AuthWebServer()
   d_tid = 0;
   if(arg().mustDo("webserver") || arg().mustDo("api")) {
     d_ws = new WebServer(arg()["webserver-address"], arg().asNum("webserver-port"));
+    apiSetStatisticsInterval(arg().asNum("webserver-statistics-interval"));
     d_ws->bind();
   }
 }
@@ -434,6 +437,28 @@ void productServerStatisticsFetch(map<string,string>& out)
   out["uptime"] = std::to_string(time(0) - s_starttime);
 }
 
+// validate that the client sent something we can actually parse, and require that data to be dotted.
+static void setRecordContent(DNSResourceRecord& rr, const string& content) {
+  try {
+    if (rr.qtype.getCode() != QType::AAAA) {
+      string tmp = makeApiRecordContent(rr.qtype, content);
+      if (!pdns_iequals(tmp, content)) {
+        throw std::runtime_error("Not in expected format (parsed as '"+tmp+"')");
+      }
+    } else {
+      struct in6_addr tmpbuf;
+      if (inet_pton(AF_INET6, content.c_str(), &tmpbuf) != 1 || content.find('.') != string::npos) {
+        throw std::runtime_error("Invalid IPv6 address");
+      }
+    }
+    rr.content = makeBackendRecordContent(rr.qtype, content);
+  }
+  catch(std::exception& e)
+  {
+    throw ApiException("Record "+rr.qname.toString()+"/"+rr.qtype.getName()+" '"+content+"': "+e.what());
+  }
+}
+
 static void gatherRecords(const Json container, const DNSName& qname, const QType qtype, const int ttl, vector<DNSResourceRecord>& new_records, vector<DNSResourceRecord>& new_ptrs) {
   UeberBackend B;
   DNSResourceRecord rr;
@@ -444,26 +469,7 @@ static void gatherRecords(const Json container, const DNSName& qname, const QTyp
   for(auto record : container["records"].array_items()) {
     string content = stringFromJson(record, "content");
     rr.disabled = boolFromJson(record, "disabled");
-
-    // validate that the client sent something we can actually parse, and require that data to be dotted.
-    try {
-      if (rr.qtype.getCode() != QType::AAAA) {
-        string tmp = makeApiRecordContent(rr.qtype, content);
-        if (!pdns_iequals(tmp, content)) {
-          throw std::runtime_error("Not in expected format (parsed as '"+tmp+"')");
-        }
-      } else {
-        struct in6_addr tmpbuf;
-        if (inet_pton(AF_INET6, content.c_str(), &tmpbuf) != 1 || content.find('.') != string::npos) {
-          throw std::runtime_error("Invalid IPv6 address");
-        }
-      }
-      rr.content = makeBackendRecordContent(rr.qtype, content);
-    }
-    catch(std::exception& e)
-    {
-      throw ApiException("Record "+rr.qname.toString()+"/"+rr.qtype.getName()+" '"+content+"': "+e.what());
-    }
+    setRecordContent(rr, content);
 
     if ((rr.qtype.getCode() == QType::A || rr.qtype.getCode() == QType::AAAA) &&
         boolFromJson(record, "set-ptr", false) == true) {
@@ -1185,6 +1191,8 @@ static void apiServerZoneDetail(HttpRequest* req, HttpResponse* resp) {
 
     if(!di.backend->deleteDomain(zonename))
       throw ApiException("Deleting domain '"+zonename.toString()+"' failed: backend delete failed/unsupported");
+    g_zoneCache.remove(zonename);
+    g_ixfrJournal.clear(zonename);
 
     // empty body on success
     resp->body = "";
@@ -1201,40 +1209,226 @@ static void apiServerZoneDetail(HttpRequest* req, HttpResponse* resp) {
   throw HttpMethodNotAllowedException();
 }
 
+namespace {
+// A zone listing that is read from the backend while the response is being sent.
+class ZoneListing
+{
+public:
+  ZoneListing(const DNSName& zonename, bool includeDisabled=false) : d_zonename(zonename)
+  {
+    if(!d_B.getDomainInfo(zonename, d_di))
+      throw ApiException("Could not find domain '"+zonename.toString()+"'");
+    gettimeofday(&d_start, 0);
+    d_di.backend->list(zonename, d_di.id, includeDisabled);
+  }
+
+  //! returns false once all records have been read
+  bool next(DNSResourceRecord& rr)
+  {
+    while(!d_done) {
+      if(!d_di.backend->get(rr)) {
+        d_done = true;
+        struct timeval now;
+        gettimeofday(&now, 0);
+        double seconds = makeFloat(now - d_start);
+        L<<Logger::Info<<"API: exported "<<d_records<<" records of zone '"<<d_zonename<<"' in "<<seconds<<" seconds ("<<(seconds > 0 ? d_records / seconds : 0)<<" records/s)"<<endl;
+        break;
+      }
+      if (!rr.qtype.getCode())
+        continue; // skip empty non-terminals
+      d_records++;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  UeberBackend d_B;
+  DomainInfo d_di;
+  DNSName d_zonename;
+  struct timeval d_start;
+  uint64_t d_records{0};
+  bool d_done{false};
+};
+}
+
+// size of the pieces streamed zone contents are sent in
+static const size_t s_zonePieceSize = 65536;
+
 static void apiServerZoneExport(HttpRequest* req, HttpResponse* resp) {
   DNSName zonename = apiZoneIdToName(req->parameters["id"]);
 
   if(req->method != "GET")
     throw HttpMethodNotAllowedException();
 
-  ostringstream ss;
+  auto listing = std::make_shared<ZoneListing>(zonename);
+  auto format = [](const DNSResourceRecord& rr, string& out) {
+    out += rr.qname.toString() + "\t" +
+      std::to_string(rr.ttl) + "\t" +
+      rr.qtype.getName() + "\t" +
+      makeApiRecordContent(rr.qtype, rr.content) + "\n";
+  };
 
+  if (req->accept_json) {
+    string zone;
+    DNSResourceRecord rr;
+    while(listing->next(rr))
+      format(rr, zone);
+    resp->setBody(Json::object { { "zone", zone } });
+  } else {
+    resp->headers["Content-Type"] = "text/plain; charset=us-ascii";
+    resp->setStreamingBody([listing, format](string& piece) {
+      DNSResourceRecord rr;
+      while(piece.size() < s_zonePieceSize && listing->next(rr))
+        format(rr, piece);
+      return !piece.empty();
+    });
+  }
+}
+
+static DNSResourceRecord recordFromJsonLine(const string& line, const DNSName& zonename) {
+  string err;
+  Json record = Json::parse(line, err);
+  if (!record.is_object())
+    throw ApiException("Could not parse record: "+(err.empty() ? "not an object" : err));
+
+  DNSResourceRecord rr;
+  rr.qname = apiNameToDNSName(stringFromJson(record, "name"));
+  apiCheckQNameAllowedCharacters(rr.qname.toString());
+  rr.qtype = stringFromJson(record, "type");
+  if (rr.qtype.getCode() == 0)
+    throw ApiException("Record "+rr.qname.toString()+" IN "+stringFromJson(record, "type")+": unknown type given");
+  if (!rr.qname.isPartOf(zonename) && rr.qname != zonename)
+    throw ApiException("Record "+rr.qname.toString()+" IN "+rr.qtype.getName()+": Name is out of zone");
+  rr.ttl = intFromJson(record, "ttl");
+  rr.disabled = boolFromJson(record, "disabled", false);
+  rr.auth = 1;
+  setRecordContent(rr, stringFromJson(record, "content"));
+  return rr;
+}
+
+// Replaces all records of the zone with those in the request body, one JSON
+// object per line. The body is read while the records are fed to the backend.
+static void importZoneRecords(HttpRequest* req, HttpResponse* resp, const DNSName& zonename) {
   UeberBackend B;
   DomainInfo di;
   if(!B.getDomainInfo(zonename, di))
     throw ApiException("Could not find domain '"+zonename.toString()+"'");
 
-  DNSResourceRecord rr;
-  SOAData sd;
-  di.backend->list(zonename, di.id);
-  while(di.backend->get(rr)) {
-    if (!rr.qtype.getCode())
-      continue; // skip empty non-terminals
-
-    ss <<
-      rr.qname.toString() << "\t" <<
-      rr.ttl << "\t" <<
-      rr.qtype.getName() << "\t" <<
-      makeApiRecordContent(rr.qtype, rr.content) <<
-      endl;
+  string soa_edit_api_kind;
+  string soa_edit_kind;
+  di.backend->getDomainMetadataOne(zonename, "SOA-EDIT-API", soa_edit_api_kind);
+  di.backend->getDomainMetadataOne(zonename, "SOA-EDIT", soa_edit_kind);
+
+  struct timeval start;
+  gettimeofday(&start, 0);
+  uint64_t records = 0;
+
+  if(!di.backend->startTransaction(zonename, di.id))
+    throw ApiException("Hosting backend does not support replacing zone contents.");
+
+  try {
+    bool have_soa = false;
+    uint64_t lineno = 0;
+    string buffer;
+    char buf[s_zonePieceSize];
+    bool eof = false;
+
+    while(!eof) {
+      size_t len = req->readBody(buf, sizeof(buf));
+      if (len)
+        buffer.append(buf, len);
+      else
+        eof = true;
+
+      string::size_type begin = 0;
+      while(begin < buffer.size()) {
+        string::size_type end = buffer.find('\n', begin);
+        if (end == string::npos) {
+          if (!eof)
+            break;
+          end = buffer.size();
+        }
+        string line = buffer.substr(begin, end - begin);
+        begin = end + 1;
+        lineno++;
+
+        boost::trim(line);
+        if (line.empty())
+          continue;
+
+        try {
+          DNSResourceRecord rr = recordFromJsonLine(line, zonename);
+          rr.domain_id = di.id;
+          if (rr.qtype.getCode() == QType::SOA && rr.qname == zonename) {
+            have_soa = true;
+            increaseSOARecord(rr, soa_edit_api_kind, soa_edit_kind);
+            // fixup dots after serializeSOAData/increaseSOARecord
+            rr.content = makeBackendRecordContent(rr.qtype, rr.content);
+          }
+          di.backend->feedRecord(rr);
+          records++;
+        }
+        catch(ApiException& e) {
+          throw ApiException("Line "+std::to_string(lineno)+": "+e.what());
+        }
+      }
+      buffer.erase(0, begin);
+      if (buffer.size() > s_zonePieceSize)
+        throw ApiException("Line "+std::to_string(lineno + 1)+": record is too long");
+    }
+
+    if (!have_soa)
+      throw ApiException("Zone '"+zonename.toString()+"' must have a SOA record");
+  } catch(...) {
+    di.backend->abortTransaction();
+    throw;
   }
+  di.backend->commitTransaction();
+  g_ixfrJournal.clear(zonename);
 
-  if (req->accept_json) {
-    resp->setBody(Json::object { { "zone", ss.str() } });
-  } else {
-    resp->headers["Content-Type"] = "text/plain; charset=us-ascii";
-    resp->body = ss.str();
+  purgeAuthCaches(zonename.toString()+"$");
+
+  struct timeval now;
+  gettimeofday(&now, 0);
+  double seconds = makeFloat(now - start);
+  double rate = seconds > 0 ? records / seconds : 0;
+  L<<Logger::Warning<<"API: imported "<<records<<" records into zone '"<<zonename<<"' in "<<seconds<<" seconds ("<<rate<<" records/s)"<<endl;
+
+  resp->setBody(Json::object {
+    { "records", (double)records },
+    { "seconds", seconds },
+    { "records_per_second", rate },
+  });
+}
+
+static void apiServerZoneRecords(HttpRequest* req, HttpResponse* resp) {
+  DNSName zonename = apiZoneIdToName(req->parameters["id"]);
+
+  if(req->method == "PUT" && !::arg().mustDo("api-readonly")) {
+    importZoneRecords(req, resp, zonename);
+    return;
   }
+  else if(req->method != "GET")
+    throw HttpMethodNotAllowedException();
+
+  // disabled records too, so what is read here can be PUT back as is
+  auto listing = std::make_shared<ZoneListing>(zonename, true);
+  resp->headers["Content-Type"] = "application/x-ndjson";
+  resp->setStreamingBody([listing](string& piece) {
+    DNSResourceRecord rr;
+    while(piece.size() < s_zonePieceSize && listing->next(rr)) {
+      Json(Json::object {
+        { "name", rr.qname.toString() },
+        { "type", rr.qtype.getName() },
+        { "ttl", (double)rr.ttl },
+        { "content", makeApiRecordContent(rr.qtype, rr.content) },
+        { "disabled", rr.disabled },
+      }).dump(piece);
+      piece += "\n";
+    }
+    return !piece.empty();
+  });
 }
 
 static void apiServerZoneAxfrRetrieve(HttpRequest* req, HttpResponse* resp) {
@@ -1372,6 +1566,7 @@ static void patchZone(HttpRequest* req, HttpResponse* resp) {
     throw ApiException("No rrsets given in update request");
 
   di.backend->startTransaction(zonename);
+  IXFRJournalRecorder journal(di.backend, zonename, di.id);
 
   try {
     string soa_edit_api_kind;
@@ -1392,6 +1587,7 @@ static void patchZone(HttpRequest* req, HttpResponse* resp) {
 
       if (changetype == "DELETE") {
         // delete all matching qname/qtype RRs (and, implicitly comments).
+        journal.touch(qname, qtype);
         if (!di.backend->replaceRRSet(di.id, qname, qtype, vector<DNSResourceRecord>())) {
           throw ApiException("Hosting backend does not support editing records.");
         }
@@ -1435,6 +1631,7 @@ static void patchZone(HttpRequest* req, HttpResponse* resp) {
         }
 
         if (replace_records) {
+          journal.touch(qname, qtype);
           if (!di.backend->replaceRRSet(di.id, qname, qtype, new_records)) {
             throw ApiException("Hosting backend does not support editing records.");
           }
@@ -1471,11 +1668,13 @@ static void patchZone(HttpRequest* req, HttpResponse* resp) {
       }
     }
 
+    journal.finish();
   } catch(...) {
     di.backend->abortTransaction();
     throw;
   }
   di.backend->commitTransaction();
+  journal.commit();
 
   purgeAuthCachesExact(zonename);
 
@@ -1635,6 +1834,7 @@ void AuthWebServer::webThread()
       d_ws->registerApiHandler("/api/v1/servers/localhost/zones/<id>/metadata/<kind>", &apiZoneMetadataKind);
       d_ws->registerApiHandler("/api/v1/servers/localhost/zones/<id>/metadata", &apiZoneMetadata);
       d_ws->registerApiHandler("/api/v1/servers/localhost/zones/<id>/notify", &apiServerZoneNotify);
+      d_ws->registerApiHandler("/api/v1/servers/localhost/zones/<id>/records", &apiServerZoneRecords, true);
       d_ws->registerApiHandler("/api/v1/servers/localhost/zones/<id>", &apiServerZoneDetail);
       d_ws->registerApiHandler("/api/v1/servers/localhost/zones", &apiServerZones);
       d_ws->registerApiHandler("/api/v1/servers/localhost", &apiServerDetail);
@@ -660,6 +660,79 @@ fred   IN  A      192.168.0.4
                          ' 0 10800 3600 604800 3600']
         self.assertEquals(data, expected_data)
 
+    def get_zone_records(self, name):
+        r = self.session.get(self.url("/api/v1/servers/localhost/zones/" + name + "/records"))
+        self.assert_success(r)
+        self.assertEquals(r.headers['Content-Type'], 'application/x-ndjson')
+        records = [json.loads(line) for line in r.text.strip().split('\n')]
+        return sorted(records, key=lambda rr: (rr['name'], rr['type'], rr['content']))
+
+    def put_zone_records(self, name, records):
+        body = ''.join(line if isinstance(line, basestring) else json.dumps(line) + '\n' for line in records)
+        return self.session.put(
+            self.url("/api/v1/servers/localhost/zones/" + name + "/records"),
+            data=body,
+            headers={'content-type': 'application/x-ndjson'})
+
+    def test_zone_records_roundtrip(self):
+        name, payload, zone = self.create_zone(nameservers=['ns1.foo.com.', 'ns2.foo.com.'], soa_edit_api='')
+        records = self.get_zone_records(name)
+        self.assertEquals(sorted((rr['name'], rr['type'], rr['content']) for rr in records),
+                          [(name, 'NS', 'ns1.foo.com.'),
+                           (name, 'NS', 'ns2.foo.com.'),
+                           (name, 'SOA', 'a.misconfigured.powerdns.server. hostmaster.' + name +
+                            ' 0 10800 3600 604800 3600')])
+        for i in range(1000):
+            records.append({'name': 'host%d.%s' % (i, name), 'type': 'A', 'ttl': 300,
+                            'content': '192.0.2.%d' % (i % 256), 'disabled': False})
+        records.append({'name': 'off.' + name, 'type': 'A', 'ttl': 300, 'content': '192.0.2.1', 'disabled': True})
+        r = self.put_zone_records(name, records)
+        self.assert_success_json(r)
+        self.assertEquals(r.json()['records'], len(records))
+        self.assertEquals(self.get_zone_records(name),
+                          sorted(records, key=lambda rr: (rr['name'], rr['type'], rr['content'])))
+        # the text export is streamed from the same listing, disabled records are left out
+        r = self.session.get(
+            self.url("/api/v1/servers/localhost/zones/" + name + "/export"),
+            headers={'accept': '*/*'}
+        )
+        self.assert_success(r)
+        self.assertEquals(r.headers.get('Transfer-Encoding'), 'chunked')
+        data = r.text.strip().split("\n")
+        self.assertEquals(len(data), len(records) - 1)
+        self.assertIn('host999.' + name + '\t300\tA\t192.0.2.231', data)
+        self.assertNotIn('off.' + name + '\t300\tA\t192.0.2.1', data)
+
+    def test_zone_records_import_bad_line(self):
+        name, payload, zone = self.create_zone(nameservers=['ns1.foo.com.', 'ns2.foo.com.'], soa_edit_api='')
+        records = self.get_zone_records(name)
+        r = self.put_zone_records(name, records[:1] + ['{"name": "www.' + name + '", "type": \n'] + records[1:])
+        self.assert_error_json(r)
+        self.assertEquals(r.status_code, 422)
+        self.assertIn('Line 2: ', r.json()['error'])
+        # the zone is left as it was
+        self.assertEquals(self.get_zone_records(name), records)
+
+    def test_zone_records_import_missing_soa(self):
+        name, payload, zone = self.create_zone(nameservers=['ns1.foo.com.', 'ns2.foo.com.'], soa_edit_api='')
+        records = self.get_zone_records(name)
+        r = self.put_zone_records(name, [rr for rr in records if rr['type'] != 'SOA'])
+        self.assert_error_json(r)
+        self.assertEquals(r.status_code, 422)
+        self.assertIn('must have a SOA record', r.json()['error'])
+        self.assertEquals(self.get_zone_records(name), records)
+
+    def test_zone_records_import_out_of_zone(self):
+        name, payload, zone = self.create_zone(nameservers=['ns1.foo.com.', 'ns2.foo.com.'], soa_edit_api='')
+        records = self.get_zone_records(name)
+        r = self.put_zone_records(name, records + [{'name': 'not-in-zone.', 'type': 'A', 'ttl': 300,
+                                                    'content': '192.0.2.1', 'disabled': False}])
+        self.assert_error_json(r)
+        self.assertEquals(r.status_code, 422)
+        self.assertIn('Line %d: ' % (len(records) + 1), r.json()['error'])
+        self.assertIn('out of zone', r.json()['error'])
+        self.assertEquals(self.get_zone_records(name), records)
+
     def test_update_zone(self):
         name, payload, zone = self.create_zone()
         name = payload['name']